@@ -613,25 +613,52 @@ static void Png_EncodeRow(const cc_uint8* cur, const cc_uint8* prior, cc_uint8*
 	best[0] = bestFilter;
 }
 
+/* Buffers compressed image data, writing it out as an IDAT chunk whenever the buffer is full */
+/* NOTE: This means the size of an IDAT chunk is always known before it is written, */
+/*  so there is no need to seek back afterwards to fixup the size of the chunk */
+#define PNG_IDAT_SIZE 8192
+static cc_result Png_FlushIdat(struct Stream* stream) {
+	cc_uint8* data = stream->Meta.Buffered.Base;
+	cc_uint32 len  = (cc_uint32)(stream->Meta.Buffered.Cur - data) - 8;
+	if (!len) return 0;
+
+	Stream_SetU32_BE(&data[0], len);
+	Stream_SetU32_BE(&data[4], PNG_FourCC('I','D','A','T'));
+	Stream_SetU32_BE(&data[len + 8], Utils_CRC32(&data[4], len + 4));
+
+	stream->Meta.Buffered.Cur  = data + 8;
+	stream->Meta.Buffered.Left = PNG_IDAT_SIZE;
+	return Stream_Write(stream->Meta.Buffered.Source, data, len + 12);
+}
+
+static cc_result Png_IdatWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	if (count > stream->Meta.Buffered.Left) count = stream->Meta.Buffered.Left;
+	Mem_Copy(stream->Meta.Buffered.Cur, data, count);
+
+	stream->Meta.Buffered.Cur  += count;
+	stream->Meta.Buffered.Left -= count;
+	*modified = count;
+
+	if (stream->Meta.Buffered.Left) return 0;
+	return Png_FlushIdat(stream);
+}
+
 static int Png_SelectRow(Bitmap* bmp, int y) { return y; }
 cc_result Png_Encode(Bitmap* bmp, struct Stream* stream, Png_RowSelector selectRow, cc_bool alpha) {
 	cc_uint8 tmp[32];
 	/* TODO: This should be * 4 for alpha (should switch to mem_alloc though) */
 	cc_uint8 prevLine[PNG_MAX_DIMS * 3], curLine[PNG_MAX_DIMS * 3];
 	cc_uint8 bestLine[PNG_MAX_DIMS * 3 + 1];
+	/* 8 bytes for chunk size and type, 4 bytes for chunk CRC32 */
+	cc_uint8 idat[8 + PNG_IDAT_SIZE + 4];
 
 	struct ZLibState zlState;
 	struct Stream chunk, zlStream;
-	cc_uint32 stream_end, stream_beg;
 	int y, lineSize;
 	cc_result res;
 
-	/* stream may not start at 0 (e.g. when making default.zip) */
-	if ((res = stream->Position(stream, &stream_beg))) return res;
-
 	if (!selectRow) selectRow = Png_SelectRow;
 	if ((res = Stream_Write(stream, pngSig, PNG_SIG_SIZE))) return res;
-	Stream_WriteonlyCrc32(&chunk, stream);
 
 	/* Write header chunk */
 	Stream_SetU32_BE(&tmp[0], PNG_IHDR_SIZE);
@@ -646,14 +673,17 @@ cc_result Png_Encode(Bitmap* bmp, struct Stream* stream, Png_RowSelector selectR
 		tmp[20] = 0;           /* Not using interlacing */
 	}
 	Stream_SetU32_BE(&tmp[21], Utils_CRC32(&tmp[4], 17));
+	if ((res = Stream_Write(stream, tmp, 25))) return res;
 
 	/* Write PNG body */
-	Stream_SetU32_BE(&tmp[25], 0); /* size of IDAT, filled in later */
-	if ((res = Stream_Write(stream, tmp, 29))) return res;
-	Stream_SetU32_BE(&tmp[0], PNG_FourCC('I','D','A','T'));
-	if ((res = Stream_Write(&chunk, tmp, 4))) return res;
-
-	ZLib_MakeStream(&zlStream, &zlState, &chunk); 
+	Stream_Init(&chunk);
+	chunk.Write = Png_IdatWrite;
+	chunk.Meta.Buffered.Base   = idat;
+	chunk.Meta.Buffered.Cur    = idat + 8;
+	chunk.Meta.Buffered.Left   = PNG_IDAT_SIZE;
+	chunk.Meta.Buffered.Source = stream;
+
+	ZLib_MakeStream(&zlStream, &zlState, &chunk);
 	lineSize = bmp->Width * (alpha ? 4 : 3);
 	Mem_Set(prevLine, 0, lineSize);
 
@@ -670,19 +700,11 @@ cc_result Png_Encode(Bitmap* bmp, struct Stream* stream, Png_RowSelector selectR
 		if ((res = Stream_Write(&zlStream, bestLine, lineSize + 1))) return res;
 	}
 	if ((res = zlStream.Close(&zlStream))) return res;
-	Stream_SetU32_BE(&tmp[0], chunk.Meta.CRC32.CRC32 ^ 0xFFFFFFFFUL);
+	if ((res = Png_FlushIdat(&chunk)))      return res;
 
 	/* Write end chunk */
-	Stream_SetU32_BE(&tmp[4],  0);
-	Stream_SetU32_BE(&tmp[8],  PNG_FourCC('I','E','N','D'));
-	Stream_SetU32_BE(&tmp[12], 0xAE426082UL); /* CRC32 of IEND */
-	if ((res = Stream_Write(stream, tmp, 16))) return res;
-
-	/* Come back to fixup size of data in data chunk */
-	if ((res = stream->Length(stream, &stream_end)))   return res;
-	if ((res = stream->Seek(stream, stream_beg + 33))) return res;
-
-	Stream_SetU32_BE(&tmp[0], (stream_end - stream_beg) - 57);
-	if ((res = Stream_Write(stream, tmp, 4))) return res;
-	return stream->Seek(stream, stream_end);
+	Stream_SetU32_BE(&tmp[0], 0);
+	Stream_SetU32_BE(&tmp[4], PNG_FourCC('I','E','N','D'));
+	Stream_SetU32_BE(&tmp[8], 0xAE426082UL); /* CRC32 of IEND */
+	return Stream_Write(stream, tmp, 12);
 }
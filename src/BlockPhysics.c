@@ -85,22 +85,192 @@ static cc_uint32 TickQueue_Dequeue(struct TickQueue* queue) {
 }
 
 
+/* Liquid physics tick entries are stored in a timing wheel, which has a queue for each of the next few ticks. */
+/* As entries are scheduled directly into the queue for the tick they are due on, each tick only needs to */
+/*  process the entries that are actually due. (delays are always less than PHYSICS_WHEEL_SLOTS ticks) */
+#define PHYSICS_WHEEL_SLOTS 64
+struct TickWheel {
+	struct TickQueue slots[PHYSICS_WHEEL_SLOTS];
+	struct TickQueue overdue; /* Entries deferred from earlier ticks, due to going over the tick budget */
+	cc_uint32 tick; /* Number of ticks processed so far */
+};
+
+static void TickWheel_Init(struct TickWheel* wheel) {
+	int i;
+	for (i = 0; i < PHYSICS_WHEEL_SLOTS; i++) { TickQueue_Init(&wheel->slots[i]); }
+	TickQueue_Init(&wheel->overdue);
+	wheel->tick = 0;
+}
+
+static void TickWheel_Clear(struct TickWheel* wheel) {
+	int i;
+	for (i = 0; i < PHYSICS_WHEEL_SLOTS; i++) { TickQueue_Clear(&wheel->slots[i]); }
+	TickQueue_Clear(&wheel->overdue);
+	wheel->tick = 0;
+}
+
+/* Returns the total number of entries in the wheel */
+static int TickWheel_Count(struct TickWheel* wheel) {
+	int i, count = wheel->overdue.count;
+	for (i = 0; i < PHYSICS_WHEEL_SLOTS; i++) { count += wheel->slots[i].count; }
+	return count;
+}
+
+/* Schedules the block at the given index to be processed 'delay' ticks after the next tick. */
+static void TickWheel_Schedule(struct TickWheel* wheel, int index, int delay) {
+	cc_uint32 slot = (wheel->tick + delay) & (PHYSICS_WHEEL_SLOTS - 1);
+	TickQueue_Enqueue(&wheel->slots[slot], (cc_uint32)index);
+}
+
+/* Advances to the next tick, returning the queue of entries that are due on it. */
+static struct TickQueue* TickWheel_Advance(struct TickWheel* wheel) {
+	cc_uint32 slot = wheel->tick++ & (PHYSICS_WHEEL_SLOTS - 1);
+	return &wheel->slots[slot];
+}
+
+
 struct Physics_ Physics;
 static RNGState physics_rnd;
 static int physics_tickCount;
 static int physics_maxWaterX, physics_maxWaterY, physics_maxWaterZ;
-static struct TickQueue lavaQ, waterQ;
+static struct TickWheel lavaQ, waterQ;
+/* Number of blocks with an OnRandomTick handler in each chunk (see World_SectionIndex) */
+/* NOTE: NULL when physics is disabled or there is no world. */
+static cc_uint16* physics_tickable;
+
+#ifdef EXTENDED_BLOCKS
+#define Physics_GetBlock(index) ((BlockID)((World.Blocks[index] | (World.Blocks2[index] << 8)) & World.IDMask))
+#else
+#define Physics_GetBlock(index) World.Blocks[index]
+#endif
+#define Physics_IsTickable(block) ((block) < 256 && Physics.OnRandomTick[block])
+
+#define PHYSICS_ONE_DELAY    1
+#define PHYSICS_LAVA_DELAY  30
+#define PHYSICS_WATER_DELAY  5
+
+
+/* When profiling is enabled, time spent in and number of calls to each physics handler are recorded. */
+/* Time spent in handlers called by another handler (e.g. TNT activating sand) is excluded from the caller. */
+enum PhysicsProfileType { PROFILE_PLACE, PROFILE_DELETE, PROFILE_ACTIVATE, PROFILE_RANDOM, PROFILE_TICK, PROFILE_COUNT };
+static const char* const profile_names[PROFILE_COUNT] = { "place", "delete", "activate", "random tick", "tick" };
+
+static struct PhysicsProfile {
+	cc_uint64 time[PROFILE_COUNT][256]; /* Stopwatch time spent in each handler */
+	cc_uint32 calls[PROFILE_COUNT][256];
+	cc_uint64 nested;   /* Stopwatch time spent in handlers called by the current handler */
+	cc_uint64 tickTime; /* Stopwatch time spent in Physics_Tick */
+} profile;
+
+static void Physics_Invoke(int type, PhysicsHandler handler, int index, BlockID block) {
+	cc_uint64 beg, elapsed, outer;
+	if (!Physics.Profiling) { handler(index, block); return; }
+
+	outer = profile.nested;
+	profile.nested = 0;
+	beg = Stopwatch_Measure();
+	handler(index, block);
+
+	elapsed = Stopwatch_Measure() - beg;
+	profile.time[type][block] += elapsed - profile.nested;
+	profile.calls[type][block]++;
+	profile.nested = outer + elapsed;
+}
+
+void Physics_ReportProfile(String* dst) {
+	int type, block, calls, worstType = 0, worstBlock = 0;
+	int lava, water;
+	cc_uint64 worst = 0;
+	float ms;
+	String name;
+	if (!Physics.Profiling) return;
+
+	for (type = 0; type < PROFILE_COUNT; type++) {
+		for (block = 0; block < 256; block++) {
+			calls = profile.calls[type][block];
+			if (!calls) continue;
+
+			ms   = Stopwatch_ElapsedMicroseconds(0, profile.time[type][block]) / 1000.0f;
+			name = Block_UNSAFE_GetName(block);
+			Platform_Log4("Physics: %s %c - %i calls, %f3 ms", &name, profile_names[type], &calls, &ms);
+
+			if (profile.time[type][block] < worst) continue;
+			worst = profile.time[type][block]; worstType = type; worstBlock = block;
+		}
+	}
+
+	ms    = Stopwatch_ElapsedMicroseconds(0, profile.tickTime) / 1000.0f;
+	lava  = TickWheel_Count(&lavaQ);
+	water = TickWheel_Count(&waterQ);
+	Platform_Log3("Physics: %f3 ms ticking, %i lava and %i water queued", &ms, &lava, &water);
+
+	String_Format1(dst, ", physics %f1 ms", &ms);
+	if (worst) {
+		name = Block_UNSAFE_GetName(worstBlock);
+		String_Format2(dst, " (%s %c)", &name, profile_names[worstType]);
+	}
+	if (lava || water) String_Format2(dst, ", %i lava %i water", &lava, &water);
 
-#define PHYSICS_DELAY_MASK 0xF8000000UL
-#define PHYSICS_POS_MASK   0x07FFFFFFUL
-#define PHYSICS_DELAY_SHIFT 27
-#define PHYSICS_ONE_DELAY   (1U << PHYSICS_DELAY_SHIFT)
-#define PHYSICS_LAVA_DELAY (30U << PHYSICS_DELAY_SHIFT)
-#define PHYSICS_WATER_DELAY (5U << PHYSICS_DELAY_SHIFT)
+	Mem_Set(profile.time,  0, sizeof(profile.time));
+	Mem_Set(profile.calls, 0, sizeof(profile.calls));
+	profile.tickTime = 0;
+}
+
+static void Physics_FreeTickable(void) {
+	Mem_Free(physics_tickable);
+	physics_tickable = NULL;
+}
+
+/* Counts the number of randomly ticked blocks in each chunk of the world */
+static void Physics_CountTickable(void) {
+	cc_uint8 tickable[256];
+	int x, y, z, index, chunk;
+#ifdef EXTENDED_BLOCKS
+	cc_bool upper;
+#endif
+
+	Physics_FreeTickable();
+	if (!Physics.Enabled || !World.Blocks) return;
+	physics_tickable = (cc_uint16*)Mem_AllocCleared(World.SectionsX * World.SectionsY * World.SectionsZ, 2, "physics tickable");
+
+	for (x = 0; x < 256; x++) { tickable[x] = Physics.OnRandomTick[x] != NULL; }
+#ifdef EXTENDED_BLOCKS
+	upper = World.Blocks2 != World.Blocks;
+#endif
+
+	for (y = 0; y < World.Height; y++) {
+		for (z = 0; z < World.Length; z++) {
+			index = World_Pack(0, y, z);
+			chunk = World_SectionIndex(0, y, z);
+
+			for (x = 0; x < World.Width; x++, index++) {
+#ifdef EXTENDED_BLOCKS
+				/* handlers are only for blocks below 256 */
+				if (upper && World.Blocks2[index]) continue;
+#endif
+				physics_tickable[chunk + (x >> WORLD_SECTION_SHIFT)] += tickable[World.Blocks[index]];
+			}
+		}
+	}
+}
+
+void Physics_OnBlockUpdated(int x, int y, int z, BlockID old, BlockID now) {
+	int chunk;
+	if (!physics_tickable) return;
+	chunk = World_SectionIndex(x, y, z);
+
+	if (Physics_IsTickable(old)) physics_tickable[chunk]--;
+	if (Physics_IsTickable(now)) physics_tickable[chunk]++;
+}
+
+static void Physics_OnNewMap(void* obj) {
+	Physics_FreeTickable();
+}
 
 static void Physics_OnNewMapLoaded(void* obj) {
-	TickQueue_Clear(&lavaQ);
-	TickQueue_Clear(&waterQ);
+	TickWheel_Clear(&lavaQ);
+	TickWheel_Clear(&waterQ);
+	Physics_CountTickable();
 
 	physics_maxWaterX = World.MaxX - 2;
 	physics_maxWaterY = World.MaxY - 2;
@@ -119,7 +289,7 @@ void Physics_SetEnabled(cc_bool enabled) {
 static void Physics_Activate(int index) {
 	BlockID block = World.Blocks[index];
 	PhysicsHandler activate = Physics.OnActivate[block];
-	if (activate) activate(index, block);
+	if (activate) Physics_Invoke(PROFILE_ACTIVATE, activate, index, block);
 }
 
 static void Physics_ActivateNeighbours(int x, int y, int z, int index) {
@@ -152,45 +322,46 @@ void Physics_OnBlockChanged(int x, int y, int z, BlockID old, BlockID now) {
 
 	if (now == BLOCK_AIR) {
 		handler = Physics.OnDelete[old];
-		if (handler) handler(index, old);
+		if (handler) Physics_Invoke(PROFILE_DELETE, handler, index, old);
 	} else {
 		handler = Physics.OnPlace[now];
-		if (handler) handler(index, now);
+		if (handler) Physics_Invoke(PROFILE_PLACE, handler, index, now);
 	}
 	Physics_ActivateNeighbours(x, y, z, index);
 }
 
-static void Physics_TickRandomBlocks(void) {
-	int lo, hi, index;
+static void Physics_TickRandomBlock(int x, int y, int z, int width, int height, int length) {
+	int index;
 	BlockID block;
-	PhysicsHandler tick;
-	int x, y, z, x2, y2, z2;
 
-	for (y = 0; y < World.Height; y += CHUNK_SIZE) {
-		y2 = min(y + CHUNK_MAX, World.MaxY);
-		for (z = 0; z < World.Length; z += CHUNK_SIZE) {
-			z2 = min(z + CHUNK_MAX, World.MaxZ);
-			for (x = 0; x < World.Width; x += CHUNK_SIZE) {
-				x2 = min(x + CHUNK_MAX, World.MaxX);
-
-				/* Inlined 3 random ticks for this chunk */
-				lo = World_Pack( x,  y,  z);
-				hi = World_Pack(x2, y2, z2);
-				
-				index = Random_Range(&physics_rnd, lo, hi);
-				block = World.Blocks[index];
-				tick = Physics.OnRandomTick[block];
-				if (tick) tick(index, block);
+	x += Random_Next(&physics_rnd, width);
+	y += Random_Next(&physics_rnd, height);
+	z += Random_Next(&physics_rnd, length);
 
-				index = Random_Range(&physics_rnd, lo, hi);
-				block = World.Blocks[index];
-				tick = Physics.OnRandomTick[block];
-				if (tick) tick(index, block);
+	index = World_Pack(x, y, z);
+	block = Physics_GetBlock(index);
+	if (Physics_IsTickable(block)) Physics_Invoke(PROFILE_RANDOM, Physics.OnRandomTick[block], index, block);
+}
 
-				index = Random_Range(&physics_rnd, lo, hi);
-				block = World.Blocks[index];
-				tick = Physics.OnRandomTick[block];
-				if (tick) tick(index, block);
+static void Physics_TickRandomBlocks(void) {
+	int x, y, z, width, height, length;
+	int chunk = 0;
+	if (!physics_tickable) return;
+
+	/* Chunks are iterated in same order as World_SectionIndex */
+	for (y = 0; y < World.Height; y += CHUNK_SIZE) {
+		height = min(CHUNK_SIZE, World.Height - y);
+		for (z = 0; z < World.Length; z += CHUNK_SIZE) {
+			length = min(CHUNK_SIZE, World.Length - z);
+			for (x = 0; x < World.Width; x += CHUNK_SIZE, chunk++) {
+				/* Most chunks are usually just stone or air */
+				if (!physics_tickable[chunk]) continue;
+				width = min(CHUNK_SIZE, World.Width - x);
+
+				/* 3 random ticks for this chunk */
+				Physics_TickRandomBlock(x, y, z, width, height, length);
+				Physics_TickRandomBlock(x, y, z, width, height, length);
+				Physics_TickRandomBlock(x, y, z, width, height, length);
 			}
 		}
 	}
@@ -222,17 +393,6 @@ static void Physics_DoFalling(int index, BlockID block) {
 	Physics_ActivateNeighbours(x, y, z, start);
 }
 
-static cc_bool Physics_CheckItem(struct TickQueue* queue, int* posIndex) {
-	cc_uint32 item = TickQueue_Dequeue(queue);
-	*posIndex     = (int)(item & PHYSICS_POS_MASK);
-
-	if (item >= PHYSICS_ONE_DELAY) {
-		item -= PHYSICS_ONE_DELAY;
-		TickQueue_Enqueue(queue, item);
-		return false;
-	}
-	return true;
-}
 
 
 static void Physics_HandleSapling(int index, BlockID block) {
@@ -319,8 +479,50 @@ static void Physics_HandleMushroom(int index, BlockID block) {
 }
 
 
+/* Returns whether lava and water ticks have taken longer than Physics.TickBudget this tick */
+static cc_uint64 physics_tickBeg;
+static cc_bool Physics_OverBudget(void) {
+	if (!Physics.TickBudget) return false;
+	return Stopwatch_ElapsedMicroseconds(physics_tickBeg, Stopwatch_Measure()) >= Physics.TickBudget * 1000;
+}
+
+/* Activates the liquid blocks due to be processed on this tick (and any deferred from earlier ticks). */
+/* If this goes over the tick budget, the remaining entries are deferred to the next tick. */
+static void Physics_TickLiquid(struct TickWheel* wheel, BlockID liquid, BlockID still, PhysicsHandler activate) {
+	struct TickQueue* due     = TickWheel_Advance(wheel);
+	struct TickQueue* overdue = &wheel->overdue;
+	struct TickQueue* queue   = overdue;
+	cc_uint64 beg = Physics.Profiling ? Stopwatch_Measure() : 0;
+	int index, processed = 0;
+	BlockID block;
+
+	for (;;) {
+		while (queue->count) {
+			/* Only check every so often, as measuring time isn't free */
+			if (processed && !(processed & 63) && Physics_OverBudget()) {
+				while (due->count) { TickQueue_Enqueue(overdue, TickQueue_Dequeue(due)); }
+				goto finished;
+			}
+			index = (int)TickQueue_Dequeue(queue);
+			processed++;
+
+			block = World.Blocks[index];
+			if (block == liquid || block == still) activate(index, block);
+		}
+
+		if (queue == due) break;
+		queue = due;
+	}
+
+finished:
+	if (!Physics.Profiling) return;
+	profile.time[PROFILE_TICK][liquid]  += Stopwatch_Measure() - beg;
+	profile.calls[PROFILE_TICK][liquid] += processed;
+}
+
+
 static void Physics_PlaceLava(int index, BlockID block) {
-	TickQueue_Enqueue(&lavaQ, PHYSICS_LAVA_DELAY | index);
+	TickWheel_Schedule(&lavaQ, index, PHYSICS_LAVA_DELAY);
 }
 
 static void Physics_PropagateLava(int posIndex, int x, int y, int z) {
@@ -328,7 +530,7 @@ static void Physics_PropagateLava(int posIndex, int x, int y, int z) {
 	if (block == BLOCK_WATER || block == BLOCK_STILL_WATER) {
 		Game_UpdateBlock(x, y, z, BLOCK_STONE);
 	} else if (Blocks.Collide[block] == COLLIDE_GAS) {
-		TickQueue_Enqueue(&lavaQ, PHYSICS_LAVA_DELAY | posIndex);
+		TickWheel_Schedule(&lavaQ, posIndex, PHYSICS_LAVA_DELAY);
 		Game_UpdateBlock(x, y, z, BLOCK_LAVA);
 	}
 }
@@ -345,20 +547,12 @@ static void Physics_ActivateLava(int index, BlockID block) {
 }
 
 static void Physics_TickLava(void) {
-	int i, count = lavaQ.count;
-	for (i = 0; i < count; i++) {
-		int index;
-		if (Physics_CheckItem(&lavaQ, &index)) {
-			BlockID block = World.Blocks[index];
-			if (!(block == BLOCK_LAVA || block == BLOCK_STILL_LAVA)) continue;
-			Physics_ActivateLava(index, block);
-		}
-	}
+	Physics_TickLiquid(&lavaQ, BLOCK_LAVA, BLOCK_STILL_LAVA, Physics_ActivateLava);
 }
 
 
 static void Physics_PlaceWater(int index, BlockID block) {
-	TickQueue_Enqueue(&waterQ, PHYSICS_WATER_DELAY | index);
+	TickWheel_Schedule(&waterQ, index, PHYSICS_WATER_DELAY);
 }
 
 static void Physics_PropagateWater(int posIndex, int x, int y, int z) {
@@ -378,7 +572,7 @@ static void Physics_PropagateWater(int posIndex, int x, int y, int z) {
 			}
 		}
 
-		TickQueue_Enqueue(&waterQ, PHYSICS_WATER_DELAY | posIndex);
+		TickWheel_Schedule(&waterQ, posIndex, PHYSICS_WATER_DELAY);
 		Game_UpdateBlock(x, y, z, BLOCK_WATER);
 	}
 }
@@ -395,15 +589,7 @@ static void Physics_ActivateWater(int index, BlockID block) {
 }
 
 static void Physics_TickWater(void) {
-	int i, count = waterQ.count;
-	for (i = 0; i < count; i++) {
-		int index;
-		if (Physics_CheckItem(&waterQ, &index)) {
-			BlockID block = World.Blocks[index];
-			if (!(block == BLOCK_WATER || block == BLOCK_STILL_WATER)) continue;
-			Physics_ActivateWater(index, block);
-		}
-	}
+	Physics_TickLiquid(&waterQ, BLOCK_WATER, BLOCK_STILL_WATER, Physics_ActivateWater);
 }
 
 
@@ -438,7 +624,7 @@ static void Physics_DeleteSponge(int index, BlockID block) {
 					index = World_Pack(xx, yy, zz);
 					block = World.Blocks[index];
 					if (block == BLOCK_WATER || block == BLOCK_STILL_WATER) {
-						TickQueue_Enqueue(&waterQ, index | PHYSICS_ONE_DELAY);
+						TickWheel_Schedule(&waterQ, index, PHYSICS_ONE_DELAY);
 					}
 				}
 			}
@@ -508,11 +694,19 @@ static void Physics_HandleTnt(int index, BlockID block) {
 	Physics_Explode(x, y, z, 4);
 }
 
+static void Physics_TickLiquids(void) {
+	physics_tickBeg = Stopwatch_Measure();
+	Physics_TickLava();
+	Physics_TickWater();
+}
+
 void Physics_Init(void) {
+	Event_RegisterVoid(&WorldEvents.NewMap,       NULL, Physics_OnNewMap);
 	Event_RegisterVoid(&WorldEvents.MapLoaded,    NULL, Physics_OnNewMapLoaded);
-	Physics.Enabled = Options_GetBool(OPT_BLOCK_PHYSICS, true);
-	TickQueue_Init(&lavaQ);
-	TickQueue_Init(&waterQ);
+	Physics.Enabled    = Options_GetBool(OPT_BLOCK_PHYSICS, true);
+	Physics.TickBudget = Options_GetInt(OPT_PHYSICS_BUDGET, 0, 1000, 0);
+	TickWheel_Init(&lavaQ);
+	TickWheel_Init(&waterQ);
 
 	Physics.OnPlace[BLOCK_SAND]        = Physics_DoFalling;
 	Physics.OnPlace[BLOCK_GRAVEL]      = Physics_DoFalling;
@@ -552,16 +746,20 @@ void Physics_Init(void) {
 }
 
 void Physics_Free(void) {
+	Event_UnregisterVoid(&WorldEvents.NewMap,       NULL, Physics_OnNewMap);
 	Event_UnregisterVoid(&WorldEvents.MapLoaded,    NULL, Physics_OnNewMapLoaded);
+	Physics_FreeTickable();
 }
 
 void Physics_Tick(void) {
+	cc_uint64 beg;
 	if (!Physics.Enabled || !World.Blocks) return;
+	beg = Physics.Profiling ? Stopwatch_Measure() : 0;
 
 	/*if ((tickCount % 5) == 0) {*/
-	Physics_TickLava();
-	Physics_TickWater();
+	Physics_TickLiquids();
 	/*}*/
 	physics_tickCount++;
 	Physics_TickRandomBlocks();
+	if (Physics.Profiling) profile.tickTime += Stopwatch_Measure() - beg;
 }
@@ -1,6 +1,6 @@
 #ifndef CC_BLOCKPHYSICS_H
 #define CC_BLOCKPHYSICS_H
-#include "Core.h"
+#include "String.h"
 /* Implements simple block physics.
    Copyright 2014-2019 ClassiCube | Licensed under BSD-3
 */
@@ -9,6 +9,11 @@ typedef void (*PhysicsHandler)(int index, BlockID block);
 CC_VAR extern struct Physics_ {
 	/* Whether block physics are enabled at all. */
 	cc_bool Enabled;
+	/* Whether time spent in each physics handler is recorded. (see Physics_ReportProfile) */
+	cc_bool Profiling;
+	/* Max milliseconds lava and water ticks can take each tick, 0 for no limit. */
+	/* Liquid blocks not processed in time are deferred to the next tick. */
+	int TickBudget;
 	/* Called when block is activated by a neighbouring block change. */
 	/* e.g. trigger sand falling, water flooding */
 	PhysicsHandler OnActivate[256];
@@ -23,7 +28,13 @@ CC_VAR extern struct Physics_ {
 
 void Physics_SetEnabled(cc_bool enabled);
 void Physics_OnBlockChanged(int x, int y, int z, BlockID old, BlockID now);
+/* Called whenever a block in the world is changed. (including by physics or the server) */
+/* Keeps track of how many randomly ticked blocks are in each chunk of the world. */
+void Physics_OnBlockUpdated(int x, int y, int z, BlockID old, BlockID now);
 void Physics_Init(void);
 void Physics_Free(void);
 void Physics_Tick(void);
+/* Appends a summary of physics timings since the last call (and liquid queue lengths) to the given string. */
+/* Timings for each handler are also logged. Does nothing when Physics.Profiling is false. */
+void Physics_ReportProfile(String* dst);
 #endif
@@ -16,6 +16,10 @@
 #include "GameStructs.h"
 #include "Utils.h"
 #include "TexturePack.h"
+#include "Deflate.h"
+#include "ExtMath.h"
+#include "Errors.h"
+#include "BlockPhysics.h"
 
 static char msgs[10][STRING_SIZE];
 String Chat_Status[4]       = { String_FromArray(msgs[0]), String_FromArray(msgs[1]), String_FromArray(msgs[2]), String_FromArray(msgs[3]) };
@@ -578,6 +582,109 @@ static struct ChatCommand TeleportCommand = {
 };
 
 
+static void PhysicsCommand_Execute(const String* args, int argsCount) {
+	int budget;
+	if (!argsCount) {
+		Chat_AddRaw("&e/client physics: &cYou didn't specify profile or budget."); return;
+	}
+
+	if (String_CaselessEqualsConst(&args[0], "profile")) {
+		Physics.Profiling = !Physics.Profiling;
+		Chat_Add1("&e/client physics: &fProfiling is now %c.", Physics.Profiling ? "on" : "off");
+	} else if (String_CaselessEqualsConst(&args[0], "budget")) {
+		if (argsCount < 2) {
+			Chat_Add1("&e/client physics: &fTick budget is %i ms (0 means no limit).", &Physics.TickBudget);
+		} else if (!Convert_ParseInt(&args[1], &budget) || budget < 0 || budget > 1000) {
+			Chat_AddRaw("&e/client physics: &cBudget must be an integer between 0 and 1000.");
+		} else {
+			Physics.TickBudget = budget;
+			Options_SetInt(OPT_PHYSICS_BUDGET, budget);
+			Chat_Add1("&e/client physics: &fTick budget is now %i ms.", &budget);
+		}
+	} else {
+		Chat_Add1("&e/client physics: &cUnrecognised mode &f\"%s\"&c.", &args[0]);
+	}
+}
+
+static struct ChatCommand PhysicsCommand = {
+	"Physics", PhysicsCommand_Execute, true,
+	{
+		"&a/client physics [profile/budget] [milliseconds]",
+		"&bprofile: &eToggles showing time spent on block physics on the FPS line.",
+		"&e  Time spent in each kind of physics handler is also logged.",
+		"&bbudget: &eSets max milliseconds lava and water can take each tick.",
+		"&e  Remaining lava and water is then processed next tick.",
+	}
+};
+
+static void ReplayCommand_GetPath(const String* args, int argsCount, String* path) {
+	static const String defName = String_FromConst("replay");
+	String_Format1(path, "replays/%s.rpl", argsCount > 1 ? &args[1] : &defName);
+}
+
+static void ReplayCommand_Play(const String* path) {
+	struct LocalPlayerReplay r;
+	float perTick, totalMs;
+	cc_result res;
+
+	res = LocalPlayer_Replay(path, &r);
+	if (res) { Logger_Warn2(res, "replaying", path); return; }
+	if (!r.sameMap) Chat_AddRaw("&e/client replay: &cCurrent map differs from the map this was recorded in.");
+
+	perTick = r.ticks ? r.microseconds / r.ticks : 0.0f;
+	totalMs = r.microseconds / 1000.0f;
+	Chat_Add3("&e/client replay: &fReplayed %i ticks, %f2 us per tick (%f1 ms total)", 
+		&r.ticks, &perTick, &totalMs);
+
+	if (r.firstDiverged == -1) {
+		Chat_AddRaw("&e/client replay: &fAll positions matched the recording exactly.");
+	} else {
+		Chat_Add3("&e/client replay: &cFirst diverged at tick %i, &fmax %f3 blocks, final %f3 blocks off.", 
+			&r.firstDiverged, &r.maxDiff, &r.finalDiff);
+	}
+}
+
+static void ReplayCommand_Execute(const String* args, int argsCount) {
+	String path; char pathBuffer[FILENAME_SIZE];
+	cc_result res;
+
+	if (!argsCount) {
+		Chat_AddRaw("&e/client replay: &cYou didn't specify record, stop or play."); return;
+	}
+	String_InitArray(path, pathBuffer);
+	ReplayCommand_GetPath(args, argsCount, &path);
+
+	if (String_CaselessEqualsConst(&args[0], "record")) {
+		LocalPlayer_StartRecording();
+		Chat_AddRaw("&e/client replay: &fRecording started.");
+	} else if (String_CaselessEqualsConst(&args[0], "stop")) {
+		if (!LocalPlayer_IsRecording()) {
+			Chat_AddRaw("&e/client replay: &cNot currently recording."); return;
+		}
+		if (!Utils_EnsureDirectory("replays")) return;
+
+		res = LocalPlayer_StopRecording(&path);
+		if (res) { Logger_Warn2(res, "saving", &path); return; }
+		Chat_Add1("&e/client replay: &fSaved recording to %s", &path);
+	} else if (String_CaselessEqualsConst(&args[0], "play")) {
+		ReplayCommand_Play(&path);
+	} else {
+		Chat_Add1("&e/client replay: &cUnrecognised mode &f\"%s\"&c.", &args[0]);
+	}
+}
+
+static struct ChatCommand ReplayCommand = {
+	"Replay", ReplayCommand_Execute, false,
+	{
+		"&a/client replay [record/stop/play] [name]",
+		"&brecord: &eStarts recording your movement inputs each tick.",
+		"&bstop: &eStops recording, and saves it to replays/[name].rpl",
+		"&bplay: &eRuns the recorded inputs through your movement physics again,",
+		"&e  then reports time taken and how far you end up from the recording.",
+	}
+};
+
+
 /*########################################################################################################################*
 *-------------------------------------------------------Generic chat------------------------------------------------------*
 *#########################################################################################################################*/
@@ -602,6 +709,8 @@ static void Chat_Init(void) {
 	Commands_Register(&CuboidCommand);
 	Commands_Register(&TeleportCommand);
 	Commands_Register(&ClearDeniedCommand);
+	Commands_Register(&PhysicsCommand);
+	Commands_Register(&ReplayCommand);
 
 	Chat_Logging = Options_GetBool(OPT_CHAT_LOGGING, true);
 }
@@ -7,6 +7,19 @@
 #include "Utils.h"
 
 #define Header_ReadU8(value) if ((res = s->ReadU8(s, &value))) return res;
+/* Little endian CPUs known to support fast unaligned 8 byte loads and stores */
+/* (used to read input bits, copy matches and compare matches 8 bytes at a time) */
+#if defined __GNUC__ && !defined CC_BIG_ENDIAN && (defined __i386__ || defined __x86_64__ || defined __aarch64__)
+#define DEFLATE_FAST_WORDS
+#define Deflate_CopyWord(dst, src) __builtin_memcpy(dst, src, 8)
+#define Deflate_FirstSetByte(x) (__builtin_ctzll(x) >> 3)
+#elif defined _MSC_VER && (defined _M_X64 || defined _M_ARM64)
+#include <intrin.h>
+#define DEFLATE_FAST_WORDS
+#define Deflate_CopyWord(dst, src) *(cc_uint64*)(dst) = *(const cc_uint64*)(src)
+static int Deflate_FirstSetByte(cc_uint64 x) { unsigned long idx; _BitScanForward64(&idx, x); return idx >> 3; }
+#endif
+
 /*########################################################################################################################*
 *-------------------------------------------------------GZip header-------------------------------------------------------*
 *#########################################################################################################################*/
@@ -137,11 +150,11 @@ enum INFLATE_STATE_ {
 	INFLATE_STATE_DYNAMIC_LITSDISTSREPEAT, INFLATE_STATE_COMPRESSED_LIT,
 	INFLATE_STATE_COMPRESSED_LITREPEAT, INFLATE_STATE_COMPRESSED_DIST,
 	INFLATE_STATE_COMPRESSED_DISTREPEAT, INFLATE_STATE_COMPRESSED_DATA,
-	INFLATE_STATE_FASTCOMPRESSED, INFLATE_STATE_DONE
+	INFLATE_STATE_FASTCOMPRESSED, INFLATE_STATE_DONE, INFLATE_STATE_FAILED
 };
 
 /* Insert next byte into the bit buffer */
-#define Inflate_GetByte(state) state->AvailIn--; state->Bits |= (cc_uint32)(*state->NextIn++) << state->NumBits; state->NumBits += 8;
+#define Inflate_GetByte(state) state->AvailIn--; state->Bits |= (cc_uint64)(*state->NextIn++) << state->NumBits; state->NumBits += 8;
 /* Retrieves bits from the bit buffer */
 #define Inflate_PeekBits(state, bits) (state->Bits & ((1UL << (bits)) - 1UL))
 /* Consumes/eats up bits from the bit buffer */
@@ -155,13 +168,17 @@ enum INFLATE_STATE_ {
 /* Peeks then consumes given bits */
 #define Inflate_ReadBits(state, bitsCount) Inflate_PeekBits(state, bitsCount); Inflate_ConsumeBits(state, bitsCount);
 
+/* Stops decompressing, because the DEFLATE data is corrupted */
+#define Inflate_Fail(state, err) { state->Error = err; state->State = INFLATE_STATE_FAILED; return; }
+
 /* Goes to the next state, after having read data of a block */
 #define Inflate_NextBlockState(state) (state->LastBlock ? INFLATE_STATE_DONE : INFLATE_STATE_HEADER)
 /* Goes to the next state, after having finished reading a compressed entry */
 #define Inflate_NextCompressState(state) ((state->AvailIn >= INFLATE_FASTINF_IN && state->AvailOut >= INFLATE_FASTINF_OUT) ? INFLATE_STATE_FASTCOMPRESSED : INFLATE_STATE_COMPRESSED_LIT)
 /* The maximum amount of bytes that can be output is 258 */
 #define INFLATE_FASTINF_OUT 258
-/* The most input bytes required for huffman codes and extra data is 16 + 5 + 16 + 13 bits. Add 3 extra bytes to account for putting data into the bit buffer. */
+/* The most input bytes required for huffman codes and extra data is 16 + 5 + 16 + 13 bits. */
+/* Bit buffer is refilled by reading 8 bytes at once, so add extra bytes to account for that. */
 #define INFLATE_FASTINF_IN 10
 
 static cc_uint32 Huffman_ReverseBits(cc_uint32 n, cc_uint8 bits) {
@@ -173,7 +190,7 @@ static cc_uint32 Huffman_ReverseBits(cc_uint32 n, cc_uint8 bits) {
 }
 
 /* Builds a huffman tree, based on input lengths of each codeword */
-static void Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLens, int count) {
+static cc_result Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLens, int count) {
 	int bl_count[INFLATE_MAX_BITS], bl_offsets[INFLATE_MAX_BITS];
 	int code, offset, value;
 	int i, j;
@@ -189,13 +206,7 @@ static void Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLens, i
 		bl_count[bitLens[i]]++;
 	}
 
-	/* Ensure huffman tree actually makes sense */
 	bl_count[0] = 0;
-	for (i = 1; i < INFLATE_MAX_BITS; i++) {
-		if (bl_count[i] > (1 << i)) {
-			Logger_Abort("Too many huffman codes for bit length");
-		}
-	}
 
 	/* Compute the codewords for the huffman tree.
 	*  Codewords are ordered, so consider this example tree:
@@ -207,6 +218,10 @@ static void Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLens, i
 		code = (code + bl_count[i - 1]) << 1;
 		bl_offsets[i] = offset;
 
+		/* Ensure huffman tree actually makes sense */
+		/* (otherwise codewords could overflow, making decoding read outside Values) */
+		if (code + bl_count[i] > (1 << i)) return INF_ERR_NUM_CODES;
+
 		table->FirstCodewords[i] = code;
 		table->FirstOffsets[i]   = offset;
 		offset += bl_count[i];
@@ -252,10 +267,12 @@ static void Huffman_Build(struct HuffmanTable* table, const cc_uint8* bitLens, i
 		}
 		bl_offsets[len]++;
 	}
+	return 0;
 }
 
 /* Attempts to read the next huffman encoded value from the bitstream, using given table */
-/* Returns -1 if there are insufficient bits to read the value */
+/* Returns -1 if there are insufficient bits to read the value, or if the value is invalid */
+/* (in the invalid case, also changes state to failed) */
 static int Huffman_Decode(struct InflateState* state, struct HuffmanTable* table) {
 	cc_uint32 i, j, codeword;
 	int packed, bits, offset;
@@ -289,49 +306,37 @@ static int Huffman_Decode(struct InflateState* state, struct HuffmanTable* table
 		}
 	}
 
-	Logger_Abort("DEFLATE - Invalid huffman code");
+	state->Error = INF_ERR_INVALID_CODE;
+	state->State = INFLATE_STATE_FAILED;
 	return -1;
 }
 
-/* Inline the common <= 9 bits case */
-#define Huffman_Unsafe_Decode(state, table, result) \
-{\
-	Inflate_UNSAFE_EnsureBits(state, INFLATE_MAX_BITS);\
-	packed = table.Fast[Inflate_PeekBits(state, INFLATE_FAST_BITS)];\
-	if (packed >= 0) {\
-		consumedBits = packed >> INFLATE_FAST_BITS;\
-		Inflate_ConsumeBits(state, consumedBits);\
-		result = packed & 0x1FF;\
-	} else {\
-		result = Huffman_Unsafe_Decode_Slow(state, &table);\
-	}\
-}
-
-static int Huffman_Unsafe_Decode_Slow(struct InflateState* state, struct HuffmanTable* table) {
+/* Decodes a huffman code longer than INFLATE_FAST_BITS, from the next 16 bits of the bitstream. */
+/* Returns value and number of bits in codeword, packed in the same way as fast table entries. */
+/* Returns -1 if the codeword is invalid. */
+static int Huffman_DecodeSlow(struct HuffmanTable* table, cc_uint32 bits) {
 	cc_uint32 i, j, codeword;
 	int offset;
 
 	/* Slow, bit by bit lookup. Need to reverse order for huffman. */
-	codeword = Inflate_PeekBits(state,       INFLATE_FAST_BITS);
+	codeword = bits & ((1UL << INFLATE_FAST_BITS) - 1UL);
 	codeword = Huffman_ReverseBits(codeword, INFLATE_FAST_BITS);
 
 	for (i = INFLATE_FAST_BITS + 1, j = INFLATE_FAST_BITS; i < INFLATE_MAX_BITS; i++, j++) {
-		codeword = (codeword << 1) | ((state->Bits >> j) & 1);
+		codeword = (codeword << 1) | ((bits >> j) & 1);
 
 		if (codeword < table->EndCodewords[i]) {
 			offset = table->FirstOffsets[i] + (codeword - table->FirstCodewords[i]);
-			Inflate_ConsumeBits(state, i);
-			return table->Values[offset];
+			return (i << INFLATE_FAST_BITS) | table->Values[offset];
 		}
 	}
-
-	Logger_Abort("DEFLATE - Invalid huffman code");
 	return -1;
 }
 
 void Inflate_Init(struct InflateState* state, struct Stream* source) {
 	state->State = INFLATE_STATE_HEADER;
 	state->LastBlock = false;
+	state->Error = 0;
 	state->Bits = 0;
 	state->NumBits = 0;
 	state->NextIn  = state->Input;
@@ -380,68 +385,140 @@ static const cc_uint8 dist_bits[32] = {
 static const cc_uint8 codelens_order[INFLATE_MAX_CODELENS] = {
 	16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 
 };
+/* len_base and len_bits combined into one table, as (base << 8) | bits */
+static const cc_uint32 len_codes[31] = {
+	0x0300,0x0400,0x0500,0x0600,0x0700,0x0800,0x0900,0x0A00,0x0B01,0x0D01,
+	0x0F01,0x1101,0x1302,0x1702,0x1B02,0x1F02,0x2303,0x2B03,0x3303,0x3B03,
+	0x4304,0x5304,0x6304,0x7304,0x8305,0xA305,0xC305,0xE305,0x10200,0,0
+};
+/* dist_base and dist_bits combined into one table, as (base << 8) | bits */
+static const cc_uint32 dist_codes[32] = {
+	0x000100,0x000200,0x000300,0x000400,0x000501,0x000701,0x000902,0x000D02,0x001103,0x001903,
+	0x002104,0x003104,0x004105,0x006105,0x008106,0x00C106,0x010107,0x018107,0x020108,0x030108,
+	0x040109,0x060109,0x08010A,0x0C010A,0x10010B,0x18010B,0x20010C,0x30010C,0x40010D,0x60010D,0,0
+};
+
+/* Refills the bit buffer so that it has at least 56 bits (but no more than 63) */
+#ifdef DEFLATE_FAST_WORDS
+/* Reads 8 bytes at once, but only whole bytes that fit into the bit buffer are consumed. */
+/* The upper bits of the bit buffer then contain part of the next byte, which is harmless */
+/* because ORing in the same bits again later has no effect. (they are cleared at the end) */
+#define Inflate_FastRefill() \
+	Deflate_CopyWord(&word, in);\
+	bits |= word << numBits;\
+	in   += (63 - numBits) >> 3;\
+	numBits |= 56;
+#else
+#define Inflate_FastRefill() while (numBits < 56) { bits |= (cc_uint64)(*in++) << numBits; numBits += 8; }
+#endif
+
+/* Decodes a huffman code, using the fast lookup table for the common <= 9 bits case */
+#define Inflate_FastDecode(table, result) \
+	packed = table.Fast[bits & ((1UL << INFLATE_FAST_BITS) - 1UL)];\
+	if (packed < 0) {\
+		packed = Huffman_DecodeSlow(&table, (cc_uint32)bits);\
+		if (packed < 0) { state->Error = INF_ERR_INVALID_CODE; state->State = INFLATE_STATE_FAILED; break; }\
+	}\
+	consumed = packed >> INFLATE_FAST_BITS;\
+	bits >>= consumed; numBits -= consumed;\
+	result = packed & 0x1FF;
+
+/* Consumes the given number of extra bits from the bit buffer */
+#define Inflate_FastExtra(count, result) \
+	result = (cc_uint32)(bits & ((1UL << (count)) - 1UL));\
+	bits >>= (count); numBits -= (count);
 
 static void Inflate_InflateFast(struct InflateState* state) {
+	/* bit buffer variables, copied to locals so they can be kept in registers */
+	cc_uint64 bits, word;
+	cc_uint32 numBits;
+	cc_uint8* in;
+	cc_uint8* inEnd;
 	/* huffman variables */
-	cc_uint32 lit, len, dist;
-	cc_uint32 bits, lenIdx, distIdx;
-	int packed, consumedBits;
+	cc_uint32 lit, len, dist, code, extra;
+	int packed, consumed;
 
 	/* window variables */
 	cc_uint8* window;
+	cc_uint8* src;
+	cc_uint8* dst;
 	cc_uint32 i, curIdx, startIdx;
 	cc_uint32 copyStart, copyLen, partLen;
 
+	bits    = state->Bits;
+	numBits = state->NumBits;
+	in      = state->NextIn;
+	inEnd   = state->NextIn + state->AvailIn;
+
 	window = state->Window;
 	curIdx = state->WindowIndex;
 	copyStart = state->WindowIndex;
 	copyLen   = 0;
 
 #define INFLATE_FAST_COPY_MAX (INFLATE_WINDOW_SIZE - INFLATE_FASTINF_OUT)
-	while (state->AvailOut >= INFLATE_FASTINF_OUT && state->AvailIn >= INFLATE_FASTINF_IN && copyLen < INFLATE_FAST_COPY_MAX) {
-		Huffman_Unsafe_Decode(state, state->Table.Lits, lit);
+	while (state->AvailOut >= INFLATE_FASTINF_OUT && (inEnd - in) >= INFLATE_FASTINF_IN && copyLen < INFLATE_FAST_COPY_MAX) {
+		/* 56 bits is always enough for lit/len code, len extra bits, dist code and dist extra bits */
+		Inflate_FastRefill();
+		Inflate_FastDecode(state->Table.Lits, lit);
+
+		if (lit < 256) {
+			window[curIdx] = (cc_uint8)lit;
+			state->AvailOut--; copyLen++;
+			curIdx = (curIdx + 1) & INFLATE_WINDOW_MASK;
+			continue;
+		} else if (lit == 256) {
+			state->State = Inflate_NextBlockState(state);
+			break;
+		}
 
-		if (lit <= 256) {
-			if (lit < 256) {
-				window[curIdx] = (cc_uint8)lit;
-				state->AvailOut--; copyLen++;
-				curIdx = (curIdx + 1) & INFLATE_WINDOW_MASK;
-			} else {
-				state->State = Inflate_NextBlockState(state);
-				break;
+		code = len_codes[lit - 257];
+		Inflate_FastExtra(code & 0xFF, extra);
+		len  = (code >> 8) + extra;
+
+		Inflate_FastDecode(state->TableDists, dist);
+		code = dist_codes[dist];
+		Inflate_FastExtra(code & 0xFF, extra);
+		dist = (code >> 8) + extra;
+
+		/* Window is infinitely repeating like ... [xyz][xyz][xyz] ... */
+		/* If start and end don't cross a boundary, can avoid masking index */
+		startIdx = (curIdx - dist) & INFLATE_WINDOW_MASK;
+		if (curIdx >= startIdx && (curIdx + len) < INFLATE_WINDOW_SIZE) {
+			src = &window[startIdx];
+			dst = &window[curIdx];
+			i   = 0;
+
+			if (dist == 1) {
+				/* Run of same byte (very common in maps) */
+				Mem_Set(dst, *src, len); i = len;
+			}
+#ifdef DEFLATE_FAST_WORDS
+			else if (dist >= 8) {
+				/* Source and destination of each 8 bytes never overlap */
+				for (; i + 8 <= len; i += 8) { Deflate_CopyWord(dst + i, src + i); }
+			}
+#endif
+			for (; i < (len & ~0x3); i += 4) {
+				dst[i + 0] = src[i + 0]; dst[i + 1] = src[i + 1];
+				dst[i + 2] = src[i + 2]; dst[i + 3] = src[i + 3];
 			}
+			for (; i < len; i++) { dst[i] = src[i]; }
 		} else {
-			lenIdx = lit - 257;
-			bits = len_bits[lenIdx];
-			Inflate_UNSAFE_EnsureBits(state, bits);
-			len  = len_base[lenIdx] + Inflate_ReadBits(state, bits);
-
-			Huffman_Unsafe_Decode(state, state->TableDists, distIdx);
-			bits = dist_bits[distIdx];
-			Inflate_UNSAFE_EnsureBits(state, bits);
-			dist = dist_base[distIdx] + Inflate_ReadBits(state, bits);
-	
-			/* Window is infinitely repeating like ... [xyz][xyz][xyz] ... */
-			/* If start and end don't cross a boundary, can avoid masking index */
-			startIdx = (curIdx - dist) & INFLATE_WINDOW_MASK;
-			if (curIdx >= startIdx && (curIdx + len) < INFLATE_WINDOW_SIZE) {
-				cc_uint8* src = &window[startIdx]; 
-				cc_uint8* dst = &window[curIdx];
-
-				for (i = 0; i < (len & ~0x3); i += 4) {
-					*dst++ = *src++; *dst++ = *src++; *dst++ = *src++; *dst++ = *src++;
-				}
-				for (; i < len; i++) { *dst++ = *src++; }
-			} else {
-				for (i = 0; i < len; i++) {
-					window[(curIdx + i) & INFLATE_WINDOW_MASK] = window[(startIdx + i) & INFLATE_WINDOW_MASK];
-				}
+			for (i = 0; i < len; i++) {
+				window[(curIdx + i) & INFLATE_WINDOW_MASK] = window[(startIdx + i) & INFLATE_WINDOW_MASK];
 			}
-			curIdx = (curIdx + len) & INFLATE_WINDOW_MASK;
-			state->AvailOut -= len; copyLen += len;
 		}
+		curIdx = (curIdx + len) & INFLATE_WINDOW_MASK;
+		state->AvailOut -= len; copyLen += len;
 	}
 
+	/* Clear out the partial byte past the end of the bit buffer that refilling may have left */
+	bits &= ((cc_uint64)1 << numBits) - 1;
+	state->Bits     = bits;
+	state->NumBits  = numBits;
+	state->AvailIn -= (cc_uint32)(in - state->NextIn);
+	state->NextIn   = in;
+
 	state->WindowIndex = curIdx;
 	if (!copyLen) return;
 
@@ -471,6 +548,7 @@ void Inflate_Process(struct InflateState* state) {
 	/* window variables */
 	cc_uint32 startIdx, curIdx;
 	cc_uint32 copyLen, windowCopyLen;
+	cc_result res;
 
 	for (;;) {
 		switch (state->State) {
@@ -496,8 +574,8 @@ void Inflate_Process(struct InflateState* state) {
 			} break;
 
 			case 3: {
-				Logger_Abort("DEFLATE - Invalid block type");
-			} break;
+				Inflate_Fail(state, INF_ERR_BLOCKTYPE);
+			}
 
 			}
 			break;
@@ -509,7 +587,7 @@ void Inflate_Process(struct InflateState* state) {
 			nlen = Inflate_ReadBits(state, 16);
 
 			if (len != (nlen ^ 0xFFFFUL)) {
-				Logger_Abort("DEFLATE - Uncompressed block LEN check failed");
+				Inflate_Fail(state, INF_ERR_BLOCKLEN);
 			}
 			state->Index = len; /* Reuse for 'uncompressed length' */
 			state->State = INFLATE_STATE_UNCOMPRESSED_DATA;
@@ -570,7 +648,8 @@ void Inflate_Process(struct InflateState* state) {
 
 			state->Index = 0;
 			state->State = INFLATE_STATE_DYNAMIC_LITSDISTS;
-			Huffman_Build(&state->Table.CodeLens, state->Buffer, INFLATE_MAX_CODELENS);
+			res = Huffman_Build(&state->Table.CodeLens, state->Buffer, INFLATE_MAX_CODELENS);
+			if (res) Inflate_Fail(state, res);
 		}
 
 		case INFLATE_STATE_DYNAMIC_LITSDISTS: {
@@ -591,8 +670,11 @@ void Inflate_Process(struct InflateState* state) {
 			if (state->Index == count) {
 				state->Index = 0;
 				state->State = Inflate_NextCompressState(state);
-				Huffman_Build(&state->Table.Lits, state->Buffer, state->NumLits);
-				Huffman_Build(&state->TableDists, &state->Buffer[state->NumLits], state->NumDists);
+
+				res = Huffman_Build(&state->Table.Lits, state->Buffer, state->NumLits);
+				if (res) Inflate_Fail(state, res);
+				res = Huffman_Build(&state->TableDists, &state->Buffer[state->NumLits], state->NumDists);
+				if (res) Inflate_Fail(state, res);
 			}
 			break;
 		}
@@ -602,7 +684,7 @@ void Inflate_Process(struct InflateState* state) {
 			case 16:
 				Inflate_EnsureBits(state, 2);
 				repeatCount = Inflate_ReadBits(state, 2);
-				if (!state->Index) Logger_Abort("DEFLATE - Tried to repeat invalid byte");
+				if (!state->Index) Inflate_Fail(state, INF_ERR_REPEAT_BEG);
 				repeatCount += 3; repeatValue = state->Buffer[state->Index - 1];
 				break;
 
@@ -621,7 +703,7 @@ void Inflate_Process(struct InflateState* state) {
 
 			count = state->NumLits + state->NumDists;
 			if (state->Index + repeatCount > count) {
-				Logger_Abort("DEFLATE - Tried to repeat past end");
+				Inflate_Fail(state, INF_ERR_REPEAT_END);
 			}
 
 			Mem_Set(&state->Buffer[state->Index], repeatValue, repeatCount);
@@ -703,6 +785,7 @@ void Inflate_Process(struct InflateState* state) {
 		}
 
 		case INFLATE_STATE_DONE:
+		case INFLATE_STATE_FAILED:
 			return;
 		}
 	}
@@ -724,6 +807,7 @@ static cc_result Inflate_StreamRead(struct Stream* stream, cc_uint8* data, cc_ui
 	hasInput = true;
 	while (state->AvailOut > 0 && hasInput) {
 		if (state->State == INFLATE_STATE_DONE) break;
+		if (state->State == INFLATE_STATE_FAILED) return state->Error;
 
 		if (!state->AvailIn) {
 			/* Fully used up input buffer. Cycle back to start. */
@@ -759,28 +843,79 @@ void Inflate_MakeStream(struct Stream* stream, struct InflateState* state, struc
 /*########################################################################################################################*
 *---------------------------------------------------Deflate (compress)----------------------------------------------------*
 *#########################################################################################################################*/
-/* these are copies of len_base and dist_base, with UINT16_MAX instead of 0 for sentinel cutoff */
-static const cc_uint16 deflate_len[30] = {
-	3,4,5,6,7,8,9,10,11,13,
-	15,17,19,23,27,31,35,43,51,59,
-	67,83,99,115,131,163,195,227,258,UInt16_MaxValue
+/* Lookup table for index into len_base/len_bits, of a match length. (indexed by length - 3) */
+static const cc_uint8 deflate_lenIdx[256] = {
+	 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9,10,10,11,11,
+	12,12,12,12,13,13,13,13,14,14,14,14,15,15,15,15,
+	16,16,16,16,16,16,16,16,17,17,17,17,17,17,17,17,
+	18,18,18,18,18,18,18,18,19,19,19,19,19,19,19,19,
+	20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,
+	21,21,21,21,21,21,21,21,21,21,21,21,21,21,21,21,
+	22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,
+	23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
+	24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,
+	24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,
+	25,25,25,25,25,25,25,25,25,25,25,25,25,25,25,25,
+	25,25,25,25,25,25,25,25,25,25,25,25,25,25,25,25,
+	26,26,26,26,26,26,26,26,26,26,26,26,26,26,26,26,
+	26,26,26,26,26,26,26,26,26,26,26,26,26,26,26,26,
+	27,27,27,27,27,27,27,27,27,27,27,27,27,27,27,27,
+	27,27,27,27,27,27,27,27,27,27,27,27,27,27,27,28
 };
-static const cc_uint16 deflate_dist[31] = {
-	1,2,3,4,5,7,9,13,17,25,
-	33,49,65,97,129,193,257,385,513,769,
-	1025,1537,2049,3073,4097,6145,8193,12289,16385,24577,UInt16_MaxValue
+/* Lookup table for index into dist_base/dist_bits, of a match distance. */
+/* Indexed by distance - 1 for distances <= 256, 256 + ((distance - 1) >> 7) otherwise */
+static const cc_uint8 deflate_distIdx[512] = {
+	 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7,
+	 8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9,
+	10,10,10,10,10,10,10,10,10,10,10,10,10,10,10,10,
+	11,11,11,11,11,11,11,11,11,11,11,11,11,11,11,11,
+	12,12,12,12,12,12,12,12,12,12,12,12,12,12,12,12,
+	12,12,12,12,12,12,12,12,12,12,12,12,12,12,12,12,
+	13,13,13,13,13,13,13,13,13,13,13,13,13,13,13,13,
+	13,13,13,13,13,13,13,13,13,13,13,13,13,13,13,13,
+	14,14,14,14,14,14,14,14,14,14,14,14,14,14,14,14,
+	14,14,14,14,14,14,14,14,14,14,14,14,14,14,14,14,
+	14,14,14,14,14,14,14,14,14,14,14,14,14,14,14,14,
+	14,14,14,14,14,14,14,14,14,14,14,14,14,14,14,14,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,15,
+	 0, 0,16,17,18,18,19,19,20,20,20,20,21,21,21,21,
+	22,22,22,22,22,22,22,22,23,23,23,23,23,23,23,23,
+	24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,
+	25,25,25,25,25,25,25,25,25,25,25,25,25,25,25,25,
+	26,26,26,26,26,26,26,26,26,26,26,26,26,26,26,26,
+	26,26,26,26,26,26,26,26,26,26,26,26,26,26,26,26,
+	27,27,27,27,27,27,27,27,27,27,27,27,27,27,27,27,
+	27,27,27,27,27,27,27,27,27,27,27,27,27,27,27,27,
+	28,28,28,28,28,28,28,28,28,28,28,28,28,28,28,28,
+	28,28,28,28,28,28,28,28,28,28,28,28,28,28,28,28,
+	28,28,28,28,28,28,28,28,28,28,28,28,28,28,28,28,
+	28,28,28,28,28,28,28,28,28,28,28,28,28,28,28,28,
+	29,29,29,29,29,29,29,29,29,29,29,29,29,29,29,29,
+	29,29,29,29,29,29,29,29,29,29,29,29,29,29,29,29,
+	29,29,29,29,29,29,29,29,29,29,29,29,29,29,29,29,
+	29,29,29,29,29,29,29,29,29,29,29,29,29,29,29,29
 };
 
 /* Pushes given bits, but does not write them */
-#define Deflate_PushBits(state, value, bits) state->Bits |= (value) << state->NumBits; state->NumBits += (bits);
+#define Deflate_PushBits(state, value, bits) state->Bits |= (cc_uint64)(value) << state->NumBits; state->NumBits += (bits);
 /* Pushes bits of the huffman codeword bits for the given literal, but does not write them */
 #define Deflate_PushLit(state, value) Deflate_PushBits(state, state->LitsCodewords[value], state->LitsLens[value])
 /* Pushes given bits (reversing for huffman code), but does not write them */
 #define Deflate_PushHuff(state, value, bits) Deflate_PushBits(state, Huffman_ReverseBits(value, bits), bits)
 /* Writes given byte to output */
-#define Deflate_WriteByte(state) *state->NextOut++ = state->Bits; state->AvailOut--; state->Bits >>= 8; state->NumBits -= 8;
+#define Deflate_WriteByte(state) *state->NextOut++ = (cc_uint8)state->Bits; state->AvailOut--; state->Bits >>= 8; state->NumBits -= 8;
 /* Flushes bits in buffer to output buffer */
 #define Deflate_FlushBits(state) while (state->NumBits >= 8) { Deflate_WriteByte(state); }
+/* Writes 4 bytes to output buffer, if at least 32 bits are in bit buffer */
+/* NOTE: A literal or length-distance pair is at most 31 bits, so bit buffer never overflows */
+#define Deflate_FlushWord(state) if (state->NumBits >= 32) {\
+	state->NextOut[0] = (cc_uint8)(state->Bits);       state->NextOut[1] = (cc_uint8)(state->Bits >> 8);\
+	state->NextOut[2] = (cc_uint8)(state->Bits >> 16); state->NextOut[3] = (cc_uint8)(state->Bits >> 24);\
+	state->NextOut += 4; state->AvailOut -= 4; state->Bits >>= 32; state->NumBits -= 32;\
+}
 
 #define MIN_MATCH_LEN 3
 #define MAX_MATCH_LEN 258
@@ -788,7 +923,19 @@ static const cc_uint16 deflate_dist[31] = {
 /* Number of bytes that match (are the same) from a and b */
 static int Deflate_MatchLen(cc_uint8* a, cc_uint8* b, int maxLen) {
 	int i = 0;
-	while (i < maxLen && *a == *b) { i++; a++; b++; }
+#ifdef DEFLATE_FAST_WORDS
+	cc_uint64 wordA, wordB;
+	/* Hash collisions usually differ in first byte, so avoid loading whole word in that case */
+	if (*a != *b) return 0;
+
+	/* First differing byte is lowest non-zero byte of XOR of the two words */
+	for (; i + 8 <= maxLen; i += 8) {
+		Deflate_CopyWord(&wordA, a + i);
+		Deflate_CopyWord(&wordB, b + i);
+		if (wordA != wordB) return i + Deflate_FirstSetByte(wordA ^ wordB);
+	}
+#endif
+	while (i < maxLen && a[i] == b[i]) { i++; }
 	return i;
 }
 
@@ -800,23 +947,22 @@ static cc_uint32 Deflate_Hash(cc_uint8* src) {
 /* Writes a literal to state->Output */
 static void Deflate_Lit(struct DeflateState* state, int lit) {
 	Deflate_PushLit(state, lit);
-	Deflate_FlushBits(state);
+	Deflate_FlushWord(state);
 }
 
 /* Writes a length-distance pair to state->Output */
 static void Deflate_LenDist(struct DeflateState* state, int len, int dist) {
 	int j;
-	/* TODO: Do we actually need the if (len_bits[j]) ????????? does writing 0 bits matter??? */
+	/* NOTE: Pushing 0 extra bits is harmless, so no need to check len_bits/dist_bits */
 
-	for (j = 0; len >= deflate_len[j + 1]; j++);
+	j = deflate_lenIdx[len - MIN_MATCH_LEN];
 	Deflate_PushLit(state, j + 257);
-	if (len_bits[j]) { Deflate_PushBits(state, len - deflate_len[j], len_bits[j]); }
-	Deflate_FlushBits(state);
+	Deflate_PushBits(state, len - len_base[j], len_bits[j]);
 
-	for (j = 0; dist >= deflate_dist[j + 1]; j++);
+	j = dist <= 256 ? deflate_distIdx[dist - 1] : deflate_distIdx[256 + ((dist - 1) >> 7)];
 	Deflate_PushHuff(state, j, 5);
-	if (dist_bits[j]) { Deflate_PushBits(state, dist - deflate_dist[j], dist_bits[j]); }
-	Deflate_FlushBits(state);
+	Deflate_PushBits(state, dist - dist_base[j], dist_bits[j]);
+	Deflate_FlushWord(state);
 }
 
 /* Moves "current block" to "previous block", adjusting state if needed. */
@@ -864,10 +1010,10 @@ static cc_result Deflate_FlushBlock(struct DeflateState* state, int len) {
 		bestPos = 0;
 
 		/* Find longest match starting at this byte */
-		/* Only explore up to 5 previous matches, to avoid slow performance */
+		/* By default only explore up to 5 previous matches, to avoid slow performance */
 		/* (i.e prefer quickly saving maps/screenshots to completely optimal filesize) */
 		pos = state->Head[hash];
-		for (depth = 0; pos != 0 && depth < 5; depth++) {
+		for (depth = 0; pos != 0 && depth < state->MaxDepth; depth++) {
 			matchLen = Deflate_MatchLen(&input[pos], cur, maxLen);
 			if (matchLen > bestLen) { bestLen = matchLen; bestPos = pos; }
 			pos = state->Prev[pos];
@@ -886,7 +1032,7 @@ static cc_result Deflate_FlushBlock(struct DeflateState* state, int len) {
 			nextPos  = state->Head[nextHash];
 			maxLen   = min(len - 1, MAX_MATCH_LEN);
 
-			for (depth = 0; nextPos != 0 && depth < 5; depth++) {
+			for (depth = 0; nextPos != 0 && depth < state->MaxDepth; depth++) {
 				matchLen = Deflate_MatchLen(&input[nextPos], cur + 1, maxLen);
 				if (matchLen > bestLen) { bestPos = 0; break; }
 				nextPos = state->Prev[nextPos];
@@ -974,6 +1120,44 @@ static cc_result Deflate_StreamClose(struct Stream* stream) {
 	return Stream_Write(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
 }
 
+/* Fills "previous block" with data that precedes the data to compress, so matches can refer back to it */
+static void Deflate_SetDictionary(struct DeflateState* state, const cc_uint8* data) {
+	cc_uint32 hash;
+	int pos;
+	Mem_Copy(state->Input, data, DEFLATE_BLOCK_SIZE);
+
+	/* NOTE: Position 0 is used to indicate no match, so can't be inserted */
+	for (pos = 1; pos < DEFLATE_BLOCK_SIZE - MIN_MATCH_LEN; pos++) {
+		hash = Deflate_Hash(&state->Input[pos]);
+		state->Prev[pos]  = state->Head[hash];
+		state->Head[hash] = pos;
+	}
+}
+
+/* Flushes any buffered data, then ends the block and realigns output to a byte boundary */
+/* (i.e. a 'sync flush', so that the output can be directly followed by more DEFLATE blocks) */
+static cc_result Deflate_FlushSync(struct DeflateState* state) {
+	cc_result res = Deflate_FlushBlock(state, state->InputPosition - DEFLATE_BLOCK_SIZE);
+	if (res) return res;
+
+	/* Write huffman encoded "literal 256" to terminate symbols */
+	Deflate_PushLit(state, 256);
+	/* Then an empty non final uncompressed block, which is padded to the next byte */
+	Deflate_PushBits(state, 0, 3);
+	Deflate_FlushBits(state);
+
+	if (state->NumBits) {
+		while (state->NumBits < 8) { Deflate_PushBits(state, 0, 1); }
+		Deflate_FlushBits(state);
+	}
+
+	/* Uncompressed block LEN is 0, NLEN is ~0 */
+	state->NextOut[0] = 0x00; state->NextOut[1] = 0x00;
+	state->NextOut[2] = 0xFF; state->NextOut[3] = 0xFF;
+	state->NextOut += 4; state->AvailOut -= 4;
+	return Stream_Write(state->Dest, state->Output, DEFLATE_OUT_SIZE - state->AvailOut);
+}
+
 /* Constructs a huffman encoding table (for values to codewords) */
 static void Deflate_BuildTable(const cc_uint8* lens, int count, cc_uint16* codewords, cc_uint8* bitlens) {
 	int i, j, offset, codeword;
@@ -1008,12 +1192,20 @@ void Deflate_MakeStream(struct Stream* stream, struct DeflateState* state, struc
 	state->AvailOut = DEFLATE_OUT_SIZE;
 	state->Dest     = underlying;
 	state->WroteHeader = false;
+	state->MaxDepth    = 5;
 
 	Mem_Set(state->Head, 0, sizeof(state->Head));
 	Mem_Set(state->Prev, 0, sizeof(state->Prev));
 	Deflate_BuildTable(fixed_lits, INFLATE_MAX_LITS, state->LitsCodewords, state->LitsLens);
 }
 
+void Deflate_SetLevel(struct DeflateState* state, int level) {
+	static const cc_uint16 depths[DEFLATE_MAX_LEVEL] = { 1, 2, 3, 4, 5, 16, 32, 128, 1024 };
+	level = max(level, DEFLATE_MIN_LEVEL);
+	level = min(level, DEFLATE_MAX_LEVEL);
+	state->MaxDepth = depths[level - 1];
+}
+
 
 /*########################################################################################################################*
 *-----------------------------------------------------GZip (compress)-----------------------------------------------------*
@@ -1031,15 +1223,8 @@ static cc_result GZip_StreamClose(struct Stream* stream) {
 
 static cc_result GZip_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
 	struct GZipState* state = (struct GZipState*)stream->Meta.Inflate;
-	cc_uint32 i, crc32 = state->Crc32;
 	state->Size += count;
-
-	/* TODO: Optimise this calculation */
-	for (i = 0; i < count; i++) {
-		crc32 = Utils_Crc32Table[(crc32 ^ data[i]) & 0xFF] ^ (crc32 >> 8);
-	}
-
-	state->Crc32 = crc32;
+	state->Crc32 = Utils_Crc32Update(state->Crc32, data, count);
 	return Deflate_StreamWrite(stream, data, count, modified);
 }
 
@@ -1062,6 +1247,199 @@ void GZip_MakeStream(struct Stream* stream, struct GZipState* state, struct Stre
 }
 
 
+/*########################################################################################################################*
+*------------------------------------------------GZip parallel (compress)-------------------------------------------------*
+*#########################################################################################################################*/
+/* Fixed huffman codes are at most 9 bits per input byte, so compressed data can be a bit larger than the input */
+#define GZIP_PARALLEL_OUT_SIZE ((GZIP_PARALLEL_CHUNK_SIZE / 8) * 11 + 1024)
+static cc_result GZipParallel_OutputWrite(struct Stream* s, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	count = min(count, s->Meta.Mem.Left);
+	Mem_Copy(s->Meta.Mem.Cur, data, count);
+
+	s->Meta.Mem.Cur  += count;
+	s->Meta.Mem.Left -= count;
+	*modified = count;
+	return 0;
+}
+
+/* Compresses the given chunk of the current batch into a sequence of non final DEFLATE blocks */
+static cc_result GZipParallel_CompressChunk(struct GZipParallelState* state, int i) {
+	struct DeflateState* deflate = &state->Deflaters[i];
+	struct Stream stream, output;
+	cc_uint32 offset = i * GZIP_PARALLEL_CHUNK_SIZE;
+	cc_uint8* data   = state->Input + DEFLATE_BLOCK_SIZE + offset;
+	cc_uint32 len    = min(GZIP_PARALLEL_CHUNK_SIZE, state->InputLength - offset);
+	cc_result res;
+
+	Stream_Init(&output);
+	output.Write = GZipParallel_OutputWrite;
+	output.Meta.Mem.Cur    = state->Outputs[i];
+	output.Meta.Mem.Base   = state->Outputs[i];
+	output.Meta.Mem.Left   = GZIP_PARALLEL_OUT_SIZE;
+	output.Meta.Mem.Length = GZIP_PARALLEL_OUT_SIZE;
+
+	Deflate_MakeStream(&stream, deflate, &output);
+	Deflate_SetLevel(deflate, state->Level);
+	if (i || state->HasDictionary) Deflate_SetDictionary(deflate, data - DEFLATE_BLOCK_SIZE);
+	deflate->WroteHeader = true;
+	Deflate_PushBits(deflate, 2, 3); /* final block FALSE, block type FIXED */
+
+	if ((res = Stream_Write(&stream, data, len))) return res;
+	if ((res = Deflate_FlushSync(deflate)))       return res;
+
+	state->OutputLens[i] = (cc_uint32)(output.Meta.Mem.Cur - output.Meta.Mem.Base);
+	state->Crc32s[i]     = Utils_CRC32(data, len);
+	return 0;
+}
+
+static void GZipParallel_WorkerLoop(void* arg) {
+	struct GZipParallelState* state = (struct GZipParallelState*)arg;
+	int i;
+
+	for (;;) {
+		Mutex_Lock(state->_mutex);
+		{
+			i = state->_nextChunk++;
+		}
+		Mutex_Unlock(state->_mutex);
+
+		if (i >= state->_batchChunks) return;
+		state->Results[i] = GZipParallel_CompressChunk(state, i);
+	}
+}
+
+/* Compresses all the chunks in the current batch, then writes them out in order */
+static cc_result GZipParallel_FlushBatch(struct GZipParallelState* state) {
+	void* threads[GZIP_PARALLEL_MAX_CHUNKS];
+	cc_uint32 len;
+	cc_result res;
+	int i, count;
+	if (!state->InputLength) return 0;
+
+	count = (state->InputLength + (GZIP_PARALLEL_CHUNK_SIZE - 1)) / GZIP_PARALLEL_CHUNK_SIZE;
+	state->_batchChunks = count;
+	state->_nextChunk   = 0;
+
+	/* Calling thread also compresses chunks, so one less thread is needed */
+	for (i = 1; i < count; i++) {
+		threads[i] = Thread_StartArg(GZipParallel_WorkerLoop, state);
+	}
+	GZipParallel_WorkerLoop(state);
+	for (i = 1; i < count; i++) {
+		Thread_Join(threads[i]);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (state->Results[i]) return state->Results[i];
+		res = Stream_Write(state->Dest, state->Outputs[i], state->OutputLens[i]);
+		if (res) return res;
+
+		len = min(GZIP_PARALLEL_CHUNK_SIZE, state->InputLength - i * GZIP_PARALLEL_CHUNK_SIZE);
+		state->Crc32 = Utils_Crc32Combine(state->Crc32, state->Crc32s[i], len);
+	}
+
+	/* End of this batch is preset dictionary for first chunk of next batch */
+	/* (batches are only flushed when partially full when closing the stream) */
+	if (state->InputLength >= DEFLATE_BLOCK_SIZE) {
+		Mem_Copy(state->Input, state->Input + state->InputLength, DEFLATE_BLOCK_SIZE);
+		state->HasDictionary = true;
+	}
+	state->InputLength = 0;
+	return 0;
+}
+
+static cc_result GZipParallel_StreamWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct GZipParallelState* state = (struct GZipParallelState*)stream->Meta.Inflate;
+	cc_uint32 len, batchSize = state->NumChunks * GZIP_PARALLEL_CHUNK_SIZE;
+	cc_result res;
+
+	state->Size += count;
+	*modified    = 0;
+
+	while (count > 0) {
+		len = min(count, batchSize - state->InputLength);
+		Mem_Copy(state->Input + DEFLATE_BLOCK_SIZE + state->InputLength, data, len);
+
+		state->InputLength += len;
+		*modified += len;
+		data  += len;
+		count -= len;
+
+		if (state->InputLength < batchSize) continue;
+		if ((res = GZipParallel_FlushBatch(state))) return res;
+	}
+	return 0;
+}
+
+static cc_result GZipParallel_StreamWriteFirst(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	static cc_uint8 header[10] = { 0x1F, 0x8B, 0x08 }; /* GZip header */
+	struct GZipParallelState* state = (struct GZipParallelState*)stream->Meta.Inflate;
+	cc_result res;
+
+	if ((res = Stream_Write(state->Dest, header, sizeof(header)))) return res;
+	stream->Write = GZipParallel_StreamWrite;
+	return GZipParallel_StreamWrite(stream, data, count, modified);
+}
+
+static void GZipParallel_Free(struct GZipParallelState* state) {
+	int i;
+	for (i = 0; i < state->NumChunks; i++) {
+		Mem_Free(state->Outputs[i]);
+	}
+
+	Mem_Free(state->Input);
+	Mem_Free(state->Deflaters);
+	Mutex_Free(state->_mutex);
+}
+
+static cc_result GZipParallel_StreamClose(struct Stream* stream) {
+	/* Empty final block with fixed huffman codes, to terminate the DEFLATE data */
+	static cc_uint8 lastBlock[2] = { 0x03, 0x00 };
+	struct GZipParallelState* state = (struct GZipParallelState*)stream->Meta.Inflate;
+	cc_uint8 data[8];
+	cc_result res;
+
+	res = GZipParallel_FlushBatch(state);
+	GZipParallel_Free(state);
+	if (res) return res;
+
+	if ((res = Stream_Write(state->Dest, lastBlock, sizeof(lastBlock)))) return res;
+	Stream_SetU32_LE(&data[0], state->Crc32);
+	Stream_SetU32_LE(&data[4], state->Size);
+	return Stream_Write(state->Dest, data, sizeof(data));
+}
+
+void GZip_AbortParallelStream(struct GZipParallelState* state) { GZipParallel_Free(state); }
+
+void GZip_MakeParallelStream(struct Stream* stream, struct GZipParallelState* state, struct Stream* underlying) {
+	int i, count;
+	Stream_Init(stream);
+	stream->Meta.Inflate = state;
+	stream->Write = GZipParallel_StreamWriteFirst;
+	stream->Close = GZipParallel_StreamClose;
+
+	/* CRC32 lookup tables are lazily initialised, so make sure that happens before worker threads use them */
+	Utils_Crc32Update(0, NULL, 0);
+	count = Thread_ProcessorCount();
+	count = min(count, GZIP_PARALLEL_MAX_CHUNKS);
+	state->NumChunks = count;
+
+	state->Crc32  = 0;
+	state->Size   = 0;
+	state->Dest   = underlying;
+	state->InputLength   = 0;
+	state->HasDictionary = false;
+	state->Level         = DEFLATE_DEF_LEVEL;
+
+	state->Input     = (cc_uint8*)Mem_Alloc(DEFLATE_BLOCK_SIZE + count * GZIP_PARALLEL_CHUNK_SIZE, 1, "GZip input");
+	state->Deflaters = (struct DeflateState*)Mem_Alloc(count, sizeof(struct DeflateState), "GZip deflaters");
+	for (i = 0; i < count; i++) {
+		state->Outputs[i] = (cc_uint8*)Mem_Alloc(GZIP_PARALLEL_OUT_SIZE, 1, "GZip output");
+	}
+	state->_mutex = Mutex_Create();
+}
+
+
 /*########################################################################################################################*
 *-----------------------------------------------------ZLib (compress)-----------------------------------------------------*
 *#########################################################################################################################*/
@@ -1193,35 +1571,14 @@ static cc_result Zip_ReadCentralDirectory(struct ZipState* state) {
 	return 0;
 }
 
-static cc_result Zip_ReadEndOfCentralDirectory(struct ZipState* state) {
-	struct Stream* stream = state->Input;
-	cc_uint8 header[18];
-
-	cc_result res;
-	if ((res = Stream_Read(stream, header, sizeof(header)))) return res;
-
-	state->_totalEntries  = Stream_GetU16_LE(&header[6]);
-	state->_centralDirBeg = Stream_GetU32_LE(&header[12]);
-	return 0;
-}
-
 enum ZipSig {
 	ZIP_SIG_ENDOFCENTRALDIR = 0x06054b50,
 	ZIP_SIG_CENTRALDIR      = 0x02014b50,
 	ZIP_SIG_LOCALFILEHEADER = 0x04034b50
 };
 
-static cc_result Zip_DefaultProcessor(const String* path, struct Stream* data, struct ZipState* s) { return 0; }
-static cc_bool Zip_DefaultSelector(const String* path) { return true; }
-void Zip_Init(struct ZipState* state, struct Stream* input) {
-	state->Input = input;
-	state->Obj   = NULL;
-	state->ProcessEntry = Zip_DefaultProcessor;
-	state->SelectEntry  = Zip_DefaultSelector;
-}
-
-cc_result Zip_Extract(struct ZipState* state) {
-	struct Stream* stream = state->Input;
+/* Finds then reads the end of central directory record (excluding signature) */
+static cc_result Zip_ReadEndOfCentralDirectory(struct Stream* stream, cc_uint8* header) {
 	cc_uint32 stream_len;
 	cc_uint32 sig = 0;
 	int i, count;
@@ -1240,8 +1597,28 @@ cc_result Zip_Extract(struct ZipState* state) {
 	}
 
 	if (sig != ZIP_SIG_ENDOFCENTRALDIR) return ZIP_ERR_NO_END_OF_CENTRAL_DIR;
-	res = Zip_ReadEndOfCentralDirectory(state);
-	if (res) return res;
+	return Stream_Read(stream, header, 18);
+}
+
+static cc_result Zip_DefaultProcessor(const String* path, struct Stream* data, struct ZipState* s) { return 0; }
+static cc_bool Zip_DefaultSelector(const String* path) { return true; }
+void Zip_Init(struct ZipState* state, struct Stream* input) {
+	state->Input = input;
+	state->Obj   = NULL;
+	state->ProcessEntry = Zip_DefaultProcessor;
+	state->SelectEntry  = Zip_DefaultSelector;
+}
+
+cc_result Zip_Extract(struct ZipState* state) {
+	struct Stream* stream = state->Input;
+	cc_uint8 header[18];
+	cc_uint32 sig = 0;
+	int i;
+
+	cc_result res;
+	if ((res = Zip_ReadEndOfCentralDirectory(stream, header))) return res;
+	state->_totalEntries  = Stream_GetU16_LE(&header[6]);
+	state->_centralDirBeg = Stream_GetU32_LE(&header[12]);
 
 	res = stream->Seek(stream, state->_centralDirBeg);
 	if (res) return ZIP_ERR_SEEK_CENTRAL_DIR;
@@ -1275,3 +1652,364 @@ cc_result Zip_Extract(struct ZipState* state) {
 	}
 	return 0;
 }
+
+
+/*########################################################################################################################*
+*--------------------------------------------------------ZipIndex---------------------------------------------------------*
+*#########################################################################################################################*/
+#define ZIP_CENTRALDIR_SIZE 46
+#define ZIP_LOCALHEADER_SIZE 30
+
+/* Caselessly hashes the filename portion of the given path */
+static cc_uint32 ZipIndex_Hash(const String* path) {
+	String name = *path;
+	cc_uint32 hash = 0;
+	char c;
+	int i;
+
+	Utils_UNSAFE_GetFilename(&name);
+	for (i = 0; i < name.length; i++) {
+		c = name.buffer[i];
+		Char_MakeLower(c);
+		hash = (hash * 31) + (cc_uint8)c;
+	}
+	return hash;
+}
+
+/* NOTE: Replaces any earlier entry with the same filename, so the last entry in the archive wins */
+static void ZipIndex_Insert(struct ZipIndex* index, int i) {
+	String name = index->Paths[i], path;
+	int j, slot;
+
+	Utils_UNSAFE_GetFilename(&name);
+	slot = ZipIndex_Hash(&name) & index->_bucketsMask;
+
+	while ((j = index->_buckets[slot])) {
+		path = index->Paths[j - 1];
+		Utils_UNSAFE_GetFilename(&path);
+
+		if (String_CaselessEquals(&path, &name)) break;
+		slot = (slot + 1) & index->_bucketsMask;
+	}
+	index->_buckets[slot] = i + 1;
+}
+
+int ZipIndex_Find(struct ZipIndex* index, const String* name) {
+	String path, file = *name;
+	int i, slot;
+
+	Utils_UNSAFE_GetFilename(&file);
+	slot = ZipIndex_Hash(&file) & index->_bucketsMask;
+
+	while ((i = index->_buckets[slot])) {
+		path = index->Paths[i - 1];
+		Utils_UNSAFE_GetFilename(&path);
+
+		if (String_CaselessEquals(&path, &file)) return i - 1;
+		slot = (slot + 1) & index->_bucketsMask;
+	}
+	return -1;
+}
+
+static cc_result ZipIndex_Read(struct ZipIndex* index, struct Stream* input) {
+	cc_uint8 header[18];
+	cc_uint32 dirSize, dirBeg, offset, length;
+	int i, count, buckets, pathLen, extraLen, commentLen;
+	struct ZipEntry* entry;
+	cc_uint8* data;
+	cc_result res;
+
+	if ((res = Zip_ReadEndOfCentralDirectory(input, header))) return res;
+	count   = Stream_GetU16_LE(&header[6]);
+	dirSize = Stream_GetU32_LE(&header[8]);
+	dirBeg  = Stream_GetU32_LE(&header[12]);
+
+	/* Don't trust the sizes in the header, as the archive could be corrupted */
+	if ((res = input->Length(input, &length))) return res;
+	if (dirBeg > length || dirSize > length - dirBeg) return ZIP_ERR_INVALID_CENTRAL_DIR;
+
+	/* Read all the central directory entries at once, to avoid many small reads */
+	if (input->Seek(input, dirBeg)) return ZIP_ERR_SEEK_CENTRAL_DIR;
+	index->_centralDir = (cc_uint8*)Mem_TryAlloc(dirSize + 1, 1);
+	if (!index->_centralDir) return ERR_OUT_OF_MEMORY;
+	if ((res = Stream_Read(input, index->_centralDir, dirSize))) return res;
+
+	/* Keep hash table at most half full */
+	for (buckets = 16; buckets < count * 2; buckets <<= 1) { }
+	index->Entries  = (struct ZipEntry*)Mem_TryAlloc(count + 1, sizeof(struct ZipEntry));
+	index->Paths    = (String*)Mem_TryAlloc(count + 1, sizeof(String));
+	index->_buckets = (int*)Mem_TryAlloc(buckets, sizeof(int));
+
+	if (!index->Entries || !index->Paths || !index->_buckets) return ERR_OUT_OF_MEMORY;
+	Mem_Set(index->_buckets, 0, buckets * sizeof(int));
+	index->_bucketsMask = buckets - 1;
+
+	for (i = 0, offset = 0; i < count; i++) {
+		if (offset + ZIP_CENTRALDIR_SIZE > dirSize) return ZIP_ERR_INVALID_CENTRAL_DIR;
+		data = &index->_centralDir[offset];
+		if (Stream_GetU32_LE(data) != ZIP_SIG_CENTRALDIR) return ZIP_ERR_INVALID_CENTRAL_DIR;
+
+		pathLen    = Stream_GetU16_LE(&data[28]);
+		extraLen   = Stream_GetU16_LE(&data[30]);
+		commentLen = Stream_GetU16_LE(&data[32]);
+		if (offset + ZIP_CENTRALDIR_SIZE + pathLen > dirSize) return ZIP_ERR_INVALID_CENTRAL_DIR;
+
+		entry = &index->Entries[i];
+		entry->CRC32             = Stream_GetU32_LE(&data[16]);
+		entry->CompressedSize    = Stream_GetU32_LE(&data[20]);
+		entry->UncompressedSize  = Stream_GetU32_LE(&data[24]);
+		entry->LocalHeaderOffset = Stream_GetU32_LE(&data[42]);
+
+		/* NOTE: ZIP spec says path uses code page 437 for encoding */
+		index->Paths[i] = String_Init((char*)&data[ZIP_CENTRALDIR_SIZE], pathLen, pathLen);
+		ZipIndex_Insert(index, i);
+		index->Count++;
+		offset += ZIP_CENTRALDIR_SIZE + pathLen + extraLen + commentLen;
+	}
+	return 0;
+}
+
+cc_result ZipIndex_Load(struct ZipIndex* index, struct Stream* input) {
+	cc_result res;
+	index->Input   = input;
+	index->Count   = 0;
+	index->Entries = NULL;
+	index->Paths   = NULL;
+	index->_centralDir = NULL;
+	index->_buckets    = NULL;
+
+	res = ZipIndex_Read(index, input);
+	if (res) ZipIndex_Free(index);
+	return res;
+}
+
+void ZipIndex_Free(struct ZipIndex* index) {
+	Mem_Free(index->Entries);
+	Mem_Free(index->Paths);
+	Mem_Free(index->_centralDir);
+	Mem_Free(index->_buckets);
+
+	index->Count   = 0;
+	index->Entries = NULL;
+	index->Paths   = NULL;
+	index->_centralDir = NULL;
+	index->_buckets    = NULL;
+}
+
+cc_result ZipIndex_Open(struct ZipIndex* index, int i, struct Stream* stream, struct ZipEntryState* state) {
+	struct Stream* input   = index->Input;
+	struct ZipEntry* entry = &index->Entries[i];
+	cc_uint8 header[ZIP_LOCALHEADER_SIZE];
+	int method, pathLen, extraLen;
+	cc_result res;
+
+	if (input->Seek(input, entry->LocalHeaderOffset)) return ZIP_ERR_SEEK_LOCAL_DIR;
+	if ((res = Stream_Read(input, header, sizeof(header)))) return res;
+	if (Stream_GetU32_LE(header) != ZIP_SIG_LOCALFILEHEADER) return ZIP_ERR_INVALID_LOCAL_DIR;
+
+	/* local file may have different extra data to central directory (e.g. ZIP64) */
+	method   = Stream_GetU16_LE(&header[8]);
+	pathLen  = Stream_GetU16_LE(&header[26]);
+	extraLen = Stream_GetU16_LE(&header[28]);
+	if ((res = input->Skip(input, pathLen + extraLen))) return res;
+
+	if (method == 0) {
+		Stream_ReadonlyPortion(stream, input, entry->UncompressedSize);
+		return 0;
+	} else if (method == 8) {
+		Stream_ReadonlyPortion(&state->Portion, input, entry->CompressedSize);
+		Inflate_MakeStream(stream, &state->Inflate, &state->Portion);
+		return 0;
+	}
+
+	Platform_Log1("Unsupported.zip entry compression method: %i", &method);
+	return ERR_NOT_SUPPORTED;
+}
+
+
+/*########################################################################################################################*
+*--------------------------------------------------------ZipWriter--------------------------------------------------------*
+*#########################################################################################################################*/
+#define ZIP_DATADESCRIPTOR_SIZE 16
+#define ZIP_FLAG_DATADESCRIPTOR 0x08
+enum ZipWriterSig { ZIP_SIG_DATADESCRIPTOR = 0x08074b50 };
+
+static cc_result ZipWriter_DestWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct ZipWriter* zip = (struct ZipWriter*)stream->Meta.Inflate;
+	cc_result res = zip->Dest->Write(zip->Dest, data, count, modified);
+
+	zip->Position += *modified;
+	return res;
+}
+
+static cc_result ZipWriter_EntryWrite(struct Stream* stream, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct ZipWriter* zip  = (struct ZipWriter*)stream->Meta.Inflate;
+	struct ZipWriterEntry* e = &zip->Entries[zip->Count];
+	struct Stream* dst     = e->Method ? &zip->_compressed : &zip->_dest;
+	cc_result res = dst->Write(dst, data, count, modified);
+
+	e->Base.CRC32 = Utils_Crc32Update(e->Base.CRC32, data, *modified);
+	e->Base.UncompressedSize += *modified;
+	return res;
+}
+
+void ZipWriter_Init(struct ZipWriter* zip, struct Stream* dest) {
+	struct DateTime now;
+	DateTime_CurrentLocal(&now);
+
+	zip->Dest      = dest;
+	zip->Position  = 0;
+	zip->Count     = 0;
+	zip->Entries   = zip->_defaultEntries;
+	zip->_capacity = ZIPWRITER_DEF_ENTRIES;
+	zip->_deflater = NULL;
+	zip->_modTime  = (now.second / 2) | (now.minute << 5) | (now.hour << 11);
+	zip->_modDate  = (now.day) | (now.month << 5) | ((now.year - 1980) << 9);
+
+	Mem_Set(&zip->Paths, 0, sizeof(zip->Paths));
+	Stream_Init(&zip->_dest);
+	zip->_dest.Meta.Inflate = zip;
+	zip->_dest.Write        = ZipWriter_DestWrite;
+}
+
+cc_result ZipWriter_BeginEntry(struct ZipWriter* zip, const String* path, cc_bool compress, struct Stream* stream) {
+	cc_uint8 header[ZIP_LOCALHEADER_SIZE + STRINGSBUFFER_LEN_MASK];
+	struct ZipWriterEntry* e;
+
+	if (path->length > STRINGSBUFFER_LEN_MASK) return ZIP_ERR_FILENAME_LEN;
+	if (zip->Count >= 0xFFFF) return ZIP_ERR_TOO_MANY_ENTRIES;
+	if (zip->Count == zip->_capacity) {
+		Utils_Resize((void**)&zip->Entries, &zip->_capacity,
+			sizeof(struct ZipWriterEntry), ZIPWRITER_DEF_ENTRIES, 512);
+	}
+
+	if (compress && !zip->_deflater) {
+		zip->_deflater = (struct DeflateState*)Mem_TryAlloc(1, sizeof(struct DeflateState));
+		if (!zip->_deflater) return ERR_OUT_OF_MEMORY;
+	}
+	if (compress) Deflate_MakeStream(&zip->_compressed, zip->_deflater, &zip->_dest);
+
+	e = &zip->Entries[zip->Count];
+	e->Method = compress ? 8 : 0;
+	e->Base.CRC32             = 0xFFFFFFFFUL;
+	e->Base.UncompressedSize  = 0;
+	e->Base.LocalHeaderOffset = zip->Position;
+
+	Stream_Init(stream);
+	stream->Meta.Inflate = zip;
+	stream->Write        = ZipWriter_EntryWrite;
+
+	/* CRC32 and sizes are in the data descriptor instead */
+	Stream_SetU32_LE(&header[0],  ZIP_SIG_LOCALFILEHEADER);
+	Stream_SetU16_LE(&header[4],  20);                      /* version needed */
+	Stream_SetU16_LE(&header[6],  ZIP_FLAG_DATADESCRIPTOR); /* bitflags */
+	Stream_SetU16_LE(&header[8],  e->Method);               /* compression method */
+	Stream_SetU16_LE(&header[10], zip->_modTime);           /* last modified */
+	Stream_SetU16_LE(&header[12], zip->_modDate);           /* last modified */
+	Stream_SetU32_LE(&header[14], 0);                       /* CRC32 */
+	Stream_SetU32_LE(&header[18], 0);                       /* compressed size */
+	Stream_SetU32_LE(&header[22], 0);                       /* uncompressed size */
+	Stream_SetU16_LE(&header[26], path->length);            /* name length */
+	Stream_SetU16_LE(&header[28], 0);                       /* extra field length */
+
+	Mem_Copy(&header[ZIP_LOCALHEADER_SIZE], path->buffer, path->length);
+	StringsBuffer_Add(&zip->Paths, path);
+	return Stream_Write(&zip->_dest, header, ZIP_LOCALHEADER_SIZE + path->length);
+}
+
+cc_result ZipWriter_EndEntry(struct ZipWriter* zip) {
+	struct ZipWriterEntry* e = &zip->Entries[zip->Count];
+	String path = StringsBuffer_UNSAFE_Get(&zip->Paths, zip->Count);
+	cc_uint8 header[ZIP_DATADESCRIPTOR_SIZE];
+	cc_uint32 dataBeg;
+	cc_result res;
+
+	if (e->Method && (res = zip->_compressed.Close(&zip->_compressed))) return res;
+	dataBeg = e->Base.LocalHeaderOffset + ZIP_LOCALHEADER_SIZE + path.length;
+
+	e->Base.CRC32 ^= 0xFFFFFFFFUL;
+	e->Base.CompressedSize = zip->Position - dataBeg;
+	zip->Count++;
+
+	Stream_SetU32_LE(&header[0],  ZIP_SIG_DATADESCRIPTOR);
+	Stream_SetU32_LE(&header[4],  e->Base.CRC32);
+	Stream_SetU32_LE(&header[8],  e->Base.CompressedSize);
+	Stream_SetU32_LE(&header[12], e->Base.UncompressedSize);
+	return Stream_Write(&zip->_dest, header, ZIP_DATADESCRIPTOR_SIZE);
+}
+
+cc_result ZipWriter_WriteEntry(struct ZipWriter* zip, const String* path, cc_bool compress, const cc_uint8* data, cc_uint32 len) {
+	struct Stream stream;
+	cc_result res;
+
+	if ((res = ZipWriter_BeginEntry(zip, path, compress, &stream))) return res;
+	if ((res = Stream_Write(&stream, data, len)))                    return res;
+	return ZipWriter_EndEntry(zip);
+}
+
+static cc_result ZipWriter_CentralDir(struct ZipWriter* zip, int i) {
+	struct ZipWriterEntry* e = &zip->Entries[i];
+	String path = StringsBuffer_UNSAFE_Get(&zip->Paths, i);
+	cc_uint8 header[ZIP_CENTRALDIR_SIZE + STRINGSBUFFER_LEN_MASK];
+
+	Stream_SetU32_LE(&header[0],  ZIP_SIG_CENTRALDIR);
+	Stream_SetU16_LE(&header[4],  20);                       /* version */
+	Stream_SetU16_LE(&header[6],  20);                       /* version needed */
+	Stream_SetU16_LE(&header[8],  ZIP_FLAG_DATADESCRIPTOR);  /* bitflags */
+	Stream_SetU16_LE(&header[10], e->Method);                /* compression method */
+	Stream_SetU16_LE(&header[12], zip->_modTime);            /* last modified */
+	Stream_SetU16_LE(&header[14], zip->_modDate);            /* last modified */
+
+	Stream_SetU32_LE(&header[16], e->Base.CRC32);            /* CRC32 */
+	Stream_SetU32_LE(&header[20], e->Base.CompressedSize);   /* compressed size */
+	Stream_SetU32_LE(&header[24], e->Base.UncompressedSize); /* uncompressed size */
+
+	Stream_SetU16_LE(&header[28], path.length);              /* name length */
+	Stream_SetU16_LE(&header[30], 0);                        /* extra field length */
+	Stream_SetU16_LE(&header[32], 0);                        /* file comment length */
+	Stream_SetU16_LE(&header[34], 0);                        /* disk number */
+	Stream_SetU16_LE(&header[36], 0);                        /* internal attributes */
+	Stream_SetU32_LE(&header[38], 0);                        /* external attributes */
+	Stream_SetU32_LE(&header[42], e->Base.LocalHeaderOffset); /* local header offset */
+
+	Mem_Copy(&header[ZIP_CENTRALDIR_SIZE], path.buffer, path.length);
+	return Stream_Write(&zip->_dest, header, ZIP_CENTRALDIR_SIZE + path.length);
+}
+
+static cc_result ZipWriter_WriteTrailer(struct ZipWriter* zip) {
+	cc_uint8 header[22];
+	cc_uint32 centralDirBeg = zip->Position;
+	cc_result res;
+	int i;
+
+	for (i = 0; i < zip->Count; i++) {
+		if ((res = ZipWriter_CentralDir(zip, i))) return res;
+	}
+
+	Stream_SetU32_LE(&header[0],  ZIP_SIG_ENDOFCENTRALDIR);
+	Stream_SetU16_LE(&header[4],  0);                                /* disk number */
+	Stream_SetU16_LE(&header[6],  0);                                /* disk number of start */
+	Stream_SetU16_LE(&header[8],  zip->Count);                       /* disk entries */
+	Stream_SetU16_LE(&header[10], zip->Count);                       /* total entries */
+	Stream_SetU32_LE(&header[12], zip->Position - centralDirBeg);    /* central dir size */
+	Stream_SetU32_LE(&header[16], centralDirBeg);                    /* central dir start */
+	Stream_SetU16_LE(&header[20], 0);                                /* comment length */
+	return Stream_Write(&zip->_dest, header, 22);
+}
+
+cc_result ZipWriter_Finish(struct ZipWriter* zip) {
+	cc_result res = ZipWriter_WriteTrailer(zip);
+	ZipWriter_Free(zip);
+	return res;
+}
+
+void ZipWriter_Free(struct ZipWriter* zip) {
+	if (zip->Entries != zip->_defaultEntries) Mem_Free(zip->Entries);
+	StringsBuffer_Clear(&zip->Paths);
+	Mem_Free(zip->_deflater);
+
+	zip->Entries   = zip->_defaultEntries;
+	zip->_capacity = ZIPWRITER_DEF_ENTRIES;
+	zip->_deflater = NULL;
+}
+
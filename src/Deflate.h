@@ -1,6 +1,7 @@
 #ifndef CC_DEFLATE_H
 #define CC_DEFLATE_H
 #include "String.h"
+#include "Stream.h"
 /* Decodes data compressed using DEFLATE in a streaming manner.
    Partially based off information from
 	https://handmade.network/forums/wip/t/2363-implementing_a_basic_png_reader_the_handmade_way
@@ -9,7 +10,6 @@
 	https://github.com/nothings/stb/blob/master/stb_image.h
    Copyright 2014-2019 ClassiCube | Licensed under BSD-3
 */
-struct Stream;
 
 struct GZipHeader { cc_uint8 State; cc_bool Done; cc_uint8 PartsRead; cc_int32 Flags; };
 void GZipHeader_Init(struct GZipHeader* header);
@@ -41,7 +41,8 @@ struct HuffmanTable {
 struct InflateState {
 	cc_uint8 State;
 	cc_bool LastBlock; /* Whether the last DEFLATE block has been encounted in the stream */
-	cc_uint32 Bits;    /* Holds bits across byte boundaries */
+	cc_result Error;   /* Why decompression failed, if the DEFLATE data is corrupted */
+	cc_uint64 Bits;    /* Holds bits across byte boundaries */
 	cc_uint32 NumBits; /* Number of bits in Bits buffer */
 
 	cc_uint8* NextIn;   /* Pointer within Input buffer to next byte that can be read */
@@ -81,8 +82,11 @@ CC_API void Inflate_MakeStream(struct Stream* stream, struct InflateState* state
 #define DEFLATE_OUT_SIZE 8192
 #define DEFLATE_HASH_SIZE 0x1000UL
 #define DEFLATE_HASH_MASK 0x0FFFUL
+#define DEFLATE_MIN_LEVEL 1
+#define DEFLATE_DEF_LEVEL 5
+#define DEFLATE_MAX_LEVEL 9
 struct DeflateState {
-	cc_uint32 Bits;         /* Holds bits across byte boundaries */
+	cc_uint64 Bits;         /* Holds bits across byte boundaries */
 	cc_uint32 NumBits;      /* Number of bits in Bits buffer */
 	cc_uint32 InputPosition;
 
@@ -98,16 +102,47 @@ struct DeflateState {
 	int Head[DEFLATE_HASH_SIZE];
 	int Prev[DEFLATE_BUFFER_SIZE];
 	cc_bool WroteHeader;
+	int MaxDepth; /* Max number of previous positions checked when finding the longest match */
 };
 /* Compresses input data using DEFLATE, then writes compressed output to another stream. Write only stream. */
 /* DEFLATE compression is pure compressed data, there is no header or footer. */
 CC_API void Deflate_MakeStream(struct Stream* stream, struct DeflateState* state, struct Stream* underlying);
+/* Sets how thoroughly to search for matches, from DEFLATE_MIN_LEVEL (fastest) to DEFLATE_MAX_LEVEL (smallest output). */
+/* NOTE: Deflate_MakeStream defaults to DEFLATE_DEF_LEVEL. */
+CC_API void Deflate_SetLevel(struct DeflateState* state, int level);
 
 struct GZipState { struct DeflateState Base; cc_uint32 Crc32, Size; };
 /* Compresses input data using GZIP, then writes compressed output to another stream. Write only stream. */
 /* GZIP compression is GZIP header, followed by DEFLATE compressed data, followed by GZIP footer. */
 CC_API void GZip_MakeStream(struct Stream* stream, struct GZipState* state, struct Stream* underlying);
 
+#define GZIP_PARALLEL_CHUNK_SIZE (1024 * 1024)
+#define GZIP_PARALLEL_MAX_CHUNKS 16
+struct GZipParallelState {
+	cc_uint32 Crc32, Size; /* NOTE: Crc32 is the final CRC32 of all chunks compressed so far */
+	struct Stream* Dest;   /* Destination that compressed chunks are written to */
+	int NumChunks;         /* Number of chunks compressed in parallel per batch */
+	cc_uint32 InputLength; /* Number of bytes of input buffered for the current batch */
+	cc_bool HasDictionary; /* Whether Input starts with data from the previous batch */
+	int Level;             /* Compression level of each chunk (see Deflate_SetLevel) */
+	/* Buffered input, formed of DEFLATE_BLOCK_SIZE bytes of preset dictionary then NumChunks chunks */
+	cc_uint8* Input;
+	struct DeflateState* Deflaters;                  /* Compressor state for each chunk */
+	cc_uint8* Outputs[GZIP_PARALLEL_MAX_CHUNKS];     /* Compressed data for each chunk */
+	cc_uint32 OutputLens[GZIP_PARALLEL_MAX_CHUNKS];  /* Length of compressed data for each chunk */
+	cc_result Results[GZIP_PARALLEL_MAX_CHUNKS];     /* Result of compressing each chunk */
+	cc_uint32 Crc32s[GZIP_PARALLEL_MAX_CHUNKS];      /* CRC32 of the input data of each chunk */
+	int _batchChunks, _nextChunk;
+	void* _mutex;
+};
+/* Compresses input data using GZIP on multiple threads, then writes compressed output to another stream. Write only stream. */
+/* Input is split into GZIP_PARALLEL_CHUNK_SIZE chunks, which are each compressed on a separate thread. */
+/* The end of the previous chunk is used as a preset dictionary, so compression ratio is barely affected. */
+/* NOTE: Allocates memory which is only freed by closing the stream. (or GZip_AbortParallelStream) */
+CC_API void GZip_MakeParallelStream(struct Stream* stream, struct GZipParallelState* state, struct Stream* underlying);
+/* Frees memory allocated by GZip_MakeParallelStream, without writing any more compressed data. */
+CC_API void GZip_AbortParallelStream(struct GZipParallelState* state);
+
 struct ZLibState { struct DeflateState Base; cc_uint32 Adler32; };
 /* Compresses input data using ZLIB, then writes compressed output to another stream. Write only stream. */
 /* ZLIB compression is ZLIB header, followed by DEFLATE compressed data, followed by ZLIB footer. */
@@ -149,4 +184,85 @@ CC_API void Zip_Init(struct ZipState* state, struct Stream* input);
 /* Reads and processes the entries in a .zip archive. */
 /* NOTE: Must have been initialised with Zip_Init first. */
 CC_API cc_result Zip_Extract(struct ZipState* state);
+
+/* Index of the entries in a .zip archive, allowing entries to be read in any order. */
+struct ZipIndex {
+	/* Source of the .zip archive data. Must be seekable. */
+	struct Stream* Input;
+	/* Number of entries in the archive. */
+	int Count;
+	/* Data for each entry in the archive. */
+	struct ZipEntry* Entries;
+	/* Path of each entry in the archive. (points into central directory data) */
+	String* Paths;
+
+	/* (internal) Raw data of the central directory. */
+	cc_uint8* _centralDir;
+	/* (internal) Hash table of entry index + 1 (0 for empty slot), keyed by filename. */
+	int* _buckets;
+	/* (internal) Number of slots in hash table - 1. */
+	int _bucketsMask;
+};
+
+/* Stores state for reading the data of an entry in a .zip archive. */
+struct ZipEntryState { struct Stream Portion; struct InflateState Inflate; };
+
+/* Reads the central directory of a .zip archive, then builds an index of its entries. */
+/* NOTE: Only the central directory is read, the data of entries is not read at all. */
+CC_API cc_result ZipIndex_Load(struct ZipIndex* index, struct Stream* input);
+/* Frees the memory allocated by ZipIndex_Load. */
+CC_API void ZipIndex_Free(struct ZipIndex* index);
+/* Returns index of the entry whose filename caselessly equals the given name, or -1 if not found. */
+/* NOTE: Directories are ignored (e.g. "terrain.png" matches "pack/terrain.png") */
+/* NOTE: If multiple entries have the same filename, the last one in the archive is returned. */
+CC_API int ZipIndex_Find(struct ZipIndex* index, const String* name);
+/* Opens the data of the given entry as a read only stream. (decompressing it if needed) */
+/* NOTE: All entries share the same Input, so only one entry can be read at a time. */
+CC_API cc_result ZipIndex_Open(struct ZipIndex* index, int i, struct Stream* stream, struct ZipEntryState* state);
+
+/* Data needed to describe an entry written to a .zip archive. */
+struct ZipWriterEntry { struct ZipEntry Base; cc_uint16 Method; };
+#define ZIPWRITER_DEF_ENTRIES 32
+
+/* Stores state for writing entries to a .zip archive in a streaming manner. */
+/* Entries are followed by a data descriptor, so the CRC32 and sizes don't need to be known in advance. */
+struct ZipWriter {
+	/* Destination of the .zip archive data. Does not need to be seekable. */
+	struct Stream* Dest;
+	/* Number of bytes written to Dest so far. */
+	cc_uint32 Position;
+	/* Number of entries fully written so far. */
+	int Count;
+	/* Data for each entry written so far. */
+	struct ZipWriterEntry* Entries;
+	/* Path of each entry written so far. */
+	StringsBuffer Paths;
+
+	/* (internal) DEFLATE compressor state, only allocated when first needed. */
+	struct DeflateState* _deflater;
+	/* (internal) Wraps Dest, counting the number of bytes written. */
+	struct Stream _dest;
+	/* (internal) Compresses data of the current entry, then writes it to _dest. */
+	struct Stream _compressed;
+	/* (internal) Last modified time and date of all entries, in MS-DOS format. */
+	cc_uint16 _modTime, _modDate;
+	int _capacity;
+	struct ZipWriterEntry _defaultEntries[ZIPWRITER_DEF_ENTRIES];
+};
+
+/* Initialises .zip archive writer state to defaults. */
+CC_API void ZipWriter_Init(struct ZipWriter* zip, struct Stream* dest);
+/* Writes the header of a new entry, then sets stream to a write only stream for the data of the entry. */
+/* If compress is true, the data is compressed using DEFLATE. Otherwise the data is stored as is. */
+/* NOTE: ZipWriter_EndEntry must be called after all data has been written to stream. */
+CC_API cc_result ZipWriter_BeginEntry(struct ZipWriter* zip, const String* path, cc_bool compress, struct Stream* stream);
+/* Finishes writing the data of the current entry, then writes its data descriptor. */
+CC_API cc_result ZipWriter_EndEntry(struct ZipWriter* zip);
+/* Writes an entry whose data is entirely contained in the given block of memory. */
+CC_API cc_result ZipWriter_WriteEntry(struct ZipWriter* zip, const String* path, cc_bool compress, const cc_uint8* data, cc_uint32 len);
+/* Writes the central directory and end of central directory record, then calls ZipWriter_Free. */
+/* NOTE: This does NOT close Dest. */
+CC_API cc_result ZipWriter_Finish(struct ZipWriter* zip);
+/* Frees memory allocated by the .zip archive writer. (only needed if ZipWriter_Finish isn't reached) */
+CC_API void ZipWriter_Free(struct ZipWriter* zip);
 #endif
@@ -19,6 +19,8 @@
 #include "Stream.h"
 #include "Bitmap.h"
 #include "Logger.h"
+#include "Errors.h"
+#include "Utils.h"
 
 const char* const NameMode_Names[NAME_MODE_COUNT]   = { "None", "Hovered", "All", "AllHovered", "AllUnscaled" };
 const char* const ShadowMode_Names[SHADOW_MODE_COUNT] = { "None", "SnapToBlock", "Circle", "CircleAll" };
@@ -155,6 +157,7 @@ void Entity_SetModel(struct Entity* e, const String* model) {
 	if (Utils_IsUrlPrefix(&skin)) e->MobTextureId = e->TextureId;
 }
 
+static void EntitiesGrid_MarkEntity(struct Entity* e);
 void Entity_UpdateModelBounds(struct Entity* e) {
 	struct Model* model = e->Model;
 	model->GetCollisionSize(e);
@@ -163,6 +166,7 @@ void Entity_UpdateModelBounds(struct Entity* e) {
 	Vec3_Mul3By(&e->Size,          &e->ModelScale);
 	Vec3_Mul3By(&e->ModelAABB.Min, &e->ModelScale);
 	Vec3_Mul3By(&e->ModelAABB.Max, &e->ModelScale);
+	EntitiesGrid_MarkEntity(e);
 }
 
 cc_bool Entity_TouchesAny(struct AABB* bounds, Entity_TouchesCondition condition) {
@@ -511,6 +515,324 @@ void Entity_SetSkin(struct Entity* e, const String* skin) {
 }
 
 
+/*########################################################################################################################*
+*------------------------------------------------------Entities grid------------------------------------------------------*
+*#########################################################################################################################*/
+/* Entities are grouped by the chunk their position is in, so that queries */
+/*  only need to check entities in chunks whose bounds overlap the query area */
+/* Rather than rebuilding the grid, only entities marked as added, removed, moved, */
+/*  or having changed model since the last query are moved between cells */
+#define GRID_CELL_SHIFT 4
+#define GRID_BUCKETS 256
+#define GRID_NONE -1
+/* Query bounds beyond this are too far out to be converted to cell coordinates */
+#define GRID_MAX_COORD 1000000000.0f
+
+struct EntitiesCell {
+	int x, y, z;
+	struct AABB bounds;  /* Union of the bounds of all entities in this cell */
+	cc_bool boundsStale; /* Whether bounds must be recalculated, as an entity moved or left */
+	cc_int16 head, next; /* First entity in this cell, next cell in same hash bucket */
+	cc_int16 active;     /* Index of this cell in grid.active */
+};
+
+static struct EntitiesGrid {
+	struct EntitiesCell cells[ENTITIES_MAX_COUNT];
+	cc_int16 active[ENTITIES_MAX_COUNT]; /* Cells which have at least one entity */
+	cc_int16 free[ENTITIES_MAX_COUNT];   /* Cells which are unused */
+	int activeCount, freeCount;
+	cc_int16 buckets[GRID_BUCKETS];
+	cc_int16 next[ENTITIES_MAX_COUNT];   /* Next entity in same cell */
+	cc_int16 cellOf[ENTITIES_MAX_COUNT]; /* Cell each entity is in, or GRID_NONE */
+	/* Position and extent of each entity when it was last placed in a cell */
+	Vec3 pos[ENTITIES_MAX_COUNT];
+	float extent[ENTITIES_MAX_COUNT];
+	float maxExtent; /* Largest extent of any entity placed so far */
+	/* Entities which may have been added, removed, moved, or changed model */
+	cc_bool dirty[ENTITIES_MAX_COUNT];
+	EntityID dirtyIds[ENTITIES_MAX_COUNT];
+	int dirtyCount;
+	cc_bool rescan; /* Whether every entity needs to be checked, as the changed entity is unknown */
+} grid;
+
+static void EntitiesGrid_Reset(void) {
+	int i;
+	for (i = 0; i < GRID_BUCKETS; i++) { grid.buckets[i] = GRID_NONE; }
+
+	for (i = 0; i < ENTITIES_MAX_COUNT; i++) {
+		grid.free[i]   = (cc_int16)(ENTITIES_MAX_COUNT - 1 - i);
+		grid.cellOf[i] = GRID_NONE;
+		grid.dirty[i]  = false;
+	}
+	grid.activeCount = 0;
+	grid.freeCount   = ENTITIES_MAX_COUNT;
+	grid.dirtyCount  = 0;
+	grid.maxExtent   = 0.0f;
+	grid.rescan      = true;
+}
+
+void Entities_MarkChanged(EntityID id) {
+	if (grid.dirty[id]) return;
+	grid.dirty[id] = true;
+	grid.dirtyIds[grid.dirtyCount++] = id;
+}
+
+/* Marks the given entity as changed, when its ID is not known */
+static void EntitiesGrid_MarkEntity(struct Entity* e) {
+	struct NetPlayer* p = (struct NetPlayer*)e;
+
+	if (e == &LocalPlayer_Instance.Base) {
+		Entities_MarkChanged(ENTITIES_SELF_ID);
+	} else if (p >= NetPlayers_List && p < NetPlayers_List + ENTITIES_SELF_ID) {
+		Entities_MarkChanged((EntityID)(p - NetPlayers_List));
+	} else {
+		grid.rescan = true;
+	}
+}
+
+/* Returns how far from its position an entity's model bounds may extend along any axis */
+static float EntitiesGrid_Extent(struct Entity* e) {
+	struct AABB* bb = &e->ModelAABB;
+	float extent;
+
+	extent = max(Math_AbsF(bb->Min.X), Math_AbsF(bb->Max.X));
+	extent = max(extent, max(Math_AbsF(bb->Min.Y), Math_AbsF(bb->Max.Y)));
+	extent = max(extent, max(Math_AbsF(bb->Min.Z), Math_AbsF(bb->Max.Z)));
+	/* Rotated picking bounds (see Intersection_RayIntersectsRotatedBox) and the */
+	/*  area measured by Model_RenderDistance both stay within twice this extent */
+	return extent * 2.0f;
+}
+
+static int EntitiesGrid_Hash(int x, int y, int z) {
+	cc_uint32 hash = (cc_uint32)x * 73856093u ^ (cc_uint32)y * 19349663u ^ (cc_uint32)z * 83492791u;
+	return hash & (GRID_BUCKETS - 1);
+}
+
+static int EntitiesGrid_FindCell(int x, int y, int z) {
+	struct EntitiesCell* cell;
+	int i;
+
+	for (i = grid.buckets[EntitiesGrid_Hash(x, y, z)]; i != GRID_NONE; i = grid.cells[i].next) {
+		cell = &grid.cells[i];
+		if (cell->x == x && cell->y == y && cell->z == z) return i;
+	}
+	return GRID_NONE;
+}
+
+static void EntitiesGrid_EntityBounds(int id, struct AABB* bb) {
+	Vec3 pos = grid.pos[id];
+	float extent = grid.extent[id];
+
+	bb->Min.X = pos.X - extent; bb->Min.Y = pos.Y - extent; bb->Min.Z = pos.Z - extent;
+	bb->Max.X = pos.X + extent; bb->Max.Y = pos.Y + extent; bb->Max.Z = pos.Z + extent;
+}
+
+static void EntitiesGrid_GrowBounds(struct AABB* bounds, const struct AABB* bb) {
+	bounds->Min.X = min(bounds->Min.X, bb->Min.X); bounds->Max.X = max(bounds->Max.X, bb->Max.X);
+	bounds->Min.Y = min(bounds->Min.Y, bb->Min.Y); bounds->Max.Y = max(bounds->Max.Y, bb->Max.Y);
+	bounds->Min.Z = min(bounds->Min.Z, bb->Min.Z); bounds->Max.Z = max(bounds->Max.Z, bb->Max.Z);
+}
+
+/* Returns the bounds of the given cell, recalculating them if an entity moved or left */
+static const struct AABB* EntitiesGrid_CellBounds(struct EntitiesCell* cell) {
+	struct AABB bb;
+	int j;
+	if (!cell->boundsStale) return &cell->bounds;
+
+	cell->boundsStale = false;
+	EntitiesGrid_EntityBounds(cell->head, &cell->bounds);
+	for (j = grid.next[cell->head]; j != GRID_NONE; j = grid.next[j]) {
+		EntitiesGrid_EntityBounds(j, &bb);
+		EntitiesGrid_GrowBounds(&cell->bounds, &bb);
+	}
+	return &cell->bounds;
+}
+
+static void EntitiesGrid_Remove(int id) {
+	struct EntitiesCell* cell;
+	cc_int16* link;
+	int i = grid.cellOf[id], hash;
+	if (i == GRID_NONE) return;
+
+	cell = &grid.cells[i];
+	for (link = &cell->head; *link != id; link = &grid.next[*link]) { }
+	*link = grid.next[id];
+	grid.cellOf[id] = GRID_NONE;
+
+	if (cell->head != GRID_NONE) { cell->boundsStale = true; return; }
+	/* Cell is now empty, so remove it from its hash bucket and the active cells */
+	hash = EntitiesGrid_Hash(cell->x, cell->y, cell->z);
+	for (link = &grid.buckets[hash]; *link != i; link = &grid.cells[*link].next) { }
+	*link = cell->next;
+
+	grid.active[cell->active] = grid.active[--grid.activeCount];
+	grid.cells[grid.active[cell->active]].active = cell->active;
+	grid.free[grid.freeCount++] = i;
+}
+
+static void EntitiesGrid_Insert(int id, int x, int y, int z) {
+	struct EntitiesCell* cell;
+	struct AABB bb;
+	int i = EntitiesGrid_FindCell(x, y, z), hash;
+	EntitiesGrid_EntityBounds(id, &bb);
+
+	if (i == GRID_NONE) {
+		i    = grid.free[--grid.freeCount];
+		hash = EntitiesGrid_Hash(x, y, z);
+		cell = &grid.cells[i];
+
+		cell->x = x; cell->y = y; cell->z = z;
+		cell->bounds = bb;
+		cell->boundsStale = false;
+		cell->head   = GRID_NONE;
+		cell->next   = grid.buckets[hash];
+		cell->active = grid.activeCount;
+		grid.buckets[hash] = i;
+		grid.active[grid.activeCount++] = i;
+	} else {
+		cell = &grid.cells[i];
+		if (!cell->boundsStale) EntitiesGrid_GrowBounds(&cell->bounds, &bb);
+	}
+
+	grid.next[id]   = cell->head;
+	grid.cellOf[id] = i;
+	cell->head      = id;
+}
+
+/* Moves the given entity to the cell its position is now in, or removes it if it no longer exists */
+static void EntitiesGrid_Place(int id) {
+	struct Entity* e = Entities.List[id];
+	struct EntitiesCell* cell;
+	float extent;
+	int x, y, z;
+
+	if (!e) { EntitiesGrid_Remove(id); return; }
+	extent = EntitiesGrid_Extent(e);
+	if (grid.cellOf[id] != GRID_NONE && extent == grid.extent[id] && Vec3_Equals(&e->Position, &grid.pos[id])) return;
+
+	grid.pos[id]    = e->Position;
+	grid.extent[id] = extent;
+	grid.maxExtent  = max(grid.maxExtent, extent);
+
+	x = Math_Floor(e->Position.X) >> GRID_CELL_SHIFT;
+	y = Math_Floor(e->Position.Y) >> GRID_CELL_SHIFT;
+	z = Math_Floor(e->Position.Z) >> GRID_CELL_SHIFT;
+
+	/* Still in the same cell, so just its bounds need updating */
+	if (grid.cellOf[id] != GRID_NONE) {
+		cell = &grid.cells[grid.cellOf[id]];
+		if (cell->x == x && cell->y == y && cell->z == z) { cell->boundsStale = true; return; }
+		EntitiesGrid_Remove(id);
+	}
+	EntitiesGrid_Insert(id, x, y, z);
+}
+
+/* Updates the cells of all entities which were marked as changed since the last query */
+static void EntitiesGrid_Update(void) {
+	int i;
+	if (grid.rescan) {
+		grid.rescan = false;
+		for (i = 0; i < ENTITIES_MAX_COUNT; i++) { EntitiesGrid_Place(i); }
+	}
+
+	for (i = 0; i < grid.dirtyCount; i++) {
+		grid.dirty[grid.dirtyIds[i]] = false;
+		EntitiesGrid_Place(grid.dirtyIds[i]);
+	}
+	grid.dirtyCount = 0;
+}
+
+/* Whether a ray could hit something within the given bounds before the given distance */
+/* NOTE: Unlike Intersection_RayIntersectsBox, this is also true when origin is inside the bounds */
+static cc_bool EntitiesGrid_RayHits(Vec3 origin, Vec3 dir, const struct AABB* bb, float maxDist) {
+	float tMin = -MATH_POS_INF, tMax = MATH_POS_INF;
+	float invDir, t0, t1, tmp;
+
+	invDir = 1.0f / dir.X;
+	t0 = (bb->Min.X - origin.X) * invDir; t1 = (bb->Max.X - origin.X) * invDir;
+	if (invDir < 0) { tmp = t0; t0 = t1; t1 = tmp; }
+	if (t0 > tMin) tMin = t0;
+	if (t1 < tMax) tMax = t1;
+
+	invDir = 1.0f / dir.Y;
+	t0 = (bb->Min.Y - origin.Y) * invDir; t1 = (bb->Max.Y - origin.Y) * invDir;
+	if (invDir < 0) { tmp = t0; t0 = t1; t1 = tmp; }
+	if (t0 > tMin) tMin = t0;
+	if (t1 < tMax) tMax = t1;
+
+	invDir = 1.0f / dir.Z;
+	t0 = (bb->Min.Z - origin.Z) * invDir; t1 = (bb->Max.Z - origin.Z) * invDir;
+	if (invDir < 0) { tmp = t0; t0 = t1; t1 = tmp; }
+	if (t0 > tMin) tMin = t0;
+	if (t1 < tMax) tMax = t1;
+
+	return tMin <= tMax && tMax >= 0.0f && tMin <= maxDist;
+}
+
+/* Marks all the entities in the given cell as found, if the cell's bounds intersect the given bounds */
+static void EntitiesGrid_QueryCell(struct EntitiesCell* cell, const struct AABB* bb, cc_uint32* found) {
+	int j;
+	if (!AABB_Intersects(EntitiesGrid_CellBounds(cell), bb)) return;
+
+	for (j = cell->head; j != GRID_NONE; j = grid.next[j]) {
+		found[j >> 5] |= 1u << (j & 0x1F);
+	}
+}
+
+/* Whether the given bounds can be converted to cell coordinates without overflowing */
+/* NOTE: Infinite and NaN bounds (e.g. entity pushing queries all Y) are never in range */
+static cc_bool EntitiesGrid_InRange(const struct AABB* bb) {
+	float limit = GRID_MAX_COORD;
+	return bb->Min.X >= -limit && bb->Min.X <= limit && bb->Max.X >= -limit && bb->Max.X <= limit
+		&& bb->Min.Y >= -limit && bb->Min.Y <= limit && bb->Max.Y >= -limit && bb->Max.Y <= limit
+		&& bb->Min.Z >= -limit && bb->Min.Z <= limit && bb->Max.Z >= -limit && bb->Max.Z <= limit;
+}
+
+int Entities_Query(const struct AABB* bb, EntityID* ids) {
+	cc_uint32 found[ENTITIES_MAX_COUNT / 32] = { 0 };
+	IVec3 min, max;
+	float cells = MATH_POS_INF;
+	cc_uint32 bits;
+	int i, j, x, y, z, count = 0;
+
+	EntitiesGrid_Update();
+	/* Entities are stored in the cell their position is in, but may extend into nearby cells */
+	if (EntitiesGrid_InRange(bb)) {
+		min.X = Math_Floor(bb->Min.X - grid.maxExtent) >> GRID_CELL_SHIFT;
+		min.Y = Math_Floor(bb->Min.Y - grid.maxExtent) >> GRID_CELL_SHIFT;
+		min.Z = Math_Floor(bb->Min.Z - grid.maxExtent) >> GRID_CELL_SHIFT;
+		max.X = Math_Floor(bb->Max.X + grid.maxExtent) >> GRID_CELL_SHIFT;
+		max.Y = Math_Floor(bb->Max.Y + grid.maxExtent) >> GRID_CELL_SHIFT;
+		max.Z = Math_Floor(bb->Max.Z + grid.maxExtent) >> GRID_CELL_SHIFT;
+		cells = (float)(max.X - min.X + 1) * (float)(max.Y - min.Y + 1) * (float)(max.Z - min.Z + 1);
+	}
+
+	if (cells <= grid.activeCount) {
+		for (y = min.Y; y <= max.Y; y++) {
+			for (z = min.Z; z <= max.Z; z++) {
+				for (x = min.X; x <= max.X; x++) {
+					i = EntitiesGrid_FindCell(x, y, z);
+					if (i != GRID_NONE) EntitiesGrid_QueryCell(&grid.cells[i], bb, found);
+				}
+			}
+		}
+	} else {
+		/* Query area covers more cells than are in use, so just check every used cell */
+		for (i = 0; i < grid.activeCount; i++) {
+			EntitiesGrid_QueryCell(&grid.cells[grid.active[i]], bb, found);
+		}
+	}
+
+	/* Return entities in order of ID, same as looping over Entities.List */
+	for (i = 0; i < Array_Elems(found); i++) {
+		for (bits = found[i], j = 0; bits; bits >>= 1, j++) {
+			if (bits & 1) ids[count++] = (EntityID)((i << 5) + j);
+		}
+	}
+	return count;
+}
+
+
 /*########################################################################################################################*
 *--------------------------------------------------------Entities---------------------------------------------------------*
 *#########################################################################################################################*/
@@ -522,11 +844,13 @@ void Entities_Tick(struct ScheduledTask* task) {
 	for (i = 0; i < ENTITIES_MAX_COUNT; i++) {
 		if (!Entities.List[i]) continue;
 		Entities.List[i]->VTABLE->Tick(Entities.List[i], task->Interval);
+		Entities_MarkChanged((EntityID)i);
 	}
 }
 
 void Entities_RenderModels(double delta, float t) {
 	int i;
+	NetPlayers_Interpolate(t);
 	Gfx_SetTexturing(true);
 	Gfx_SetAlphaTest(true);
 	
@@ -539,10 +863,27 @@ void Entities_RenderModels(double delta, float t) {
 }
 	
 
+/* Finds entities whose names may be close enough to the camera to be drawn (see NetPlayer_RenderName) */
+static int Entities_QueryNames(EntityID* ids) {
+	float range = Entities.NamesMode == NAME_MODE_ALL_UNSCALED ? 8192.0f : 32.0f;
+	Vec3 pos    = Camera.CurrentPos;
+	struct AABB bb;
+	int count;
+
+	bb.Min.X = pos.X - range; bb.Min.Y = pos.Y - range; bb.Min.Z = pos.Z - range;
+	bb.Max.X = pos.X + range; bb.Max.Y = pos.Y + range; bb.Max.Z = pos.Z + range;
+	count = Entities_Query(&bb, ids);
+
+	/* Local player's name is drawn regardless of distance */
+	if (!count || ids[count - 1] != ENTITIES_SELF_ID) ids[count++] = ENTITIES_SELF_ID;
+	return count;
+}
+
 void Entities_RenderNames(void) {
 	struct LocalPlayer* p = &LocalPlayer_Instance;
+	EntityID ids[ENTITIES_MAX_COUNT];
 	cc_bool hadFog;
-	int i;
+	int i, count;
 
 	if (Entities.NamesMode == NAME_MODE_NONE) return;
 	entities_closestId = Entities_GetClosest(&p->Base);
@@ -552,11 +893,12 @@ void Entities_RenderNames(void) {
 	Gfx_SetAlphaTest(true);
 	hadFog = Gfx_GetFog();
 	if (hadFog) Gfx_SetFog(false);
+	count = Entities_QueryNames(ids);
 
-	for (i = 0; i < ENTITIES_MAX_COUNT; i++) {
-		if (!Entities.List[i]) continue;
-		if (i != entities_closestId || i == ENTITIES_SELF_ID) {
-			Entities.List[i]->VTABLE->RenderName(Entities.List[i]);
+	for (i = 0; i < count; i++) {
+		if (!Entities.List[ids[i]]) continue;
+		if (ids[i] != entities_closestId || ids[i] == ENTITIES_SELF_ID) {
+			Entities.List[ids[i]]->VTABLE->RenderName(Entities.List[ids[i]]);
 		}
 	}
 
@@ -567,8 +909,9 @@ void Entities_RenderNames(void) {
 
 void Entities_RenderHoveredNames(void) {
 	struct LocalPlayer* p = &LocalPlayer_Instance;
+	EntityID ids[ENTITIES_MAX_COUNT];
 	cc_bool allNames, hadFog;
-	int i;
+	int i, count;
 
 	if (Entities.NamesMode == NAME_MODE_NONE) return;
 	allNames = !(Entities.NamesMode == NAME_MODE_HOVERED || Entities.NamesMode == NAME_MODE_ALL) 
@@ -580,10 +923,16 @@ void Entities_RenderHoveredNames(void) {
 	hadFog = Gfx_GetFog();
 	if (hadFog) Gfx_SetFog(false);
 
-	for (i = 0; i < ENTITIES_MAX_COUNT; i++) {
-		if (!Entities.List[i]) continue;
-		if ((i == entities_closestId || allNames) && i != ENTITIES_SELF_ID) {
-			Entities.List[i]->VTABLE->RenderName(Entities.List[i]);
+	if (allNames) {
+		count = Entities_QueryNames(ids);
+	} else {
+		ids[0] = entities_closestId; count = 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!Entities.List[ids[i]]) continue;
+		if (ids[i] != ENTITIES_SELF_ID) {
+			Entities.List[ids[i]]->VTABLE->RenderName(Entities.List[ids[i]]);
 		}
 	}
 
@@ -625,6 +974,7 @@ void Entities_Remove(EntityID id) {
 	Event_RaiseInt(&EntityEvents.Removed, id);
 	Entities.List[id]->VTABLE->Despawn(Entities.List[id]);
 	Entities.List[id] = NULL;
+	Entities_MarkChanged(id);
 }
 
 EntityID Entities_GetClosest(struct Entity* src) {
@@ -633,16 +983,26 @@ EntityID Entities_GetClosest(struct Entity* src) {
 	float closestDist = MATH_POS_INF;
 	EntityID targetId = ENTITIES_SELF_ID;
 
+	struct EntitiesCell* cell;
 	float t0, t1;
-	int i;
-
-	for (i = 0; i < ENTITIES_SELF_ID; i++) { /* because we don't want to pick against local player */
-		struct Entity* entity = Entities.List[i];
-		if (!entity) continue;
-
-		if (Intersection_RayIntersectsRotatedBox(eyePos, dir, entity, &t0, &t1) && t0 < closestDist) {
-			closestDist = t0;
-			targetId = (EntityID)i;
+	int i, j;
+
+	/* Can't easily limit which cells a ray passes through, so check the bounds of every used cell */
+	EntitiesGrid_Update();
+	for (i = 0; i < grid.activeCount; i++) {
+		cell = &grid.cells[grid.active[i]];
+		if (!EntitiesGrid_RayHits(eyePos, dir, EntitiesGrid_CellBounds(cell), closestDist)) continue;
+
+		for (j = cell->head; j != GRID_NONE; j = grid.next[j]) {
+			struct Entity* entity = Entities.List[j];
+			if (j == ENTITIES_SELF_ID) continue; /* because we don't want to pick against local player */
+			if (!Intersection_RayIntersectsRotatedBox(eyePos, dir, entity, &t0, &t1)) continue;
+
+			/* Prefer lowest ID when equally close, same as checking in order of ID */
+			if (t0 < closestDist || (t0 == closestDist && j < targetId)) {
+				closestDist = t0;
+				targetId = (EntityID)j;
+			}
 		}
 	}
 	return targetId;
@@ -769,33 +1129,63 @@ void LocalPlayer_SetInterpPosition(float t) {
 		Vec3_Lerp(&p->Base.Position, &p->Interp.Prev.Pos, &p->Interp.Next.Pos, t);
 	}
 	InterpComp_LerpAngles((struct InterpComp*)(&p->Interp), &p->Base, t);
-}
+	Entities_MarkChanged(ENTITIES_SELF_ID);
+}
+
+/* Inputs that affect how the local player moves in a tick */
+enum INPUT_FLAGS {
+	INPUT_FORWARD = 0x001, INPUT_BACK = 0x002, INPUT_LEFT = 0x004, INPUT_RIGHT = 0x008,
+	INPUT_JUMP = 0x010, INPUT_SPEED = 0x020, INPUT_HALF_SPEED = 0x040,
+	INPUT_FLY_UP = 0x080, INPUT_FLY_DOWN = 0x100, INPUT_NOCLIP = 0x200, INPUT_GRABBED = 0x400,
+	/* State toggled outside of ticks (e.g. by pressing fly key) */
+	INPUT_FLYING = 0x800, INPUT_NOCLIPPING = 0x1000,
+	/* Position or velocity changed outside of ticks (e.g. teleported, double jumped) */
+	INPUT_SET_POSITION = 0x2000, INPUT_SET_VELOCITY = 0x4000
+};
 
-static void LocalPlayer_HandleInput(float* xMoving, float* zMoving) {
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+static int LocalPlayer_ReadInput(struct LocalPlayer* p) {
+	int input = 0;
+	if (p->Hacks.Flying) input |= INPUT_FLYING;
+	if (p->Hacks.Noclip) input |= INPUT_NOCLIPPING;
+	if (Gui_GetInputGrab()) return input | INPUT_GRABBED;
+
+	if (KeyBind_IsPressed(KEYBIND_FORWARD))    input |= INPUT_FORWARD;
+	if (KeyBind_IsPressed(KEYBIND_BACK))       input |= INPUT_BACK;
+	if (KeyBind_IsPressed(KEYBIND_LEFT))       input |= INPUT_LEFT;
+	if (KeyBind_IsPressed(KEYBIND_RIGHT))      input |= INPUT_RIGHT;
+	if (KeyBind_IsPressed(KEYBIND_JUMP))       input |= INPUT_JUMP;
+	if (KeyBind_IsPressed(KEYBIND_SPEED))      input |= INPUT_SPEED;
+	if (KeyBind_IsPressed(KEYBIND_HALF_SPEED)) input |= INPUT_HALF_SPEED;
+	if (KeyBind_IsPressed(KEYBIND_FLY_UP))     input |= INPUT_FLY_UP;
+	if (KeyBind_IsPressed(KEYBIND_FLY_DOWN))   input |= INPUT_FLY_DOWN;
+	if (KeyBind_IsPressed(KEYBIND_NOCLIP))     input |= INPUT_NOCLIP;
+	return input;
+}
+
+static void LocalPlayer_HandleInput(struct LocalPlayer* p, int input, float* xMoving, float* zMoving) {
 	struct HacksComp* hacks = &p->Hacks;
 
-	if (Gui_GetInputGrab()) {
+	if (input & INPUT_GRABBED) {
 		p->Physics.Jumping = false; hacks->Speeding = false;
 		hacks->FlyingUp    = false; hacks->FlyingDown = false;
 	} else {
-		if (KeyBind_IsPressed(KEYBIND_FORWARD)) *zMoving -= 0.98f;
-		if (KeyBind_IsPressed(KEYBIND_BACK))    *zMoving += 0.98f;
-		if (KeyBind_IsPressed(KEYBIND_LEFT))    *xMoving -= 0.98f;
-		if (KeyBind_IsPressed(KEYBIND_RIGHT))   *xMoving += 0.98f;
+		if (input & INPUT_FORWARD) *zMoving -= 0.98f;
+		if (input & INPUT_BACK)    *zMoving += 0.98f;
+		if (input & INPUT_LEFT)    *xMoving -= 0.98f;
+		if (input & INPUT_RIGHT)   *xMoving += 0.98f;
 
-		p->Physics.Jumping  = KeyBind_IsPressed(KEYBIND_JUMP);
-		hacks->Speeding     = hacks->Enabled && KeyBind_IsPressed(KEYBIND_SPEED);
-		hacks->HalfSpeeding = hacks->Enabled && KeyBind_IsPressed(KEYBIND_HALF_SPEED);
-		hacks->FlyingUp     = KeyBind_IsPressed(KEYBIND_FLY_UP);
-		hacks->FlyingDown   = KeyBind_IsPressed(KEYBIND_FLY_DOWN);
+		p->Physics.Jumping  = (input & INPUT_JUMP) != 0;
+		hacks->Speeding     = hacks->Enabled && (input & INPUT_SPEED);
+		hacks->HalfSpeeding = hacks->Enabled && (input & INPUT_HALF_SPEED);
+		hacks->FlyingUp     = (input & INPUT_FLY_UP)   != 0;
+		hacks->FlyingDown   = (input & INPUT_FLY_DOWN) != 0;
 
 		if (hacks->WOMStyleHacks && hacks->Enabled && hacks->CanNoclip) {
 			if (hacks->Noclip) {
 				/* need the { } because it's a macro */
 				Vec3_Set(p->Base.Velocity, 0,0,0);
 			}
-			hacks->Noclip = KeyBind_IsPressed(KEYBIND_NOCLIP);
+			hacks->Noclip = (input & INPUT_NOCLIP) != 0;
 		}
 	}
 }
@@ -803,22 +1193,21 @@ static void LocalPlayer_HandleInput(float* xMoving, float* zMoving) {
 static void LocalPlayer_SetLocation(struct Entity* e, struct LocationUpdate* update, cc_bool interpolate) {
 	struct LocalPlayer* p = (struct LocalPlayer*)e;
 	LocalInterpComp_SetLocation(&p->Interp, update, interpolate);
+	Entities_MarkChanged(ENTITIES_SELF_ID);
 }
 
-static void LocalPlayer_Tick(struct Entity* e, double delta) {
-	struct LocalPlayer* p = (struct LocalPlayer*)e;
+/* Moves the local player for one tick, based on the given inputs */
+static void LocalPlayer_PhysicsTick(struct LocalPlayer* p, int input) {
+	struct Entity* e = &p->Base;
 	struct HacksComp* hacks = &p->Hacks;
 	float xMoving = 0, zMoving = 0;
-	cc_bool wasOnGround;
 	Vec3 headingVelocity;
 
-	if (!World.Blocks) return;
 	e->StepSize = hacks->FullBlockStep && hacks->Enabled && hacks->CanSpeed ? 1.0f : 0.5f;
 	p->OldVelocity = e->Velocity;
-	wasOnGround    = e->OnGround;
 
 	LocalInterpComp_AdvanceState(&p->Interp);
-	LocalPlayer_HandleInput(&xMoving, &zMoving);
+	LocalPlayer_HandleInput(p, input, &xMoving, &zMoving);
 	hacks->Floating = hacks->Noclip || hacks->Flying;
 	if (!hacks->Floating && hacks->CanBePushed) PhysicsComp_DoEntityPush(e);
 
@@ -833,8 +1222,26 @@ static void LocalPlayer_Tick(struct Entity* e, double delta) {
 
 	/* Fixes high jump, when holding down a movement key, jump, fly, then let go of fly key */
 	if (p->Hacks.Floating) e->Velocity.Y = 0.0f;
-
 	p->Interp.Next.Pos = e->Position; e->Position = p->Interp.Prev.Pos;
+}
+
+static void LocalPlayer_RecordTick(struct LocalPlayer* p, int input, const Vec3* startPos, const Vec3* startVel);
+static void LocalPlayer_DiscardRecording(void);
+static void LocalPlayer_Tick(struct Entity* e, double delta) {
+	struct LocalPlayer* p = (struct LocalPlayer*)e;
+	cc_bool wasOnGround;
+	Vec3 startPos, startVel;
+	int input;
+
+	if (!World.Blocks) return;
+	wasOnGround = e->OnGround;
+	startPos    = p->Interp.Next.Pos;
+	startVel    = e->Velocity;
+
+	input = LocalPlayer_ReadInput(p);
+	LocalPlayer_PhysicsTick(p, input);
+	LocalPlayer_RecordTick(p, input, &startPos, &startVel);
+
 	AnimatedComp_Update(e, p->Interp.Prev.Pos, p->Interp.Next.Pos, delta);
 	TiltComp_Update(&p->Tilt, delta);
 
@@ -914,6 +1321,8 @@ static void LocalPlayer_OnNewMap(void) {
 	struct LocalPlayer* p = &LocalPlayer_Instance;
 	Vec3_Set(p->Base.Velocity, 0,0,0);
 	Vec3_Set(p->OldVelocity,   0,0,0);
+	/* Recorded ticks are meaningless for a different map */
+	LocalPlayer_DiscardRecording();
 
 	p->_warnedRespawn = false;
 	p->_warnedFly     = false;
@@ -1053,27 +1462,409 @@ cc_bool LocalPlayer_HandlesKey(int key) {
 }
 
 
+/*########################################################################################################################*
+*---------------------------------------------------LocalPlayer replay----------------------------------------------------*
+*#########################################################################################################################*/
+/* Records the local player's inputs each tick, so they can later be run through the */
+/*  same physics again, to measure its speed and check it still moves the player the same */
+/* File format (all values little endian, floats stored as their raw bits): */
+/*  "CCRP", version, map width, height, length, map blocks CRC32, ticks count, flags, multi jumps, */
+/*  hacks flags, speed multiplier, base horizontal speed, max jumps, jump velocity, */
+/*  model size, model gravity, model drag, model ground friction */
+/*  then for each tick: input flags, yaw, start position, start velocity, end position */
+/* NOTE: Hacks and model state is stored, so replaying doesn't depend on the current player */
+#define REPLAY_MAGIC 0x43435250UL /* "CCRP" */
+#define REPLAY_VERSION 2
+#define REPLAY_HEADER_SIZE 96
+#define REPLAY_TICK_SIZE 44
+#define REPLAY_ON_GROUND 0x01
+#define REPLAY_CAN_LIQUID_JUMP 0x02
+
+enum REPLAY_HACKS {
+	REPLAY_HACKS_ENABLED = 0x001, REPLAY_CAN_ANY_HACKS = 0x002, REPLAY_CAN_SPEED = 0x004,
+	REPLAY_CAN_FLY = 0x008, REPLAY_CAN_NOCLIP = 0x010, REPLAY_CAN_DOUBLE_JUMP = 0x020,
+	REPLAY_CAN_BE_PUSHED = 0x040, REPLAY_WOM_STYLE_HACKS = 0x080, REPLAY_FULL_BLOCK_STEP = 0x100,
+	REPLAY_NOCLIP_SLIDE = 0x200
+};
+
+struct ReplayTick { cc_uint32 input; float yaw; Vec3 startPos, startVel, endPos; };
+static struct Replay {
+	struct ReplayTick* ticks;
+	int count, capacity;
+	cc_uint32 width, height, length, mapCrc, flags, multiJumps;
+	cc_uint32 hacks, maxJumps;
+	float speedMultiplier, baseHorSpeed, jumpVel, gravity;
+	Vec3 size, drag, groundFriction;
+} recording;
+/* Position and velocity at end of last recorded tick */
+static Vec3 recording_lastPos, recording_lastVel;
+static cc_bool replay_recording;
+
+static void Replay_Free(struct Replay* r) {
+	Mem_Free(r->ticks);
+	r->ticks = NULL;
+	r->count = 0; r->capacity = 0;
+}
+
+static cc_uint32 Replay_MapCrc(void) {
+	return World.Blocks ? Utils_CRC32(World.Blocks, World.Volume) : 0;
+}
+
+static void Replay_SetF32(cc_uint8* data, float value) {
+	union IntAndFloat raw; raw.f = value;
+	Stream_SetU32_LE(data, raw.u);
+}
+
+static float Replay_GetF32(const cc_uint8* data) {
+	union IntAndFloat raw; raw.u = Stream_GetU32_LE(data);
+	return raw.f;
+}
+
+static void Replay_SetVec3(cc_uint8* data, const Vec3* value) {
+	Replay_SetF32(data + 0, value->X); Replay_SetF32(data + 4, value->Y); Replay_SetF32(data + 8, value->Z);
+}
+
+static void Replay_GetVec3(const cc_uint8* data, Vec3* value) {
+	value->X = Replay_GetF32(data + 0); value->Y = Replay_GetF32(data + 4); value->Z = Replay_GetF32(data + 8);
+}
+
+cc_bool LocalPlayer_IsRecording(void) { return replay_recording; }
+static void LocalPlayer_DiscardRecording(void) {
+	replay_recording = false;
+	Replay_Free(&recording);
+}
+
+void LocalPlayer_StartRecording(void) {
+	struct LocalPlayer* p = &LocalPlayer_Instance;
+	Replay_Free(&recording);
+	replay_recording = true;
+
+	recording.width  = World.Width;
+	recording.height = World.Height;
+	recording.length = World.Length;
+	recording.mapCrc = Replay_MapCrc();
+
+	recording.flags = 0;
+	if (p->Base.OnGround)          recording.flags |= REPLAY_ON_GROUND;
+	if (p->Physics.CanLiquidJump)  recording.flags |= REPLAY_CAN_LIQUID_JUMP;
+	recording.multiJumps = p->Physics.MultiJumps;
+
+	recording.hacks = 0;
+	if (p->Hacks.Enabled)       recording.hacks |= REPLAY_HACKS_ENABLED;
+	if (p->Hacks.CanAnyHacks)   recording.hacks |= REPLAY_CAN_ANY_HACKS;
+	if (p->Hacks.CanSpeed)      recording.hacks |= REPLAY_CAN_SPEED;
+	if (p->Hacks.CanFly)        recording.hacks |= REPLAY_CAN_FLY;
+	if (p->Hacks.CanNoclip)     recording.hacks |= REPLAY_CAN_NOCLIP;
+	if (p->Hacks.CanDoubleJump) recording.hacks |= REPLAY_CAN_DOUBLE_JUMP;
+	if (p->Hacks.CanBePushed)   recording.hacks |= REPLAY_CAN_BE_PUSHED;
+	if (p->Hacks.WOMStyleHacks) recording.hacks |= REPLAY_WOM_STYLE_HACKS;
+	if (p->Hacks.FullBlockStep) recording.hacks |= REPLAY_FULL_BLOCK_STEP;
+	if (p->Hacks.NoclipSlide)   recording.hacks |= REPLAY_NOCLIP_SLIDE;
+
+	recording.speedMultiplier = p->Hacks.SpeedMultiplier;
+	recording.baseHorSpeed    = p->Hacks.BaseHorSpeed;
+	recording.maxJumps        = p->Hacks.MaxJumps;
+	recording.jumpVel         = p->Physics.JumpVel;
+
+	recording.size           = p->Base.Size;
+	recording.gravity        = p->Base.Model->gravity;
+	recording.drag           = p->Base.Model->drag;
+	recording.groundFriction = p->Base.Model->groundFriction;
+}
+
+static void LocalPlayer_RecordTick(struct LocalPlayer* p, int input, const Vec3* startPos, const Vec3* startVel) {
+	struct ReplayTick* tick;
+	if (!replay_recording) return;
+
+	if (!recording.count || !Vec3_Equals(startPos, &recording_lastPos)) input |= INPUT_SET_POSITION;
+	if (!recording.count || !Vec3_Equals(startVel, &recording_lastVel)) input |= INPUT_SET_VELOCITY;
+	recording_lastPos = p->Interp.Next.Pos;
+	recording_lastVel = p->Base.Velocity;
+
+	if (recording.count == recording.capacity) {
+		recording.capacity = recording.capacity ? recording.capacity * 2 : 1024;
+		recording.ticks    = (struct ReplayTick*)Mem_Realloc(recording.ticks, recording.capacity, 
+								sizeof(struct ReplayTick), "replay ticks");
+	}
+
+	tick = &recording.ticks[recording.count++];
+	tick->input    = input;
+	tick->yaw      = p->Base.Yaw;
+	tick->startPos = *startPos;
+	tick->startVel = *startVel;
+	tick->endPos   = p->Interp.Next.Pos;
+}
+
+static cc_result Replay_Write(struct Stream* s, struct Replay* r) {
+	cc_uint8 header[REPLAY_HEADER_SIZE];
+	cc_uint8 data[REPLAY_TICK_SIZE];
+	struct ReplayTick* tick;
+	cc_result res;
+	int i;
+
+	Stream_SetU32_BE(header,      REPLAY_MAGIC);
+	Stream_SetU32_LE(header +  4, REPLAY_VERSION);
+	Stream_SetU32_LE(header +  8, r->width);
+	Stream_SetU32_LE(header + 12, r->height);
+	Stream_SetU32_LE(header + 16, r->length);
+	Stream_SetU32_LE(header + 20, r->mapCrc);
+	Stream_SetU32_LE(header + 24, r->count);
+	Stream_SetU32_LE(header + 28, r->flags);
+	Stream_SetU32_LE(header + 32, r->multiJumps);
+	Stream_SetU32_LE(header + 36, r->hacks);
+	Replay_SetF32(header    + 40, r->speedMultiplier);
+	Replay_SetF32(header    + 44, r->baseHorSpeed);
+	Stream_SetU32_LE(header + 48, r->maxJumps);
+	Replay_SetF32(header    + 52, r->jumpVel);
+	Replay_SetVec3(header   + 56, &r->size);
+	Replay_SetF32(header    + 68, r->gravity);
+	Replay_SetVec3(header   + 72, &r->drag);
+	Replay_SetVec3(header   + 84, &r->groundFriction);
+	if ((res = Stream_Write(s, header, REPLAY_HEADER_SIZE))) return res;
+
+	for (i = 0; i < r->count; i++) {
+		tick = &r->ticks[i];
+		Stream_SetU32_LE(data, tick->input);
+		Replay_SetF32(data   +  4, tick->yaw);
+		Replay_SetVec3(data  +  8, &tick->startPos);
+		Replay_SetVec3(data  + 20, &tick->startVel);
+		Replay_SetVec3(data  + 32, &tick->endPos);
+		if ((res = Stream_Write(s, data, REPLAY_TICK_SIZE))) return res;
+	}
+	return 0;
+}
+
+static cc_result Replay_Read(struct Stream* s, struct Replay* r) {
+	cc_uint8 header[REPLAY_HEADER_SIZE];
+	cc_uint8 data[REPLAY_TICK_SIZE];
+	struct ReplayTick* tick;
+	cc_uint32 count;
+	cc_result res;
+	int i;
+
+	if ((res = Stream_Read(s, header, REPLAY_HEADER_SIZE))) return res;
+	if (Stream_GetU32_BE(header)     != REPLAY_MAGIC)   return ERR_NOT_SUPPORTED;
+	if (Stream_GetU32_LE(header + 4) != REPLAY_VERSION) return ERR_NOT_SUPPORTED;
+
+	r->width      = Stream_GetU32_LE(header +  8);
+	r->height     = Stream_GetU32_LE(header + 12);
+	r->length     = Stream_GetU32_LE(header + 16);
+	r->mapCrc     = Stream_GetU32_LE(header + 20);
+	count         = Stream_GetU32_LE(header + 24);
+	r->flags      = Stream_GetU32_LE(header + 28);
+	r->multiJumps = Stream_GetU32_LE(header + 32);
+	r->hacks      = Stream_GetU32_LE(header + 36);
+
+	r->speedMultiplier = Replay_GetF32(header    + 40);
+	r->baseHorSpeed    = Replay_GetF32(header    + 44);
+	r->maxJumps        = Stream_GetU32_LE(header + 48);
+	r->jumpVel         = Replay_GetF32(header    + 52);
+	r->gravity         = Replay_GetF32(header    + 68);
+	Replay_GetVec3(header + 56, &r->size);
+	Replay_GetVec3(header + 72, &r->drag);
+	Replay_GetVec3(header + 84, &r->groundFriction);
+
+	/* Sanity check to avoid allocating huge amounts of memory for a corrupted file */
+	if (count > 100000000) return ERR_INVALID_ARGUMENT;
+	r->ticks    = count ? (struct ReplayTick*)Mem_TryAlloc(count, sizeof(struct ReplayTick)) : NULL;
+	if (count && !r->ticks) return ERR_OUT_OF_MEMORY;
+	r->count    = count;
+	r->capacity = count;
+
+	for (i = 0; i < r->count; i++) {
+		if ((res = Stream_Read(s, data, REPLAY_TICK_SIZE))) return res;
+		tick = &r->ticks[i];
+		tick->input = Stream_GetU32_LE(data);
+		tick->yaw   = Replay_GetF32(data +  4);
+		Replay_GetVec3(data +  8, &tick->startPos);
+		Replay_GetVec3(data + 20, &tick->startVel);
+		Replay_GetVec3(data + 32, &tick->endPos);
+	}
+	return 0;
+}
+
+cc_result LocalPlayer_StopRecording(const String* path) {
+	struct Stream stream;
+	cc_result res;
+	replay_recording = false;
+
+	res = Stream_CreateFile(&stream, path);
+	if (res) { Replay_Free(&recording); return res; }
+	res = Replay_Write(&stream, &recording);
+
+	if (res) {
+		stream.Close(&stream);
+	} else {
+		res = stream.Close(&stream);
+	}
+	Replay_Free(&recording);
+	return res;
+}
+
+/* Restores the local player's hacks, jump and model state to how it was when recording started */
+static void Replay_Restore(struct Replay* r, struct Model* model) {
+	struct LocalPlayer* p   = &LocalPlayer_Instance;
+	struct HacksComp* hacks = &p->Hacks;
+
+	/* Local player may not have been initialised at all (e.g. replaying in --replay mode) */
+	p->Collisions.Entity  = &p->Base;
+	p->Physics.Entity     = &p->Base;
+	p->Physics.Hacks      = &p->Hacks;
+	p->Physics.Collisions = &p->Collisions;
+
+	p->Base.OnGround         = (r->flags & REPLAY_ON_GROUND) != 0;
+	p->Physics.CanLiquidJump = (r->flags & REPLAY_CAN_LIQUID_JUMP) != 0;
+	p->Physics.MultiJumps    = r->multiJumps;
+	p->Physics.JumpVel       = r->jumpVel;
+
+	hacks->Enabled       = (r->hacks & REPLAY_HACKS_ENABLED)   != 0;
+	hacks->CanAnyHacks   = (r->hacks & REPLAY_CAN_ANY_HACKS)   != 0;
+	hacks->CanSpeed      = (r->hacks & REPLAY_CAN_SPEED)       != 0;
+	hacks->CanFly        = (r->hacks & REPLAY_CAN_FLY)         != 0;
+	hacks->CanNoclip     = (r->hacks & REPLAY_CAN_NOCLIP)      != 0;
+	hacks->CanDoubleJump = (r->hacks & REPLAY_CAN_DOUBLE_JUMP) != 0;
+	hacks->CanBePushed   = (r->hacks & REPLAY_CAN_BE_PUSHED)   != 0;
+	hacks->WOMStyleHacks = (r->hacks & REPLAY_WOM_STYLE_HACKS) != 0;
+	hacks->FullBlockStep = (r->hacks & REPLAY_FULL_BLOCK_STEP) != 0;
+	hacks->NoclipSlide   = (r->hacks & REPLAY_NOCLIP_SLIDE)    != 0;
+
+	hacks->SpeedMultiplier = r->speedMultiplier;
+	hacks->BaseHorSpeed    = r->baseHorSpeed;
+	hacks->MaxJumps        = r->maxJumps;
+
+	/* Physics only uses these properties of the model */
+	Mem_Set(model, 0, sizeof(struct Model));
+	model->gravity        = r->gravity;
+	model->drag           = r->drag;
+	model->groundFriction = r->groundFriction;
+	p->Base.Model = model;
+	p->Base.Size  = r->size;
+}
+
+/* Runs the given replay's ticks through physics, comparing where the player ends up each tick */
+static void Replay_Run(struct Replay* r, struct LocalPlayerReplay* result) {
+	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct ReplayTick* tick;
+	struct Model model;
+	cc_uint64 beg, end;
+	Vec3 delta;
+	float dist;
+	int i;
+
+	Replay_Restore(r, &model);
+
+	for (i = 0; i < r->count; i++) {
+		tick = &r->ticks[i];
+		/* Apply teleports and velocity changes made outside of ticks, */
+		/*  otherwise carry on from where the previous replayed tick ended */
+		if (tick->input & INPUT_SET_POSITION) p->Interp.Next.Pos = tick->startPos;
+		if (tick->input & INPUT_SET_VELOCITY) p->Base.Velocity   = tick->startVel;
+
+		p->Base.Yaw     = tick->yaw;
+		p->Hacks.Flying = (tick->input & INPUT_FLYING)     != 0;
+		p->Hacks.Noclip = (tick->input & INPUT_NOCLIPPING) != 0;
+
+		beg = Stopwatch_Measure();
+		LocalPlayer_PhysicsTick(p, tick->input);
+		end = Stopwatch_Measure();
+		result->microseconds += Stopwatch_ElapsedMicroseconds(beg, end);
+
+		Vec3_Sub(&delta, &p->Interp.Next.Pos, &tick->endPos);
+		dist = Math_SqrtF(Vec3_LengthSquared(&delta));
+		result->maxDiff   = max(result->maxDiff, dist);
+		result->finalDiff = dist;
+		if (dist != 0.0f && result->firstDiverged == -1) result->firstDiverged = i;
+	}
+}
+
+cc_result LocalPlayer_Replay(const String* path, struct LocalPlayerReplay* result) {
+	struct LocalPlayer saved;
+	struct Replay replay = { 0 };
+	struct Stream stream;
+	cc_result res;
+
+	Mem_Set(result, 0, sizeof(struct LocalPlayerReplay));
+	result->firstDiverged = -1;
+
+	res = Stream_OpenFile(&stream, path);
+	if (res) return res;
+	res = Replay_Read(&stream, &replay);
+	stream.Close(&stream);
+	if (res) { Replay_Free(&replay); return res; }
+
+	result->ticks   = replay.count;
+	result->sameMap = replay.width == World.Width && replay.height == World.Height
+		&& replay.length == World.Length && replay.mapCrc == Replay_MapCrc();
+
+	/* Replaying must not affect the actual local player */
+	saved = LocalPlayer_Instance;
+	if (World.Blocks) Replay_Run(&replay, result);
+	LocalPlayer_Instance = saved;
+
+	Replay_Free(&replay);
+	return 0;
+}
+
+
 /*########################################################################################################################*
 *-------------------------------------------------------NetPlayer---------------------------------------------------------*
 *#########################################################################################################################*/
 struct NetPlayer NetPlayers_List[ENTITIES_SELF_ID];
 
+enum NETINTERP_FIELD {
+	NETINTERP_X, NETINTERP_Y, NETINTERP_Z,
+	NETINTERP_PITCH, NETINTERP_YAW, NETINTERP_ROTX, NETINTERP_ROTY, NETINTERP_ROTZ, NETINTERP_FIELDS
+};
+/* Previous, next and interpolated state of each player in NetPlayers_List, stored */
+/*  one field at a time so interpolating every player is a few linear passes over memory */
+static float netInterp_prev[NETINTERP_FIELDS][ENTITIES_SELF_ID];
+static float netInterp_next[NETINTERP_FIELDS][ENTITIES_SELF_ID];
+static float netInterp_cur[NETINTERP_FIELDS][ENTITIES_SELF_ID];
+
+#define NetPlayer_IsListed(p) ((p) >= NetPlayers_List && (p) < NetPlayers_List + ENTITIES_SELF_ID)
+
+/* Copies interpolation state of the given player, after it has been changed */
+static void NetPlayer_StoreInterp(struct NetPlayer* p) {
+	struct InterpState* prev = &p->Interp.Prev;
+	struct InterpState* next = &p->Interp.Next;
+	int i;
+	if (!NetPlayer_IsListed(p)) return;
+	i = (int)(p - NetPlayers_List);
+
+	netInterp_prev[NETINTERP_X][i]     = prev->Pos.X;   netInterp_next[NETINTERP_X][i]     = next->Pos.X;
+	netInterp_prev[NETINTERP_Y][i]     = prev->Pos.Y;   netInterp_next[NETINTERP_Y][i]     = next->Pos.Y;
+	netInterp_prev[NETINTERP_Z][i]     = prev->Pos.Z;   netInterp_next[NETINTERP_Z][i]     = next->Pos.Z;
+	netInterp_prev[NETINTERP_PITCH][i] = prev->Pitch;   netInterp_next[NETINTERP_PITCH][i] = next->Pitch;
+	netInterp_prev[NETINTERP_YAW][i]   = prev->Yaw;     netInterp_next[NETINTERP_YAW][i]   = next->Yaw;
+	netInterp_prev[NETINTERP_ROTX][i]  = prev->RotX;    netInterp_next[NETINTERP_ROTX][i]  = next->RotX;
+	netInterp_prev[NETINTERP_ROTY][i]  = p->Interp.PrevRotY;
+	netInterp_next[NETINTERP_ROTY][i]  = p->Interp.NextRotY;
+	netInterp_prev[NETINTERP_ROTZ][i]  = prev->RotZ;    netInterp_next[NETINTERP_ROTZ][i]  = next->RotZ;
+}
+
 static void NetPlayer_SetLocation(struct Entity* e, struct LocationUpdate* update, cc_bool interpolate) {
 	struct NetPlayer* p = (struct NetPlayer*)e;
 	NetInterpComp_SetLocation(&p->Interp, update, interpolate);
+	NetPlayer_StoreInterp(p);
+	EntitiesGrid_MarkEntity(e);
 }
 
 static void NetPlayer_Tick(struct Entity* e, double delta) {
 	struct NetPlayer* p = (struct NetPlayer*)e;
 	Entity_CheckSkin(e);
 	NetInterpComp_AdvanceState(&p->Interp);
+	NetPlayer_StoreInterp(p);
 	AnimatedComp_Update(e, p->Interp.Prev.Pos, p->Interp.Next.Pos, delta);
 }
 
 static void NetPlayer_RenderModel(struct Entity* e, double deltaTime, float t) {
 	struct NetPlayer* p = (struct NetPlayer*)e;
-	Vec3_Lerp(&e->Position, &p->Interp.Prev.Pos, &p->Interp.Next.Pos, t);
-	InterpComp_LerpAngles((struct InterpComp*)(&p->Interp), e, t);
+	/* Players in NetPlayers_List have already been interpolated by NetPlayers_Interpolate */
+	if (!NetPlayer_IsListed(p)) {
+		Vec3_Lerp(&e->Position, &p->Interp.Prev.Pos, &p->Interp.Next.Pos, t);
+		InterpComp_LerpAngles((struct InterpComp*)(&p->Interp), e, t);
+		EntitiesGrid_MarkEntity(e);
+	}
 
 	AnimatedComp_GetCurrent(e, t);
 	p->ShouldRender = Model_ShouldRender(e);
@@ -1099,6 +1890,50 @@ void NetPlayer_Init(struct NetPlayer* p) {
 	Mem_Set(p, 0, sizeof(struct NetPlayer));
 	Entity_Init(&p->Base);
 	p->Base.VTABLE = &netPlayer_VTABLE;
+	NetPlayer_StoreInterp(p);
+}
+
+void NetPlayers_Interpolate(float t) {
+	struct Entity* e;
+	float* prev; float* next; float* cur;
+	float left, right;
+	int i, field;
+
+	/* Same as Vec3_Lerp */
+	for (field = NETINTERP_X; field <= NETINTERP_Z; field++) {
+		prev = netInterp_prev[field]; next = netInterp_next[field]; cur = netInterp_cur[field];
+
+		for (i = 0; i < ENTITIES_SELF_ID; i++) {
+			cur[i] = t * (next[i] - prev[i]) + prev[i];
+		}
+	}
+
+	/* Same as Math_LerpAngle */
+	for (field = NETINTERP_PITCH; field < NETINTERP_FIELDS; field++) {
+		prev = netInterp_prev[field]; next = netInterp_next[field]; cur = netInterp_cur[field];
+
+		for (i = 0; i < ENTITIES_SELF_ID; i++) {
+			left = prev[i]; right = next[i];
+			if (left  > 270.0f && right < 90.0f) left  -= 360.0f;
+			if (right > 270.0f && prev[i] < 90.0f) right -= 360.0f;
+			cur[i] = left + (right - left) * t;
+		}
+	}
+
+	for (i = 0; i < ENTITIES_SELF_ID; i++) {
+		e = &NetPlayers_List[i].Base;
+		if (e->VTABLE != &netPlayer_VTABLE) continue;
+
+		e->Position.X = netInterp_cur[NETINTERP_X][i];
+		e->Position.Y = netInterp_cur[NETINTERP_Y][i];
+		e->Position.Z = netInterp_cur[NETINTERP_Z][i];
+		e->Pitch = netInterp_cur[NETINTERP_PITCH][i];
+		e->Yaw   = netInterp_cur[NETINTERP_YAW][i];
+		e->RotX  = netInterp_cur[NETINTERP_ROTX][i];
+		e->RotY  = netInterp_cur[NETINTERP_ROTY][i];
+		e->RotZ  = netInterp_cur[NETINTERP_ROTZ][i];
+		Entities_MarkChanged((EntityID)i);
+	}
 }
 
 
@@ -1119,6 +1954,7 @@ static void Entities_Init(void) {
 		ShadowMode_Names, Array_Elems(ShadowMode_Names));
 	if (Game_ClassicMode) Entities.ShadowsMode = SHADOW_MODE_NONE;
 
+	EntitiesGrid_Reset();
 	Entities.List[ENTITIES_SELF_ID] = &LocalPlayer_Instance.Base;
 	LocalPlayer_Init();
 }
@@ -1133,6 +1969,7 @@ static void Entities_Free(void) {
 	Event_UnregisterVoid(&GfxEvents.ContextLost,      NULL, Entities_ContextLost);
 	Event_UnregisterVoid(&GfxEvents.ContextRecreated, NULL, Entities_ContextRecreated);
 	Event_UnregisterVoid(&ChatEvents.FontChanged,     NULL, Entities_ChatFontChanged);
+	LocalPlayer_DiscardRecording();
 
 	if (ShadowComponent_ShadowTex) {
 		Gfx_DeleteTexture(&ShadowComponent_ShadowTex);
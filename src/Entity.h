@@ -142,6 +142,13 @@ void Entities_RenderNames(void);
 void Entities_RenderHoveredNames(void);
 /* Removes the given entity, raising EntityEvents.Removed event. */
 void Entities_Remove(EntityID id);
+/* Marks the given entity as added, removed, moved, or having changed model, so Entities_Query sees it. */
+/* NOTE: Entities are already marked when ticked, when their location is set, and when interpolated. */
+CC_API void Entities_MarkChanged(EntityID id);
+/* Finds entities whose bounds may intersect the given bounds, returning the number of entities found. */
+/* NOTE: ids must have room for ENTITIES_MAX_COUNT entries, and are sorted by entity ID. */
+/* NOTE: This can also find entities outside the given bounds, so callers should check each entity. */
+int Entities_Query(const struct AABB* bb, EntityID* ids);
 /* Gets the ID of the closest entity to the given entity. */
 EntityID Entities_GetClosest(struct Entity* src);
 /* Draws shadows under entities, depending on Entities.ShadowsMode */
@@ -180,6 +187,9 @@ struct NetPlayer {
 };
 void NetPlayer_Init(struct NetPlayer* player);
 extern struct NetPlayer NetPlayers_List[ENTITIES_SELF_ID];
+/* Interpolates position and orientation of all players in NetPlayers_List at once. */
+/* NOTE: Entities_RenderModels calls this, so NetPlayer's RenderModel doesn't have to. */
+void NetPlayers_Interpolate(float t);
 
 /* Represents the user/player's own entity. */
 struct LocalPlayer {
@@ -202,4 +212,23 @@ void LocalPlayer_SetInterpPosition(float t);
 /* Returns whether local player handles a key being pressed. */
 /* e.g. for respawn, toggle fly, etc. */
 cc_bool LocalPlayer_HandlesKey(int key);
+
+/* Results of replaying recorded local player ticks */
+struct LocalPlayerReplay {
+	int ticks;           /* Number of ticks replayed */
+	float microseconds;  /* Total time spent in physics for all ticks */
+	cc_bool sameMap;     /* Whether current map is the same as the map ticks were recorded in */
+	int firstDiverged;   /* First tick ending in a different position than recorded, -1 if none did */
+	float maxDiff, finalDiff; /* Max and final distance from recorded positions */
+};
+/* Whether the local player's inputs are currently being recorded. */
+cc_bool LocalPlayer_IsRecording(void);
+/* Starts recording the local player's inputs and resulting position each tick. */
+/* NOTE: Recording is discarded when a new map is loaded. */
+void LocalPlayer_StartRecording(void);
+/* Stops recording, then saves what was recorded to the given file. */
+cc_result LocalPlayer_StopRecording(const String* path);
+/* Runs recorded ticks in the given file through the local player's physics, */
+/*  then restores the local player back to how it was before replaying. */
+cc_result LocalPlayer_Replay(const String* path, struct LocalPlayerReplay* result);
 #endif
@@ -1198,15 +1198,22 @@ float PhysicsComp_CalcJumpVelocity(float jumpHeight) {
 }
 
 void PhysicsComp_DoEntityPush(struct Entity* entity) {
+	EntityID ids[ENTITIES_MAX_COUNT];
 	struct Entity* other;
 	cc_bool yIntersects;
+	struct AABB bb;
 	Vec3 dir;
 	float dist, pushStrength;
-	int id;
+	int i, count;
 	dir.Y = 0.0f;
 
-	for (id = 0; id < ENTITIES_MAX_COUNT; id++) {
-		other = Entities.List[id];
+	/* Only entities within 1 block horizontally can push */
+	bb.Min.X = entity->Position.X - 1.0f; bb.Min.Y = -MATH_POS_INF; bb.Min.Z = entity->Position.Z - 1.0f;
+	bb.Max.X = entity->Position.X + 1.0f; bb.Max.Y =  MATH_POS_INF; bb.Max.Z = entity->Position.Z + 1.0f;
+	count = Entities_Query(&bb, ids);
+
+	for (i = 0; i < count; i++) {
+		other = Entities.List[ids[i]];
 		if (!other || other == entity) continue;
 		if (!other->Model->pushes)     continue;
 
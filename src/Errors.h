@@ -46,6 +46,13 @@ enum ERRORS_ALL {
 	DAT_ERR_JCLASS_TYPE, DAT_ERR_JCLASS_FIELDS, DAT_ERR_JCLASS_ANNOTATION,
 	DAT_ERR_JOBJECT_TYPE, DAT_ERR_JARRAY_TYPE, DAT_ERR_JARRAY_CONTENT,
 	/* CW map decoding errors */
-	NBT_ERR_INT32S, NBT_ERR_UNKNOWN, CW_ERR_ROOT_TAG, CW_ERR_STRING_LEN
+	NBT_ERR_INT32S, NBT_ERR_UNKNOWN, CW_ERR_ROOT_TAG, CW_ERR_STRING_LEN,
+	/* DEFLATE decompression errors */
+	INF_ERR_BLOCKTYPE, INF_ERR_BLOCKLEN, INF_ERR_REPEAT_BEG, INF_ERR_REPEAT_END,
+	INF_ERR_INVALID_CODE, INF_ERR_NUM_CODES,
+	/* CCM map decoding errors */
+	CCM_ERR_SIGNATURE, CCM_ERR_VERSION, CCM_ERR_DIMENSIONS, CCM_ERR_OFFSETS, CCM_ERR_SECTION_DATA, CCM_ERR_CHECKSUM,
+	/* Schematic map decoding errors */
+	SC_ERR_BLOCKS
 };
 #endif
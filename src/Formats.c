@@ -15,17 +15,68 @@
 #include "Chat.h"
 #include "Inventory.h"
 #include "TexturePack.h"
+#include "Screens.h"
+#include "Utils.h"
 
 
 /*########################################################################################################################*
 *--------------------------------------------------------General----------------------------------------------------------*
 *#########################################################################################################################*/
+/* Blocks of the map being imported. World.Blocks is only set once importing has finished, */
+/* since the rest of the game treats World.Blocks being non NULL as the world being ready. */
+static BlockRaw* map_blocks;
+/* Upper 8 bits of the blocks of the map being imported, or NULL if the map doesn't have them. */
+static BlockRaw* map_blocks2;
+/* Spawn and reach distance of the map being imported. Importers may run on a background thread, */
+/* so these are only copied into the local player once importing has finished. */
+static struct MapPlayer { Vec3 spawn; float spawnYaw, spawnPitch, reach; } map_player;
+static void Cw_ApplyPending(cc_bool fetchTexturePack);
+static void Cw_FreePending(void);
+
+/* Resets the state importers read the map into, before importing a map */
+static void Map_BeginImport(void) {
+	struct LocalPlayer* p = &LocalPlayer_Instance;
+	map_player.spawn      = p->Spawn;
+	map_player.spawnYaw   = p->SpawnYaw;
+	map_player.spawnPitch = p->SpawnPitch;
+	map_player.reach      = p->ReachDistance;
+	map_blocks2           = NULL;
+}
+
+/* Frees the state of a map that failed to import */
+static void Map_AbortImport(void) {
+	Mem_Free(map_blocks);
+	Mem_Free(map_blocks2);
+	map_blocks  = NULL;
+	map_blocks2 = NULL;
+	Cw_FreePending();
+}
+
+/* Replaces the current world with the imported map. (must be called on the main thread) */
+static void Map_FinishImport(IMapImporter importer, cc_bool fetchTexturePack) {
+	struct LocalPlayer* p = &LocalPlayer_Instance;
+	p->Spawn         = map_player.spawn;
+	p->SpawnYaw      = map_player.spawnYaw;
+	p->SpawnPitch    = map_player.spawnPitch;
+	p->ReachDistance = map_player.reach;
+
+	if (importer == Cw_Load || importer == Ccm_Load) Cw_ApplyPending(fetchTexturePack);
+#ifdef EXTENDED_BLOCKS
+	if (map_blocks2) World_SetMapUpper(map_blocks2);
+#else
+	Mem_Free(map_blocks2);
+#endif
+	World_SetNewMap(map_blocks, World.Width, World.Height, World.Length);
+	map_blocks  = NULL;
+	map_blocks2 = NULL;
+}
+
 static cc_result Map_ReadBlocks(struct Stream* stream) {
 	World.Volume = World.Width * World.Length * World.Height;
-	World.Blocks = (BlockRaw*)Mem_TryAlloc(World.Volume, 1);
+	map_blocks   = (BlockRaw*)Mem_TryAlloc(World.Volume, 1);
 
-	if (!World.Blocks) return ERR_OUT_OF_MEMORY;
-	return Stream_Read(stream, World.Blocks, World.Volume);
+	if (!map_blocks) return ERR_OUT_OF_MEMORY;
+	return Stream_Read(stream, map_blocks, World.Volume);
 }
 
 static cc_result Map_SkipGZipHeader(struct Stream* stream) {
@@ -42,44 +93,244 @@ static cc_result Map_SkipGZipHeader(struct Stream* stream) {
 IMapImporter Map_FindImporter(const String* path) {
 	static const String cw  = String_FromConst(".cw"),  lvl = String_FromConst(".lvl");
 	static const String fcm = String_FromConst(".fcm"), dat = String_FromConst(".dat");
+	static const String ccm = String_FromConst(".ccm"), sch = String_FromConst(".schematic");
 
 	if (String_CaselessEnds(path, &cw))  return Cw_Load;
+	if (String_CaselessEnds(path, &ccm)) return Ccm_Load;
 #ifndef CC_BUILD_WEB
 	if (String_CaselessEnds(path, &lvl)) return Lvl_Load;
 	if (String_CaselessEnds(path, &fcm)) return Fcm_Load;
 	if (String_CaselessEnds(path, &dat)) return Dat_Load;
+	if (String_CaselessEnds(path, &sch)) return Schematic_Load;
 #endif
 
 	return NULL;
 }
 
-void Map_LoadFrom(const String* path) {
-	struct LocalPlayer* p = &LocalPlayer_Instance;
-	struct LocationUpdate update;
+
+
+/*########################################################################################################################*
+*--------------------------------------------------------MapImport--------------------------------------------------------*
+*#########################################################################################################################*/
+#define MAP_READAHEAD_BLOCKS 4
+#define MAP_READAHEAD_SIZE   (256 * 1024)
+volatile float Map_LoadProgress;
+volatile cc_bool Map_LoadDone;
+
+/* Importing a map is split into stages, so that the game stays responsive while doing so: */
+/*  1) Reading the file ahead of where the importer is up to (read-ahead thread) */
+/*  2) Decompressing and parsing the map file (import thread) */
+/*  3) Replacing the current world with the imported map (main thread, see Map_EndLoad) */
+static struct MapImport {
+	struct Stream file;
 	IMapImporter importer;
+	cc_result result;
+	cc_uint32 length, consumed;
+	cc_bool active;
+
+	/* Ring of blocks of data read from the file, waiting to be used by the importer */
+	cc_uint8* buffer;
+	cc_uint32 blockLens[MAP_READAHEAD_BLOCKS];
+	int curBlock, numBlocks;
+	cc_uint32 blockPos;
+	cc_result readResult;
+	cc_bool readDone, cancelled;
+	void* mutex;
+	void* dataReady;
+	void* spaceFree;
+
+	String path;
+	char _pathBuffer[FILENAME_SIZE];
+} map_import;
+
+#ifndef CC_BUILD_WEB
+static void MapImport_ReadLoop(void) {
+	struct MapImport* m = &map_import;
+	cc_bool cancelled;
+	cc_uint32 len;
+	cc_result res;
+	int i;
+
+	for (;;) {
+		Mutex_Lock(m->mutex);
+		while (m->numBlocks == MAP_READAHEAD_BLOCKS && !m->cancelled) {
+			Mutex_Unlock(m->mutex);
+			Waitable_WaitFor(m->spaceFree, 10);
+			Mutex_Lock(m->mutex);
+		}
+		i = (m->curBlock + m->numBlocks) % MAP_READAHEAD_BLOCKS;
+		cancelled = m->cancelled;
+		Mutex_Unlock(m->mutex);
+		if (cancelled) return;
+
+		res = m->file.Read(&m->file, m->buffer + i * MAP_READAHEAD_SIZE, MAP_READAHEAD_SIZE, &len);
+		Mutex_Lock(m->mutex);
+		{
+			m->blockLens[i] = len;
+			if (res || !len) {
+				m->readResult = res;
+				m->readDone   = true;
+			} else {
+				m->numBlocks++;
+			}
+		}
+		Mutex_Unlock(m->mutex);
+
+		Waitable_Signal(m->dataReady);
+		if (res || !len) return;
+	}
+}
+
+static cc_result MapImport_StreamRead(struct Stream* s, cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	struct MapImport* m = &map_import;
+	cc_uint32 left;
+	cc_result res;
+	int numBlocks;
+	*modified = 0;
+
+	Mutex_Lock(m->mutex);
+	while (!m->numBlocks && !m->readDone) {
+		Mutex_Unlock(m->mutex);
+		Waitable_WaitFor(m->dataReady, 10);
+		Mutex_Lock(m->mutex);
+	}
+	numBlocks = m->numBlocks;
+	res       = m->readResult;
+	Mutex_Unlock(m->mutex);
+	/* Either end of the file, or failed to read from the file */
+	if (!numBlocks) return res;
+
+	left  = m->blockLens[m->curBlock] - m->blockPos;
+	count = min(count, left);
+	Mem_Copy(data, m->buffer + m->curBlock * MAP_READAHEAD_SIZE + m->blockPos, count);
+
+	*modified    = count;
+	m->blockPos += count;
+	m->consumed += count;
+	Map_LoadProgress = (float)m->consumed / m->length;
+	if (count < left) return 0;
+
+	/* Finished with this block, so the read-ahead thread can reuse it */
+	Mutex_Lock(m->mutex);
+	{
+		m->curBlock = (m->curBlock + 1) % MAP_READAHEAD_BLOCKS;
+		m->numBlocks--;
+	}
+	Mutex_Unlock(m->mutex);
+
+	m->blockPos = 0;
+	Waitable_Signal(m->spaceFree);
+	return 0;
+}
+#endif
+
+static void MapImport_ImportLoop(void) {
+	struct MapImport* m = &map_import;
+#ifdef CC_BUILD_WEB
+	/* No real threading support with emscripten backend, so just read from the file */
+	m->result = m->importer(&m->file);
+#else
 	struct Stream stream;
+	void* readThread;
+
+	Stream_Init(&stream);
+	stream.Read = MapImport_StreamRead;
+	readThread  = Thread_Start(MapImport_ReadLoop, false);
+	m->result   = m->importer(&stream);
+
+	/* Importer may not have read all of the file (e.g. failed to parse it) */
+	Mutex_Lock(m->mutex);
+	{
+		m->cancelled = true;
+	}
+	Mutex_Unlock(m->mutex);
+
+	Waitable_Signal(m->spaceFree);
+	Thread_Join(readThread);
+#endif
+	Map_LoadDone = true;
+}
+
+void Map_LoadFrom(const String* path) {
+	struct MapImport* m = &map_import;
 	cc_result res;
+	if (m->active) return;
 	Game_Reset();
 	
-	res = Stream_OpenFile(&stream, path);
+	res = Stream_OpenFile(&m->file, path);
 	if (res) { Logger_Warn2(res, "opening", path); return; }
 
-	importer = Map_FindImporter(path);
-	if ((res = importer(&stream))) {
+	res = m->file.Length(&m->file, &m->length);
+	if (res || !m->length) m->length = 1;
+
+	String_InitArray(m->path, m->_pathBuffer);
+	String_AppendString(&m->path, path);
+	m->importer   = Map_FindImporter(path);
+	Map_BeginImport();
+	m->active     = true;
+	m->result     = 0;
+	m->consumed   = 0;
+	m->curBlock   = 0;
+	m->numBlocks  = 0;
+	m->blockPos   = 0;
+	m->readResult = 0;
+	m->readDone   = false;
+	m->cancelled  = false;
+
+	m->buffer    = (cc_uint8*)Mem_Alloc(MAP_READAHEAD_BLOCKS, MAP_READAHEAD_SIZE, "map read-ahead");
+	m->mutex     = Mutex_Create();
+	m->dataReady = Waitable_Create();
+	m->spaceFree = Waitable_Create();
+
+	Map_LoadProgress = 0.0f;
+	Map_LoadDone     = false;
+	LoadingMapScreen_Show(path);
+	Thread_Start(MapImport_ImportLoop, true);
+}
+
+void Map_EndLoad(void) {
+	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapImport* m   = &map_import;
+	struct LocationUpdate update;
+	cc_result res;
+
+	Mem_Free(m->buffer);
+	Mutex_Free(m->mutex);
+	Waitable_Free(m->dataReady);
+	Waitable_Free(m->spaceFree);
+	Map_LoadDone = false;
+	m->active    = false;
+
+	if (m->result) {
+		Map_AbortImport();
 		World_Reset();
-		Logger_Warn2(res, "decoding", path); stream.Close(&stream); return;
+		Logger_Warn2(m->result, "decoding", &m->path); m->file.Close(&m->file); return;
 	}
 
-	res = stream.Close(&stream);
-	if (res) { Logger_Warn2(res, "closing", path); }
+	res = m->file.Close(&m->file);
+	if (res) { Logger_Warn2(res, "closing", &m->path); }
 
-	World_SetNewMap(World.Blocks, World.Width, World.Height, World.Length);
+	Map_FinishImport(m->importer, true);
 	Event_RaiseVoid(&WorldEvents.MapLoaded);
 
 	LocationUpdate_MakePosAndOri(&update, p->Spawn, p->SpawnYaw, p->SpawnPitch, false);
 	p->Base.VTABLE->SetLocation(&p->Base, &update, false);
 }
 
+cc_result Map_Import(IMapImporter importer, struct Stream* stream) {
+	cc_result res;
+	World_Reset();
+	Map_BeginImport();
+
+	if ((res = importer(stream))) {
+		Map_AbortImport();
+		World_Reset(); return res;
+	}
+
+	Map_FinishImport(importer, false);
+	return 0;
+}
+
 
 /*########################################################################################################################*
 *--------------------------------------------------MCSharp level Format---------------------------------------------------*
@@ -144,7 +395,7 @@ static cc_result Lvl_ReadCustomBlocks(struct Stream* stream) {
 						xx = i & 0xF; yy = (i >> 8) & 0xF; zz = (i >> 4) & 0xF;
 
 						index = baseIndex + World_Pack(xx, yy, zz);
-						World.Blocks[index] = World.Blocks[index] == LVL_CUSTOMTILE ? chunk[i] : World.Blocks[index];
+						map_blocks[index] = map_blocks[index] == LVL_CUSTOMTILE ? chunk[i] : map_blocks[index];
 					}
 				} else {
 					for (i = 0; i < sizeof(chunk); i++) {
@@ -152,7 +403,7 @@ static cc_result Lvl_ReadCustomBlocks(struct Stream* stream) {
 						if ((x + xx) >= World.Width || (y + yy) >= World.Height || (z + zz) >= World.Length) continue;
 
 						index = baseIndex + World_Pack(xx, yy, zz);
-						World.Blocks[index] = World.Blocks[index] == LVL_CUSTOMTILE ? chunk[i] : World.Blocks[index];
+						map_blocks[index] = map_blocks[index] == LVL_CUSTOMTILE ? chunk[i] : map_blocks[index];
 					}
 				}
 			}
@@ -168,7 +419,7 @@ cc_result Lvl_Load(struct Stream* stream) {
 	cc_result res;
 	int i;
 
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapPlayer* p = &map_player;
 	struct Stream compStream;
 	struct InflateState state;
 	Inflate_MakeStream(&compStream, &state, stream);
@@ -181,15 +432,15 @@ cc_result Lvl_Load(struct Stream* stream) {
 	World.Length = Stream_GetU16_LE(&header[4]);
 	World.Height = Stream_GetU16_LE(&header[6]);
 
-	p->Spawn.X = Stream_GetU16_LE(&header[8]);
-	p->Spawn.Z = Stream_GetU16_LE(&header[10]);
-	p->Spawn.Y = Stream_GetU16_LE(&header[12]);
-	p->SpawnYaw   = Math_Packed2Deg(header[14]);
-	p->SpawnPitch = Math_Packed2Deg(header[15]);
+	p->spawn.X = Stream_GetU16_LE(&header[8]);
+	p->spawn.Z = Stream_GetU16_LE(&header[10]);
+	p->spawn.Y = Stream_GetU16_LE(&header[12]);
+	p->spawnYaw   = Math_Packed2Deg(header[14]);
+	p->spawnPitch = Math_Packed2Deg(header[15]);
 	/* (2) pervisit, perbuild permissions */
 
 	if ((res = Map_ReadBlocks(&compStream))) return res;
-	blocks = World.Blocks;
+	blocks = map_blocks;
 	/* Bulk convert 4 blocks at once */
 	for (i = 0; i < (World.Volume & ~3); i += 4) {
 		*blocks = Lvl_table[*blocks]; blocks++;
@@ -243,7 +494,7 @@ cc_result Fcm_Load(struct Stream* stream) {
 	cc_result res;
 	int i, count;
 
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapPlayer* p = &map_player;
 	struct Stream compStream;
 	struct InflateState state;
 	Inflate_MakeStream(&compStream, &state, stream);
@@ -256,11 +507,11 @@ cc_result Fcm_Load(struct Stream* stream) {
 	World.Height = Stream_GetU16_LE(&header[7]);
 	World.Length = Stream_GetU16_LE(&header[9]);
 	
-	p->Spawn.X = ((int)Stream_GetU32_LE(&header[11])) / 32.0f;
-	p->Spawn.Y = ((int)Stream_GetU32_LE(&header[15])) / 32.0f;
-	p->Spawn.Z = ((int)Stream_GetU32_LE(&header[19])) / 32.0f;
-	p->SpawnYaw   = Math_Packed2Deg(header[23]);
-	p->SpawnPitch = Math_Packed2Deg(header[24]);
+	p->spawn.X = ((int)Stream_GetU32_LE(&header[11])) / 32.0f;
+	p->spawn.Y = ((int)Stream_GetU32_LE(&header[15])) / 32.0f;
+	p->spawn.Z = ((int)Stream_GetU32_LE(&header[19])) / 32.0f;
+	p->spawnYaw   = Math_Packed2Deg(header[23]);
+	p->spawnPitch = Math_Packed2Deg(header[24]);
 
 	/* header[25] (4) date modified */
 	/* header[29] (4) date created */
@@ -290,6 +541,8 @@ enum NbtTagType {
 #define NBT_SMALL_SIZE  STRING_SIZE
 #define NBT_STRING_SIZE STRING_SIZE
 #define NbtTag_IsSmall(tag) ((tag)->dataSize <= NBT_SMALL_SIZE)
+/* Path hash of the root tag. (root tag's name is not included in paths) */
+#define NBT_PATH_ROOT 2166136261UL
 struct NbtTag;
 
 struct NbtTag {
@@ -297,6 +550,7 @@ struct NbtTag {
 	cc_uint8  type;
 	String    name;
 	cc_uint32 dataSize; /* size of data for arrays */
+	cc_uint32 pathHash; /* hash of names of all the tags from root to this tag */
 
 	union {
 		cc_uint8  u8;
@@ -305,12 +559,40 @@ struct NbtTag {
 		cc_uint32 u32;
 		float     f32;
 		cc_uint8  small[NBT_SMALL_SIZE];
-		cc_uint8* big; /* malloc for big byte arrays */
 		struct { String text; char buffer[NBT_STRING_SIZE]; } str;
 	} value;
 	char _nameBuffer[NBT_STRING_SIZE];
 };
 
+/* Hashes a name (case insensitively), then combines it with the path hash of its parent tag */
+static cc_uint32 Nbt_HashName(cc_uint32 hash, const String* name) {
+	char c;
+	int i;
+
+	for (i = 0; i < name->length; i++) {
+		c = name->buffer[i];
+		Char_MakeLower(c);
+		hash = (hash ^ (cc_uint8)c) * 16777619UL;
+	}
+	return (hash ^ '/') * 16777619UL;
+}
+
+/* Calculates path hash of a tag from its path, e.g. "Metadata/CPE/EnvColors" */
+static cc_uint32 Nbt_HashPath(const char* path) {
+	cc_uint32 hash = NBT_PATH_ROOT;
+	String name;
+	int i;
+
+	for (;;) {
+		for (i = 0; path[i] && path[i] != '/'; i++) { }
+		name = String_Init((char*)path, i, i);
+		hash = Nbt_HashName(hash, &name);
+
+		if (!path[i]) return hash;
+		path += i + 1;
+	}
+}
+
 static cc_uint8 NbtTag_U8(struct NbtTag* tag) {
 	if (tag->type != NBT_I8) Logger_Abort("Expected I8 NBT tag");
 	return tag->value.u8;
@@ -334,8 +616,8 @@ static float NbtTag_F32(struct NbtTag* tag) {
 static cc_uint8* NbtTag_U8_Array(struct NbtTag* tag, int minSize) {
 	if (tag->type != NBT_I8S) Logger_Abort("Expected I8_Array NBT tag");
 	if (tag->dataSize < minSize) Logger_Abort("I8_Array NBT tag too small");
-
-	return NbtTag_IsSmall(tag) ? tag->value.small : tag->value.big;
+	/* NOTE: Only the first NBT_SMALL_SIZE bytes of larger arrays are read */
+	return tag->value.small;
 }
 
 static String NbtTag_String(struct NbtTag* tag) {
@@ -358,11 +640,20 @@ static cc_result Nbt_ReadString(struct Stream* stream, String* str) {
 	return 0;
 }
 
-typedef void (*Nbt_Callback)(struct NbtTag* tag);
-static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream* stream, struct NbtTag* parent, Nbt_Callback callback) {
+struct NbtReader {
+	/* Called after a tag (and all its children) has been read */
+	void (*ProcessTag)(struct NbtTag* tag);
+	/* Returns where to read the data of the given array tag into, before the data is read. */
+	/* Data of small arrays is read into tag->value.small and data of big arrays is skipped, */
+	/* when *data is left as NULL. (so big arrays are only ever read into their destination) */
+	cc_result (*GetArray)(struct NbtTag* tag, cc_uint8** data);
+};
+
+static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream* stream, struct NbtTag* parent, const struct NbtReader* reader) {
 	struct NbtTag tag;
 	cc_uint8 childType;
-	cc_uint8 tmp[5];	
+	cc_uint8 tmp[5];
+	cc_uint8* data;
 	cc_result res;
 	cc_uint32 i, count;
 	
@@ -376,6 +667,7 @@ static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream
 		res = Nbt_ReadString(stream, &tag.name);
 		if (res) return res;
 	}
+	tag.pathHash = parent ? Nbt_HashName(parent->pathHash, &tag.name) : NBT_PATH_ROOT;
 
 	switch (typeId) {
 	case NBT_I8:
@@ -396,15 +688,17 @@ static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream
 
 	case NBT_I8S:
 		if ((res = Stream_ReadU32_BE(stream, &tag.dataSize))) break;
+		data = NULL;
+		if ((res = reader->GetArray(&tag, &data))) break;
 
-		if (NbtTag_IsSmall(&tag)) {
+		if (data) {
+			res = Stream_Read(stream, data, tag.dataSize);
+		} else if (NbtTag_IsSmall(&tag)) {
 			res = Stream_Read(stream, tag.value.small, tag.dataSize);
 		} else {
-			tag.value.big = (cc_uint8*)Mem_TryAlloc(tag.dataSize, 1);
-			if (!tag.value.big) return ERR_OUT_OF_MEMORY;
-
-			res = Stream_Read(stream, tag.value.big, tag.dataSize);
-			if (res) Mem_Free(tag.value.big);
+			/* Only the start of larger arrays is kept, which is all that tag handlers read */
+			res = Stream_Read(stream, tag.value.small, NBT_SMALL_SIZE);
+			if (!res) res = stream->Skip(stream, tag.dataSize - NBT_SMALL_SIZE);
 		}
 		break;
 	case NBT_STR:
@@ -418,7 +712,7 @@ static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream
 		count = Stream_GetU32_BE(&tmp[1]);
 
 		for (i = 0; i < count; i++) {
-			res = Nbt_ReadTag(childType, false, stream, &tag, callback);
+			res = Nbt_ReadTag(childType, false, stream, &tag, reader);
 			if (res) break;
 		}
 		break;
@@ -428,7 +722,7 @@ static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream
 			if ((res = stream->ReadU8(stream, &childType))) break;
 			if (childType == NBT_END) break;
 
-			res = Nbt_ReadTag(childType, true, stream, &tag, callback);
+			res = Nbt_ReadTag(childType, true, stream, &tag, reader);
 			if (res) break;
 		}
 		break;
@@ -438,12 +732,9 @@ static cc_result Nbt_ReadTag(cc_uint8 typeId, cc_bool readTagName, struct Stream
 	}
 
 	if (res) return res;
-	callback(&tag);
-	/* NOTE: callback must set DataBig to NULL, if doesn't want it to be freed */
-	if (!NbtTag_IsSmall(&tag)) Mem_Free(tag.value.big);
+	reader->ProcessTag(&tag);
 	return 0;
 }
-#define IsTag(tag, tagName) (String_CaselessEqualsConst(&tag->name, tagName))
 
 /*########################################################################################################################*
 *--------------------------------------------------ClassicWorld format----------------------------------------------------*
@@ -488,223 +779,378 @@ COMPOUND "ClassicWorld" {
 		}
 	}
 }*/
-static BlockRaw* Cw_GetBlocks(struct NbtTag* tag) {
-	BlockRaw* ptr;
-	if (NbtTag_IsSmall(tag)) {
-		ptr = (BlockRaw*)Mem_Alloc(tag->dataSize, 1, ".cw map blocks");
-		Mem_Copy(ptr, tag->value.small, tag->dataSize);
-	} else {
-		ptr = tag->value.big;
-		tag->value.big = NULL; /* So Nbt_ReadTag doesn't call Mem_Free on World.Blocks */
+enum CwTagPath {
+	CW_TAG_X, CW_TAG_Y, CW_TAG_Z, CW_TAG_UUID, CW_TAG_BLOCKS, CW_TAG_BLOCKS2,
+	CW_TAG_SPAWN_X, CW_TAG_SPAWN_Y, CW_TAG_SPAWN_Z, CW_TAG_SPAWN_H, CW_TAG_SPAWN_P,
+	CW_TAG_REACH, CW_TAG_WEATHER, CW_TAG_SIDE_BLOCK, CW_TAG_EDGE_BLOCK, CW_TAG_SIDE_LEVEL, CW_TAG_TEXTURE_URL,
+	CW_TAG_COLS, CW_TAG_COL_SKY, CW_TAG_COL_CLOUD, CW_TAG_COL_FOG, CW_TAG_COL_SUN, CW_TAG_COL_SHADOW,
+	CW_TAG_COL_R, CW_TAG_COL_G, CW_TAG_COL_B,
+	CW_TAG_BLOCKDEFS, CW_TAG_BLOCKDEF, CW_TAG_DEF_ID, CW_TAG_DEF_ID2, CW_TAG_DEF_COLLIDE, CW_TAG_DEF_SPEED,
+	CW_TAG_DEF_LIGHT, CW_TAG_DEF_BRIGHT, CW_TAG_DEF_DRAW, CW_TAG_DEF_SHAPE, CW_TAG_DEF_NAME,
+	CW_TAG_DEF_TEXTURES, CW_TAG_DEF_SOUND, CW_TAG_DEF_FOG, CW_TAG_DEF_COORDS, CW_TAG_COUNT
+};
+
+/* Paths of the tags in ClassicWorld maps that are not discarded */
+/* '*' is used for the compound tags whose names vary (i.e. colours and block definitions) */
+static const char* const cw_tagPaths[CW_TAG_COUNT] = {
+	"X", "Y", "Z", "UUID", "BlockArray", "BlockArray2",
+	"Spawn/X", "Spawn/Y", "Spawn/Z", "Spawn/H", "Spawn/P",
+	"Metadata/CPE/ClickDistance/Distance", "Metadata/CPE/EnvWeatherType/WeatherType",
+	"Metadata/CPE/EnvMapAppearance/SideBlock",  "Metadata/CPE/EnvMapAppearance/EdgeBlock",
+	"Metadata/CPE/EnvMapAppearance/SideLevel",  "Metadata/CPE/EnvMapAppearance/TextureURL",
+	"Metadata/CPE/EnvColors", "Metadata/CPE/EnvColors/Sky", "Metadata/CPE/EnvColors/Cloud",
+	"Metadata/CPE/EnvColors/Fog", "Metadata/CPE/EnvColors/Sunlight", "Metadata/CPE/EnvColors/Ambient",
+	"Metadata/CPE/EnvColors/*/R", "Metadata/CPE/EnvColors/*/G", "Metadata/CPE/EnvColors/*/B",
+	"Metadata/CPE/BlockDefinitions",               "Metadata/CPE/BlockDefinitions/*",
+	"Metadata/CPE/BlockDefinitions/*/ID",          "Metadata/CPE/BlockDefinitions/*/ID2",
+	"Metadata/CPE/BlockDefinitions/*/CollideType", "Metadata/CPE/BlockDefinitions/*/Speed",
+	"Metadata/CPE/BlockDefinitions/*/TransmitsLight", "Metadata/CPE/BlockDefinitions/*/FullBright",
+	"Metadata/CPE/BlockDefinitions/*/BlockDraw",   "Metadata/CPE/BlockDefinitions/*/Shape",
+	"Metadata/CPE/BlockDefinitions/*/Name",        "Metadata/CPE/BlockDefinitions/*/Textures",
+	"Metadata/CPE/BlockDefinitions/*/WalkSound",   "Metadata/CPE/BlockDefinitions/*/Fog",
+	"Metadata/CPE/BlockDefinitions/*/Coords"
+};
+static cc_uint32 cw_tagHashes[CW_TAG_COUNT];
+
+static void Cw_InitTagHashes(void) {
+	int i;
+	if (cw_tagHashes[0]) return;
+
+	for (i = 0; i < CW_TAG_COUNT; i++) {
+		cw_tagHashes[i] = Nbt_HashPath(cw_tagPaths[i]);
 	}
-	return ptr;
 }
 
-static void Cw_Callback_1(struct NbtTag* tag) {
-	if (IsTag(tag, "X")) { World.Width  = NbtTag_U16(tag); return; }
-	if (IsTag(tag, "Y")) { World.Height = NbtTag_U16(tag); return; }
-	if (IsTag(tag, "Z")) { World.Length = NbtTag_U16(tag); return; }
+static int Cw_FindTag(cc_uint32 hash) {
+	int i;
+	for (i = 0; i < CW_TAG_COUNT; i++) {
+		if (cw_tagHashes[i] == hash) return i;
+	}
+	return -1;
+}
 
-	if (IsTag(tag, "UUID")) {
-		if (tag->dataSize != sizeof(World.Uuid)) Logger_Abort("Map UUID must be 16 bytes");
-		Mem_Copy(World.Uuid, tag->value.small, sizeof(World.Uuid));
-		return;
+static cc_bool Cw_IsAnyNameGroup(struct NbtTag* tag) {
+	return tag && (tag->pathHash == cw_tagHashes[CW_TAG_COLS] || tag->pathHash == cw_tagHashes[CW_TAG_BLOCKDEFS]);
+}
+
+/* Works out which of the tags in cw_tagPaths the given tag is, or -1 if it should be discarded */
+static int Cw_GetTagPath(struct NbtTag* tag) {
+	static const String anyName = String_FromConst("*");
+	struct NbtTag* group;
+	cc_uint32 hash = tag->pathHash;
+
+	/* Names of the compound tags within EnvColors/BlockDefinitions are ignored for their children */
+	group = tag->parent ? tag->parent->parent : NULL;
+	if (Cw_IsAnyNameGroup(group)) {
+		hash = Nbt_HashName(Nbt_HashName(group->pathHash, &anyName), &tag->name);
+	} else if (tag->parent && tag->parent->pathHash == cw_tagHashes[CW_TAG_BLOCKDEFS]) {
+		hash = Nbt_HashName(tag->parent->pathHash, &anyName);
 	}
+	return Cw_FindTag(hash);
+}
 
-	if (IsTag(tag, "BlockArray")) {
+static cc_result Cw_GetArray(struct NbtTag* tag, cc_uint8** data) {
+	int path = Cw_FindTag(tag->pathHash);
+	BlockRaw* blocks;
+
+	if (path != CW_TAG_BLOCKS && path != CW_TAG_BLOCKS2) return 0;
+	/* Read block arrays directly into the map, instead of allocating and copying into a temp buffer */
+	blocks = (BlockRaw*)Mem_TryAlloc(tag->dataSize, 1);
+	if (!blocks) return ERR_OUT_OF_MEMORY;
+
+	if (path == CW_TAG_BLOCKS) {
 		World.Volume = tag->dataSize;
-		World.Blocks = Cw_GetBlocks(tag);
-	}
+		map_blocks   = blocks;
+	} else {
 #ifdef EXTENDED_BLOCKS
-	if (IsTag(tag, "BlockArray2")) World_SetMapUpper(Cw_GetBlocks(tag));
+		Mem_Free(map_blocks2);
+		map_blocks2 = blocks;
+#else
+		Mem_Free(blocks); return 0;
 #endif
-}
+	}
 
-static void Cw_Callback_2(struct NbtTag* tag) {
-	struct LocalPlayer* p = &LocalPlayer_Instance;
-	if (!IsTag(tag->parent, "Spawn")) return;
-	
-	if (IsTag(tag, "X")) { p->Spawn.X = NbtTag_I16(tag); return; }
-	if (IsTag(tag, "Y")) { p->Spawn.Y = NbtTag_I16(tag); return; }
-	if (IsTag(tag, "Z")) { p->Spawn.Z = NbtTag_I16(tag); return; }
-	if (IsTag(tag, "H")) { p->SpawnYaw   = Math_Packed2Deg(NbtTag_U8(tag)); return; }
-	if (IsTag(tag, "P")) { p->SpawnPitch = Math_Packed2Deg(NbtTag_U8(tag)); return; }
+	*data = blocks;
+	return 0;
 }
 
+/* Bit flag for the given tag in CwPending.fields */
+#define CW_FIELD(path) (1UL << (path))
+/* Bit flag for the given block definition tag in CwBlockDef.fields */
+#define CW_DEF_FIELD(path) (1UL << ((path) - CW_TAG_BLOCKDEF))
+
+/* Block definition read from the map */
+struct CwBlockDef {
+	cc_uint32 fields;
+	cc_uint8 collide, draw, shape, sound;
+	cc_bool blocksLight, fullBright;
+	float speed, fogDensity;
+	PackedCol fogCol;
+	Vec3 minBB, maxBB;
+	TextureLoc tex[FACE_COUNT];
+	char name[STRING_SIZE];
+};
+
 static BlockID cw_curID;
+static struct CwBlockDef cw_curDef;
 static int cw_colR, cw_colG, cw_colB;
-static PackedCol Cw_ParseCol(PackedCol defValue) {
-	int r = cw_colR, g = cw_colG, b = cw_colB;
-	if (r > 255 || g > 255 || b > 255) return defValue;
-	return PackedCol_Make(r, g, b, 255);
+
+/* The environment and block definitions are read by the rendering and UI code every frame, */
+/* so they are only changed on the main thread after the map has been imported */
+static struct CwPending {
+	cc_uint32 fields;
+	cc_uint8 weather;
+	BlockID sidesBlock, edgeBlock;
+	int edgeHeight;
+	PackedCol skyCol, cloudsCol, fogCol, sunCol, shadowCol;
+	cc_bool defined[BLOCK_COUNT];
+	struct CwBlockDef* defs;
+	String texUrl;
+	char _texUrlBuffer[NBT_STRING_SIZE];
+} cw_pending;
+
+static void Cw_FreePending(void) {
+	Mem_Free(cw_pending.defs);
+	cw_pending.defs = NULL;
 }
 
-static void Cw_Callback_4(struct NbtTag* tag) {
-	BlockID id = cw_curID;
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+static void Cw_ApplyBlockDef(BlockID id, struct CwBlockDef* def) {
+	cc_uint32 fields = def->fields;
+	String name;
+	int i;
 
-	if (!IsTag(tag->parent->parent, "CPE")) return;
-	if (!IsTag(tag->parent->parent->parent, "Metadata")) return;
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_COLLIDE)) Block_SetCollide(id, def->collide);
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_SPEED))   Blocks.SpeedMultiplier[id] = def->speed;
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_LIGHT))   Blocks.BlocksLight[id]  = def->blocksLight;
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_BRIGHT))  Blocks.FullBright[id]   = def->fullBright;
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_DRAW))    Blocks.Draw[id]         = def->draw;
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_SHAPE))   Blocks.SpriteOffset[id] = def->shape;
 
-	if (IsTag(tag->parent, "ClickDistance")) {
-		if (IsTag(tag, "Distance")) { p->ReachDistance = NbtTag_U16(tag) / 32.0f; return; }
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_NAME)) {
+		name = String_FromRawArray(def->name);
+		Block_SetName(id, &name);
 	}
-	if (IsTag(tag->parent, "EnvWeatherType")) {
-		if (IsTag(tag, "WeatherType")) { Env.Weather = NbtTag_U8(tag); return; }
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_TEXTURES)) {
+		for (i = 0; i < FACE_COUNT; i++) { Block_Tex(id, i) = def->tex[i]; }
 	}
-
-	if (IsTag(tag->parent, "EnvMapAppearance")) {
-		if (IsTag(tag, "SideBlock")) { Env.SidesBlock = NbtTag_U8(tag);  return; }
-		if (IsTag(tag, "EdgeBlock")) { Env.EdgeBlock  = NbtTag_U8(tag);  return; }
-		if (IsTag(tag, "SideLevel")) { Env.EdgeHeight = NbtTag_I16(tag); return; }
-
-		if (IsTag(tag, "TextureURL")) {
-			String url = NbtTag_String(tag);
-			if (url.length) Server_RetrieveTexturePack(&url);
-			return;
-		}
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_SOUND)) {
+		Blocks.DigSounds[id]  = def->sound;
+		Blocks.StepSounds[id] = def->sound;
+		if (def->sound == SOUND_GLASS) Blocks.StepSounds[id] = SOUND_STONE;
 	}
-
-	/* Callback for compound tag is called after all its children have been processed */
-	if (IsTag(tag->parent, "EnvColors")) {
-		if (IsTag(tag, "Sky")) {
-			Env.SkyCol    = Cw_ParseCol(ENV_DEFAULT_SKY_COL); return;
-		} else if (IsTag(tag, "Cloud")) {
-			Env.CloudsCol = Cw_ParseCol(ENV_DEFAULT_CLOUDS_COL); return;
-		} else if (IsTag(tag, "Fog")) {
-			Env.FogCol    = Cw_ParseCol(ENV_DEFAULT_FOG_COL); return;
-		} else if (IsTag(tag, "Sunlight")) {
-			Env_SetSunCol(Cw_ParseCol(ENV_DEFAULT_SUN_COL)); return;
-		} else if (IsTag(tag, "Ambient")) {
-			Env_SetShadowCol(Cw_ParseCol(ENV_DEFAULT_SHADOW_COL)); return;
-		}
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_FOG)) {
+		Blocks.FogDensity[id] = def->fogDensity;
+		Blocks.FogCol[id]     = def->fogCol;
+	}
+	if (fields & CW_DEF_FIELD(CW_TAG_DEF_COORDS)) {
+		Blocks.MinBB[id] = def->minBB;
+		Blocks.MaxBB[id] = def->maxBB;
 	}
 
-	if (IsTag(tag->parent, "BlockDefinitions") && Game_AllowCustomBlocks) {
-		static const String blockStr = String_FromConst("Block");
-		if (!String_CaselessStarts(&tag->name, &blockStr)) return;	
+	/* hack for sprite draw (can't rely on order of tags when reading) */
+	if (Blocks.SpriteOffset[id] == 0) {
+		Blocks.SpriteOffset[id] = Blocks.Draw[id];
+		Blocks.Draw[id] = DRAW_SPRITE;
+	} else {
+		Blocks.SpriteOffset[id] = 0;
+	}
 
-		/* hack for sprite draw (can't rely on order of tags when reading) */
-		if (Blocks.SpriteOffset[id] == 0) {
-			Blocks.SpriteOffset[id] = Blocks.Draw[id];
-			Blocks.Draw[id] = DRAW_SPRITE;
-		} else {
-			Blocks.SpriteOffset[id] = 0;
-		}
+	Blocks.CanPlace[id]  = true;
+	Blocks.CanDelete[id] = true;
+	Block_DefineCustom(id);
+}
 
-		Block_DefineCustom(id);
-		Blocks.CanPlace[id]  = true;
-		Blocks.CanDelete[id] = true;
-		Event_RaiseVoid(&BlockEvents.PermissionsChanged);
+static void Cw_ApplyPending(cc_bool fetchTexturePack) {
+	struct CwPending* pending = &cw_pending;
+	cc_uint32 fields = pending->fields;
+	cc_bool anyDefined = false;
+	int i;
 
-		cw_curID = 0;
+	if (fields & CW_FIELD(CW_TAG_WEATHER))    Env.Weather    = pending->weather;
+	if (fields & CW_FIELD(CW_TAG_SIDE_BLOCK)) Env.SidesBlock = pending->sidesBlock;
+	if (fields & CW_FIELD(CW_TAG_EDGE_BLOCK)) Env.EdgeBlock  = pending->edgeBlock;
+	if (fields & CW_FIELD(CW_TAG_SIDE_LEVEL)) Env.EdgeHeight = pending->edgeHeight;
+	if (fields & CW_FIELD(CW_TAG_COL_SKY))    Env.SkyCol     = pending->skyCol;
+	if (fields & CW_FIELD(CW_TAG_COL_CLOUD))  Env.CloudsCol  = pending->cloudsCol;
+	if (fields & CW_FIELD(CW_TAG_COL_FOG))    Env.FogCol     = pending->fogCol;
+
+	if (fields & CW_FIELD(CW_TAG_COL_SUN))    Env_SetSunCol(pending->sunCol);
+	if (fields & CW_FIELD(CW_TAG_COL_SHADOW)) Env_SetShadowCol(pending->shadowCol);
+
+	for (i = 0; i < BLOCK_COUNT; i++) {
+		if (!pending->defined[i]) continue;
+		Cw_ApplyBlockDef(i, &pending->defs[i]);
+		anyDefined = true;
 	}
+	if (anyDefined) Event_RaiseVoid(&BlockEvents.PermissionsChanged);
+	Cw_FreePending();
+
+	if (!fetchTexturePack) {
+		/* Still need to keep the URL, so it isn't lost when the map is saved again */
+		String_Copy(&World_TextureUrl, &pending->texUrl);
+	} else if (pending->texUrl.length) {
+		Server_RetrieveTexturePack(&pending->texUrl);
+	}
+}
+static PackedCol Cw_ParseCol(PackedCol defValue) {
+	int r = cw_colR, g = cw_colG, b = cw_colB;
+	if (r > 255 || g > 255 || b > 255) return defValue;
+	return PackedCol_Make(r, g, b, 255);
 }
 
-static void Cw_Callback_5(struct NbtTag* tag) {
+static void Cw_FinishBlockDef(struct NbtTag* tag) {
+	static const String blockStr = String_FromConst("Block");
 	BlockID id = cw_curID;
-	cc_uint8* arr;
-	cc_uint8 sound;
-
-	if (!IsTag(tag->parent->parent->parent, "CPE")) return;
-	if (!IsTag(tag->parent->parent->parent->parent, "Metadata")) return;
-
-	if (IsTag(tag->parent->parent, "EnvColors")) {
-		if (IsTag(tag, "R")) { cw_colR = NbtTag_U16(tag); return; }
-		if (IsTag(tag, "G")) { cw_colG = NbtTag_U16(tag); return; }
-		if (IsTag(tag, "B")) { cw_colB = NbtTag_U16(tag); return; }
-	}
-
-	if (IsTag(tag->parent->parent, "BlockDefinitions") && Game_AllowCustomBlocks) {
-		if (IsTag(tag, "ID"))             { cw_curID = NbtTag_U8(tag);  return; }
-		if (IsTag(tag, "ID2"))            { cw_curID = NbtTag_U16(tag); return; }
-		if (IsTag(tag, "CollideType"))    { Block_SetCollide(id, NbtTag_U8(tag)); return; }
-		if (IsTag(tag, "Speed"))          { Blocks.SpeedMultiplier[id] = NbtTag_F32(tag); return; }
-		if (IsTag(tag, "TransmitsLight")) { Blocks.BlocksLight[id] = NbtTag_U8(tag) == 0; return; }
-		if (IsTag(tag, "FullBright"))     { Blocks.FullBright[id] = NbtTag_U8(tag) != 0; return; }
-		if (IsTag(tag, "BlockDraw"))      { Blocks.Draw[id] = NbtTag_U8(tag); return; }
-		if (IsTag(tag, "Shape"))          { Blocks.SpriteOffset[id] = NbtTag_U8(tag); return; }
-
-		if (IsTag(tag, "Name")) {
-			String name = NbtTag_String(tag);
-			Block_SetName(id, &name);
-			return;
-		}
 
-		if (IsTag(tag, "Textures")) {
-			arr = NbtTag_U8_Array(tag, 6);
-			Block_Tex(id, FACE_YMAX) = arr[0]; Block_Tex(id, FACE_YMIN) = arr[1];
-			Block_Tex(id, FACE_XMIN) = arr[2]; Block_Tex(id, FACE_XMAX) = arr[3];
-			Block_Tex(id, FACE_ZMIN) = arr[4]; Block_Tex(id, FACE_ZMAX) = arr[5];
-
-			/* hacky way of storing upper 8 bits */
-			if (tag->dataSize >= 12) {
-				Block_Tex(id, FACE_YMAX) |= arr[6]  << 8; Block_Tex(id, FACE_YMIN) |= arr[7]  << 8;
-				Block_Tex(id, FACE_XMIN) |= arr[8]  << 8; Block_Tex(id, FACE_XMAX) |= arr[9]  << 8;
-				Block_Tex(id, FACE_ZMIN) |= arr[10] << 8; Block_Tex(id, FACE_ZMAX) |= arr[11] << 8;
-			}
-			return;
-		}
-		
-		if (IsTag(tag, "WalkSound")) {
-			sound = NbtTag_U8(tag);
-			Blocks.DigSounds[id]  = sound;
-			Blocks.StepSounds[id] = sound;
-			if (sound == SOUND_GLASS) Blocks.StepSounds[id] = SOUND_STONE;
-			return;
+	if (String_CaselessStarts(&tag->name, &blockStr)) {
+		if (!cw_pending.defs) {
+			cw_pending.defs = (struct CwBlockDef*)Mem_Alloc(BLOCK_COUNT, sizeof(struct CwBlockDef), "map block definitions");
 		}
+		cw_pending.defs[id]    = cw_curDef;
+		cw_pending.defined[id] = true;
+	}
 
-		if (IsTag(tag, "Fog")) {
-			arr = NbtTag_U8_Array(tag, 4);
-			Blocks.FogDensity[id] = (arr[0] + 1) / 128.0f;
-			/* Fix for older ClassicalSharp versions which saved wrong fog density value */
-			if (arr[0] == 0xFF) Blocks.FogDensity[id] = 0.0f;
-			Blocks.FogCol[id] = PackedCol_Make(arr[1], arr[2], arr[3], 255);
-			return;
-		}
+	Mem_Set(&cw_curDef, 0, sizeof(cw_curDef));
+	cw_curID = 0;
+}
 
-		if (IsTag(tag, "Coords")) {
-			arr = NbtTag_U8_Array(tag, 6);
-			Blocks.MinBB[id].X = (cc_int8)arr[0] / 16.0f; Blocks.MaxBB[id].X = (cc_int8)arr[3] / 16.0f;
-			Blocks.MinBB[id].Y = (cc_int8)arr[1] / 16.0f; Blocks.MaxBB[id].Y = (cc_int8)arr[4] / 16.0f;
-			Blocks.MinBB[id].Z = (cc_int8)arr[2] / 16.0f; Blocks.MaxBB[id].Z = (cc_int8)arr[5] / 16.0f;
-			return;
+static void Cw_BlockDefCallback(struct NbtTag* tag, int path) {
+	struct CwBlockDef* def = &cw_curDef;
+	cc_uint8* arr;
+	String name;
+
+	switch (path) {
+	case CW_TAG_BLOCKDEF:    Cw_FinishBlockDef(tag); return;
+	case CW_TAG_DEF_ID:      cw_curID = NbtTag_U8(tag);  return;
+	case CW_TAG_DEF_ID2:     cw_curID = NbtTag_U16(tag); return;
+	case CW_TAG_DEF_COLLIDE: def->collide     = NbtTag_U8(tag);  break;
+	case CW_TAG_DEF_SPEED:   def->speed       = NbtTag_F32(tag); break;
+	case CW_TAG_DEF_LIGHT:   def->blocksLight = NbtTag_U8(tag) == 0; break;
+	case CW_TAG_DEF_BRIGHT:  def->fullBright  = NbtTag_U8(tag) != 0; break;
+	case CW_TAG_DEF_DRAW:    def->draw        = NbtTag_U8(tag);  break;
+	case CW_TAG_DEF_SHAPE:   def->shape       = NbtTag_U8(tag);  break;
+	case CW_TAG_DEF_SOUND:   def->sound       = NbtTag_U8(tag);  break;
+
+	case CW_TAG_DEF_NAME:
+		name = NbtTag_String(tag);
+		String_CopyToRaw(def->name, STRING_SIZE, &name);
+		break;
+
+	case CW_TAG_DEF_TEXTURES:
+		arr = NbtTag_U8_Array(tag, 6);
+		def->tex[FACE_YMAX] = arr[0]; def->tex[FACE_YMIN] = arr[1];
+		def->tex[FACE_XMIN] = arr[2]; def->tex[FACE_XMAX] = arr[3];
+		def->tex[FACE_ZMIN] = arr[4]; def->tex[FACE_ZMAX] = arr[5];
+
+		/* hacky way of storing upper 8 bits */
+		if (tag->dataSize >= 12) {
+			def->tex[FACE_YMAX] |= arr[6]  << 8; def->tex[FACE_YMIN] |= arr[7]  << 8;
+			def->tex[FACE_XMIN] |= arr[8]  << 8; def->tex[FACE_XMAX] |= arr[9]  << 8;
+			def->tex[FACE_ZMIN] |= arr[10] << 8; def->tex[FACE_ZMAX] |= arr[11] << 8;
 		}
+		break;
+
+	case CW_TAG_DEF_FOG:
+		arr = NbtTag_U8_Array(tag, 4);
+		def->fogDensity = (arr[0] + 1) / 128.0f;
+		/* Fix for older ClassicalSharp versions which saved wrong fog density value */
+		if (arr[0] == 0xFF) def->fogDensity = 0.0f;
+		def->fogCol = PackedCol_Make(arr[1], arr[2], arr[3], 255);
+		break;
+
+	case CW_TAG_DEF_COORDS:
+		arr = NbtTag_U8_Array(tag, 6);
+		def->minBB.X = (cc_int8)arr[0] / 16.0f; def->maxBB.X = (cc_int8)arr[3] / 16.0f;
+		def->minBB.Y = (cc_int8)arr[1] / 16.0f; def->maxBB.Y = (cc_int8)arr[4] / 16.0f;
+		def->minBB.Z = (cc_int8)arr[2] / 16.0f; def->maxBB.Z = (cc_int8)arr[5] / 16.0f;
+		break;
+
+	default: return;
 	}
+	def->fields |= CW_DEF_FIELD(path);
 }
 
 static void Cw_Callback(struct NbtTag* tag) {
-	struct NbtTag* tmp = tag->parent;
-	int depth = 0;
-	while (tmp) { depth++; tmp = tmp->parent; }
+	struct CwPending* pending = &cw_pending;
+	struct MapPlayer* p = &map_player;
+	int path = Cw_GetTagPath(tag);
+	String url;
+
+	switch (path) {
+	case CW_TAG_X: World.Width  = NbtTag_U16(tag); return;
+	case CW_TAG_Y: World.Height = NbtTag_U16(tag); return;
+	case CW_TAG_Z: World.Length = NbtTag_U16(tag); return;
+
+	case CW_TAG_UUID:
+		if (tag->dataSize != sizeof(World.Uuid)) Logger_Abort("Map UUID must be 16 bytes");
+		Mem_Copy(World.Uuid, tag->value.small, sizeof(World.Uuid));
+		return;
+
+	case CW_TAG_SPAWN_X: p->spawn.X = NbtTag_I16(tag); return;
+	case CW_TAG_SPAWN_Y: p->spawn.Y = NbtTag_I16(tag); return;
+	case CW_TAG_SPAWN_Z: p->spawn.Z = NbtTag_I16(tag); return;
+	case CW_TAG_SPAWN_H: p->spawnYaw   = Math_Packed2Deg(NbtTag_U8(tag)); return;
+	case CW_TAG_SPAWN_P: p->spawnPitch = Math_Packed2Deg(NbtTag_U8(tag)); return;
+	case CW_TAG_REACH:   p->reach = NbtTag_U16(tag) / 32.0f; return;
+
+	case CW_TAG_TEXTURE_URL:
+		url = NbtTag_String(tag);
+		pending->texUrl.length = 0;
+		String_AppendString(&pending->texUrl, &url);
+		return;
 
-	switch (depth) {
-	case 1: Cw_Callback_1(tag); return;
-	case 2: Cw_Callback_2(tag); return;
-	case 4: Cw_Callback_4(tag); return;
-	case 5: Cw_Callback_5(tag); return;
+	case CW_TAG_WEATHER:    pending->weather    = NbtTag_U8(tag);  break;
+	case CW_TAG_SIDE_BLOCK: pending->sidesBlock = NbtTag_U8(tag);  break;
+	case CW_TAG_EDGE_BLOCK: pending->edgeBlock  = NbtTag_U8(tag);  break;
+	case CW_TAG_SIDE_LEVEL: pending->edgeHeight = NbtTag_I16(tag); break;
+
+	/* Callback for compound tag is called after all its children have been processed */
+	case CW_TAG_COL_SKY:    pending->skyCol    = Cw_ParseCol(ENV_DEFAULT_SKY_COL);    break;
+	case CW_TAG_COL_CLOUD:  pending->cloudsCol = Cw_ParseCol(ENV_DEFAULT_CLOUDS_COL); break;
+	case CW_TAG_COL_FOG:    pending->fogCol    = Cw_ParseCol(ENV_DEFAULT_FOG_COL);    break;
+	case CW_TAG_COL_SUN:    pending->sunCol    = Cw_ParseCol(ENV_DEFAULT_SUN_COL);    break;
+	case CW_TAG_COL_SHADOW: pending->shadowCol = Cw_ParseCol(ENV_DEFAULT_SHADOW_COL); break;
+	case CW_TAG_COL_R: cw_colR = NbtTag_U16(tag); return;
+	case CW_TAG_COL_G: cw_colG = NbtTag_U16(tag); return;
+	case CW_TAG_COL_B: cw_colB = NbtTag_U16(tag); return;
+
+	default:
+		if (path >= CW_TAG_BLOCKDEF && Game_AllowCustomBlocks) Cw_BlockDefCallback(tag, path);
+		return;
 	}
-	/* ClassicWorld -> Metadata -> CPE -> ExtName -> [values]
-	        0             1         2        3          4   */
+	pending->fields |= CW_FIELD(path);
 }
 
-cc_result Cw_Load(struct Stream* stream) {
+/* Reads the root ClassicWorld tag, and all the tags within it */
+static cc_result Cw_ReadRoot(struct Stream* stream, const struct NbtReader* reader) {
 	cc_uint8 tag;
+	cc_result res;
+
+	if ((res = stream->ReadU8(stream, &tag))) return res;
+	if (tag != NBT_DICT) return CW_ERR_ROOT_TAG;
+
+	Cw_InitTagHashes();
+	Cw_FreePending();
+	Mem_Set(&cw_pending, 0, sizeof(cw_pending));
+	Mem_Set(&cw_curDef,  0, sizeof(cw_curDef));
+	cw_curID = 0;
+	String_InitArray(cw_pending.texUrl, cw_pending._texUrlBuffer);
+	return Nbt_ReadTag(NBT_DICT, true, stream, NULL, reader);
+}
+
+cc_result Cw_Load(struct Stream* stream) {
+	static const struct NbtReader reader = { Cw_Callback, Cw_GetArray };
 	struct Stream compStream;
 	struct InflateState state;
 	Vec3* spawn; IVec3 pos;
 	cc_result res;
 
 	Inflate_MakeStream(&compStream, &state, stream);
-	if ((res = Map_SkipGZipHeader(stream))) return res;
-	if ((res = compStream.ReadU8(&compStream, &tag))) return res;
-
-	if (tag != NBT_DICT) return CW_ERR_ROOT_TAG;
-	res = Nbt_ReadTag(NBT_DICT, true, &compStream, NULL, Cw_Callback);
-	if (res) return res;
+	if ((res = Map_SkipGZipHeader(stream)))              return res;
+	if ((res = Cw_ReadRoot(&compStream, &reader))) return res;
 
 	/* Older versions incorrectly multiplied spawn coords by * 32, so we check for that */
-	spawn = &LocalPlayer_Instance.Spawn; 
+	spawn = &map_player.spawn;
 	IVec3_Floor(&pos, spawn);
 
 	if (!World_Contains(pos.X, pos.Y, pos.Z)) { 
@@ -901,7 +1347,7 @@ cc_result Dat_Load(struct Stream* stream) {
 	cc_result res;
 	int i;
 
-	struct LocalPlayer* p = &LocalPlayer_Instance;
+	struct MapPlayer* p = &map_player;
 	struct Stream compStream;
 	struct InflateState state;
 	Inflate_MakeStream(&compStream, &state, stream);
@@ -931,20 +1377,163 @@ cc_result Dat_Load(struct Stream* stream) {
 			World.Height = Dat_I32(field);
 		} else if (String_CaselessEqualsConst(&fieldName, "blocks")) {
 			if (field->Type != JFIELD_ARRAY) Logger_Abort("Blocks field must be Array");
-			World.Blocks = field->Value.Array.Ptr;
+			map_blocks   = field->Value.Array.Ptr;
 			World.Volume = field->Value.Array.Size;
 		} else if (String_CaselessEqualsConst(&fieldName, "xSpawn")) {
-			p->Spawn.X = (float)Dat_I32(field);
+			p->spawn.X = (float)Dat_I32(field);
 		} else if (String_CaselessEqualsConst(&fieldName, "ySpawn")) {
-			p->Spawn.Y = (float)Dat_I32(field);
+			p->spawn.Y = (float)Dat_I32(field);
 		} else if (String_CaselessEqualsConst(&fieldName, "zSpawn")) {
-			p->Spawn.Z = (float)Dat_I32(field);
+			p->spawn.Z = (float)Dat_I32(field);
 		}
 	}
 	return 0;
 }
 
 
+/*########################################################################################################################*
+*----------------------------------------------------Schematic format-----------------------------------------------------*
+*#########################################################################################################################*/
+/* Schematic is a NBT tag based format used by MCEdit/WorldEdit. Tags not listed below are discarded.
+COMPOUND "Schematic" {
+	I16 "Width", "Height", "Length"
+	STR "Materials" ("Classic" for ClassiCube block IDs, "Alpha" for Minecraft block IDs)
+	U8* "Blocks" (lower 8 bits)
+	U8* "Data"   (only used for the colour of wool/clay/concrete)
+}*/
+enum ScTagPath { SC_TAG_WIDTH, SC_TAG_HEIGHT, SC_TAG_LENGTH, SC_TAG_MATERIALS, SC_TAG_BLOCKS, SC_TAG_DATA, SC_TAG_COUNT };
+static const char* const sc_tagPaths[SC_TAG_COUNT] = { "Width", "Height", "Length", "Materials", "Blocks", "Data" };
+static cc_uint32 sc_tagHashes[SC_TAG_COUNT];
+
+static cc_bool sc_classic;
+static cc_uint8* sc_blockData;
+static cc_uint32 sc_blockDataSize;
+
+/* Converts Minecraft block IDs to the closest looking ClassiCube block */
+/* 255 means the block is coloured according to its data value (e.g. wool) */
+#define SC_DYED 255
+static const cc_uint8 Sc_table[256] = {
+	  0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+	 16,  17,  18,  19,  20,   1,  58,   4,  52,   5,  21,   0,   0,   5,   0,   0,
+	  0,   5,   5, 255,   0,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+	 48,  49,   0,  54,  42,   5,  64,   0,  15,  28,  64,   0,   3,   4,   4,   0,
+	  0,  51,   0,   4,   0,   0,   0,   0,   0,   1,   1,   0,   0,   0,  53,  60,
+	 36,  25,  35,   6,   5,   5,  22,  21,  57,  23,   0,  22,   0,   0,   0,  20,
+	  0,   1,  65,  57,  21,   0,  20,  24,   0,   0,   0,   0,  45,  65,   2,   0,
+	 45,  45,  45,   0,  49,   0,  42,   0,  52,  52,  34,  57,  23,   5,   5,   0,
+	 52,   1,  49,   0,   0,  25,   5,   5,   5,  64,  20,   4,   0,   0,   0,   0,
+	  0,  42,  64,   0,   0,   0,   0,   0,  21,  21,  42,  36,  36,   0,   4, 255,
+	 20,  18,  17,   5,   5,  24,   0,   0,  59,  36,  23,   0,  57,  34,  60,   0,
+	  0,   0,   0,  22,  22,  22,  22,   0,   0,   0,   0,   0,   5,   5,   5,   5,
+	  5,   0,   0,   0,   0,   0,   0,  31,  31,  31,  31,  31,  31,  31,  52,   0,
+	  2,   0,  64,  64,  60,  62,  21,  21,  36,   0,   4,  36,  22,  32,  27,  23,
+	 24,  55,  35,  35,  28,  31,  29,  57,  56,  21,  34,  36,  22,  32,  27,  23,
+	 24,  55,  35,  35,  28,  31,  29,  57,  56,  21,  34, 255, 255,   0,   0,  64
+};
+static const cc_uint8 Sc_dyeTable[16] = {
+	BLOCK_WHITE, BLOCK_ORANGE, BLOCK_MAGENTA, BLOCK_AQUA, BLOCK_YELLOW, BLOCK_LIME, BLOCK_LIGHT_PINK, BLOCK_GRAY,
+	BLOCK_GRAY,  BLOCK_CYAN,   BLOCK_VIOLET,  BLOCK_BLUE, BLOCK_BROWN,  BLOCK_FOREST_GREEN, BLOCK_RED, BLOCK_BLACK
+};
+
+static int Sc_FindTag(cc_uint32 hash) {
+	int i;
+	for (i = 0; i < SC_TAG_COUNT; i++) {
+		if (sc_tagHashes[i] == hash) return i;
+	}
+	return -1;
+}
+
+static cc_result Sc_GetArray(struct NbtTag* tag, cc_uint8** data) {
+	int path = Sc_FindTag(tag->pathHash);
+	cc_uint8* arr;
+
+	if (path != SC_TAG_BLOCKS && path != SC_TAG_DATA) return 0;
+	/* Read arrays directly into their destination, instead of into a temp buffer */
+	arr = (cc_uint8*)Mem_TryAlloc(tag->dataSize, 1);
+	if (!arr) return ERR_OUT_OF_MEMORY;
+
+	if (path == SC_TAG_BLOCKS) {
+		Mem_Free(map_blocks);
+		World.Volume = tag->dataSize;
+		map_blocks   = arr;
+	} else {
+		Mem_Free(sc_blockData);
+		sc_blockDataSize = tag->dataSize;
+		sc_blockData     = arr;
+	}
+
+	*data = arr;
+	return 0;
+}
+
+static void Sc_Callback(struct NbtTag* tag) {
+	static const String classic = String_FromConst("Classic");
+	String materials;
+
+	switch (Sc_FindTag(tag->pathHash)) {
+	case SC_TAG_WIDTH:  World.Width  = NbtTag_U16(tag); return;
+	case SC_TAG_HEIGHT: World.Height = NbtTag_U16(tag); return;
+	case SC_TAG_LENGTH: World.Length = NbtTag_U16(tag); return;
+
+	case SC_TAG_MATERIALS:
+		materials  = NbtTag_String(tag);
+		sc_classic = String_CaselessEquals(&materials, &classic);
+		return;
+	}
+}
+
+static void Sc_ConvertBlocks(void) {
+	BlockRaw* blocks = map_blocks;
+	cc_bool hasData  = sc_blockData && sc_blockDataSize >= (cc_uint32)World.Volume;
+	cc_uint8 block;
+	int i;
+
+	for (i = 0; i < World.Volume; i++) {
+		block = Sc_table[blocks[i]];
+		if (block == SC_DYED) block = Sc_dyeTable[hasData ? sc_blockData[i] & 0x0F : 0];
+		blocks[i] = block;
+	}
+}
+
+cc_result Schematic_Load(struct Stream* stream) {
+	static const struct NbtReader reader = { Sc_Callback, Sc_GetArray };
+	struct MapPlayer* p = &map_player;
+	struct Stream compStream;
+	struct InflateState state;
+	cc_uint8 tag;
+	cc_result res;
+	int i;
+
+	Inflate_MakeStream(&compStream, &state, stream);
+	if ((res = Map_SkipGZipHeader(stream)))               return res;
+	if ((res = compStream.ReadU8(&compStream, &tag)))     return res;
+	if (tag != NBT_DICT) return CW_ERR_ROOT_TAG;
+
+	if (!sc_tagHashes[0]) {
+		for (i = 0; i < SC_TAG_COUNT; i++) { sc_tagHashes[i] = Nbt_HashPath(sc_tagPaths[i]); }
+	}
+	/* MCEdit defaults to Alpha when Materials tag is missing */
+	sc_classic = false;
+	sc_blockData    = NULL;
+
+	res = Nbt_ReadTag(NBT_DICT, true, &compStream, NULL, &reader);
+	if (!res && (!map_blocks || World.Volume != World.Width * World.Height * World.Length)) {
+		res = SC_ERR_BLOCKS;
+	}
+	if (!res && !sc_classic) Sc_ConvertBlocks();
+
+	Mem_Free(sc_blockData);
+	sc_blockData = NULL;
+	if (res) return res;
+
+	/* Schematics don't store a spawn, so just drop the player in at the centre */
+	p->spawn.X = World.Width  / 2.0f; 
+	p->spawn.Y = (float)World.Height;
+	p->spawn.Z = World.Length / 2.0f;
+	return 0;
+}
+
+
 /*########################################################################################################################*
 *--------------------------------------------------ClassicWorld export----------------------------------------------------*
 *#########################################################################################################################*/
@@ -964,7 +1553,7 @@ static int Cw_WriteEndString(cc_uint8* data, const String* text) {
 	return len + 1;
 }
 
-static cc_uint8 cw_begin[131] = {
+static cc_uint8 cw_begin[114] = {
 NBT_DICT, 0,12, 'C','l','a','s','s','i','c','W','o','r','l','d',
 	NBT_I8,   0,13, 'F','o','r','m','a','t','V','e','r','s','i','o','n', 1,
 	NBT_I8S,  0,4,  'U','U','I','D', 0,0,0,16, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
@@ -978,6 +1567,8 @@ NBT_DICT, 0,12, 'C','l','a','s','s','i','c','W','o','r','l','d',
 		NBT_I8,   0,1, 'H', 0,
 		NBT_I8,   0,1, 'P', 0,
 	NBT_END,
+};
+static cc_uint8 cw_map1[17] = {
 	NBT_I8S,  0,10, 'B','l','o','c','k','A','r','r','a','y', 0,0,0,0,
 };
 static cc_uint8 cw_map2[18] = {
@@ -1095,12 +1686,10 @@ static cc_result Cw_WriteBockDef(struct Stream* stream, int b) {
 	return Stream_Write(stream, tmp, sizeof(cw_meta_def) + len);
 }
 
-cc_result Cw_Save(struct Stream* stream) {
-	cc_uint8 tmp[768];
-	PackedCol col;
+/* Writes the start of the root tag, and general information about the map */
+static cc_result Cw_WriteBegin(struct Stream* stream) {
+	cc_uint8 tmp[sizeof(cw_begin)];
 	struct LocalPlayer* p = &LocalPlayer_Instance;
-	cc_result res;
-	int b, len;
 
 	Mem_Copy(tmp, cw_begin, sizeof(cw_begin));
 	{
@@ -1108,7 +1697,6 @@ cc_result Cw_Save(struct Stream* stream) {
 		Stream_SetU16_BE(&tmp[63], World.Width);
 		Stream_SetU16_BE(&tmp[69], World.Height);
 		Stream_SetU16_BE(&tmp[75], World.Length);
-		Stream_SetU32_BE(&tmp[127], World.Volume);
 		
 		/* TODO: Maybe keep real spawn too? */
 		Stream_SetU16_BE(&tmp[89],  (cc_uint16)p->Base.Position.X);
@@ -1117,16 +1705,15 @@ cc_result Cw_Save(struct Stream* stream) {
 		tmp[107] = Math_Deg2Packed(p->SpawnYaw);
 		tmp[112] = Math_Deg2Packed(p->SpawnPitch);
 	}
-	if ((res = Stream_Write(stream, tmp,      sizeof(cw_begin)))) return res;
-	if ((res = Stream_Write(stream, World.Blocks, World.Volume))) return res;
-
-	if (World.Blocks != World.Blocks2) {
-		Mem_Copy(tmp, cw_map2, sizeof(cw_map2));
-		Stream_SetU32_BE(&tmp[14], World.Volume);
+	return Stream_Write(stream, tmp, sizeof(cw_begin));
+}
 
-		if ((res = Stream_Write(stream, tmp,        sizeof(cw_map2)))) return res;
-		if ((res = Stream_Write(stream, World.Blocks2, World.Volume))) return res;
-	}
+/* Writes the environment settings and block definitions, then the end of the root tag */
+static cc_result Cw_WriteMetadata(struct Stream* stream) {
+	cc_uint8 tmp[768];
+	PackedCol col;
+	cc_result res;
+	int b, len;
 
 	Mem_Copy(tmp, cw_meta_cpe, sizeof(cw_meta_cpe));
 	{
@@ -1156,6 +1743,27 @@ cc_result Cw_Save(struct Stream* stream) {
 	return Stream_Write(stream, cw_end, sizeof(cw_end));
 }
 
+cc_result Cw_Save(struct Stream* stream) {
+	cc_uint8 tmp[sizeof(cw_map2)];
+	cc_result res;
+
+	if ((res = Cw_WriteBegin(stream))) return res;
+	Mem_Copy(tmp, cw_map1, sizeof(cw_map1));
+	Stream_SetU32_BE(&tmp[13], World.Volume);
+
+	if ((res = Stream_Write(stream, tmp,       sizeof(cw_map1)))) return res;
+	if ((res = Stream_Write(stream, World.Blocks, World.Volume))) return res;
+
+	if (World.Blocks != World.Blocks2) {
+		Mem_Copy(tmp, cw_map2, sizeof(cw_map2));
+		Stream_SetU32_BE(&tmp[14], World.Volume);
+
+		if ((res = Stream_Write(stream, tmp,        sizeof(cw_map2)))) return res;
+		if ((res = Stream_Write(stream, World.Blocks2, World.Volume))) return res;
+	}
+	return Cw_WriteMetadata(stream);
+}
+
 
 /*########################################################################################################################*
 *---------------------------------------------------Schematic export------------------------------------------------------*
@@ -1205,3 +1813,744 @@ cc_result Schematic_Save(struct Stream* stream) {
 	}
 	return Stream_Write(stream, sc_end, sizeof(sc_end));
 }
+
+
+/*########################################################################################################################*
+*-----------------------------------------------ClassiCube chunked map format---------------------------------------------*
+*#########################################################################################################################*/
+/* .ccm is a native map format, designed so that saving a map only rewrites the parts that changed.
+The map is split into 16x16x16 sections, which are each compressed independently. (little endian)
+HEADER[2] "Headers" {
+	U8[4] "Signature" ("CCMP")
+	U16   "Version" (1)
+	U16   "Flags"   (bit 0 set if map has upper 8 bits of blocks)
+	U16   "Width", "Height", "Length"
+	U16   "Reserved"
+	U32   "MetaOffset", "MetaSize", "MetaCapacity"
+	U32   "EndOffset"  (end of all section and metadata slots)
+	U32   "Generation" (incremented each time the map is saved)
+	U32   "Checksum"   (CRC32 of the fields above, followed by this header's section table)
+}
+SECTION[2][] "Section tables" (one for each header, in YZX order, same as the blocks of a map) {
+	U32 "Offset", "Capacity" (slot in the file for this section's data)
+	U16 "Size"  (size of compressed data, 0 when all blocks in this section are the same)
+	U16 "Block" (block that fills the section, when Size is 0)
+}
+The header with the highest generation whose checksum matches is used.
+Data at MetaOffset is a ClassicWorld root tag, without any block arrays.
+Data of a section is run length encoded: U8 "Control", then either:
+ - Control < 128:  Control + 1 literal bytes
+ - Control >= 128: U8 repeated (Control - 125) times
+Decoded section data is the lower 8 bits of blocks, then the upper 8 bits (if Flags bit 0 set).
+Blocks outside the map (in sections on the edges of the map) are 0.
+*/
+#define CCM_VERSION 1
+#define CCM_HEADER_SIZE 40
+#define CCM_ENTRY_SIZE 12
+#define CCM_SECTION_SIZE 16
+#define CCM_SECTION_VOLUME (CCM_SECTION_SIZE * CCM_SECTION_SIZE * CCM_SECTION_SIZE)
+/* Number of sections needed to cover the given map dimension */
+#define Ccm_SectionsAlong(dim) (((dim) + (CCM_SECTION_SIZE - 1)) / CCM_SECTION_SIZE)
+/* Worst case size of run length encoded section data (i.e. all literals) */
+#define CCM_MAX_ENCODED (2 * CCM_SECTION_VOLUME + (2 * CCM_SECTION_VOLUME) / 128)
+/* Worst case size of metadata (see Cw_WriteBockDef) */
+#define CCM_MAX_META (1024 + BLOCK_COUNT * 512)
+#define CCM_JOB_SECTIONS 64
+#define CCM_MAX_THREADS 16
+#define CCM_SLOT_ALIGN 256
+
+struct CcmSection {
+	cc_uint32 offset, capacity; cc_uint16 size, block;
+	cc_uint32 jobOffset; /* Offset of encoded data in the job's data buffer */
+};
+/* A range of sections that is encoded or decoded by a single thread at a time */
+struct CcmJob {
+	int first, count;
+	cc_uint8* data;
+	cc_uint32 dataLen, dataCapacity;
+	cc_result result;
+};
+
+static struct CcmState {
+	int sectionsX, sectionsY, sectionsZ, count;
+	int width, height, length;
+	BlockRaw* blocks;
+	BlockRaw* blocks2;
+	int rawSize;
+	struct CcmSection* sections;
+	const cc_bool* dirty;
+
+	/* Data read from the file (decoding only) */
+	cc_uint8* data;
+	cc_uint32 dataBeg, dataEnd;
+
+	struct CcmJob* jobs;
+	int numJobs, nextJob;
+	void (*ProcessJob)(struct CcmJob* job);
+	void* mutex;
+} ccm;
+
+static cc_uint32 Ccm_AlignSlot(cc_uint32 size) {
+	return (size + (CCM_SLOT_ALIGN - 1)) & ~(CCM_SLOT_ALIGN - 1);
+}
+
+static void Ccm_InitState(int width, int height, int length, BlockRaw* blocks, BlockRaw* blocks2) {
+	ccm.width  = width;
+	ccm.height = height;
+	ccm.length = length;
+	ccm.blocks  = blocks;
+	ccm.blocks2 = blocks2;
+	ccm.rawSize = blocks2 ? 2 * CCM_SECTION_VOLUME : CCM_SECTION_VOLUME;
+
+	ccm.sectionsX = Ccm_SectionsAlong(width);
+	ccm.sectionsY = Ccm_SectionsAlong(height);
+	ccm.sectionsZ = Ccm_SectionsAlong(length);
+	ccm.count     = ccm.sectionsX * ccm.sectionsY * ccm.sectionsZ;
+	ccm.dirty     = NULL;
+	ccm.data      = NULL;
+}
+
+static int Ccm_EncodeRLE(const cc_uint8* src, int len, cc_uint8* dst) {
+	cc_uint8* cur = dst;
+	int i = 0, run, lits;
+
+	while (i < len) {
+		for (run = 1; i + run < len && run < 130 && src[i + run] == src[i]; run++) { }
+
+		if (run >= 3) {
+			*cur++ = (cc_uint8)(run + 125);
+			*cur++ = src[i];
+			i += run; continue;
+		}
+
+		/* Literals continue until the next run of 3 or more of the same byte */
+		for (lits = 1; i + lits < len && lits < 128; lits++) {
+			if (i + lits + 2 < len && src[i + lits] == src[i + lits + 1] && src[i + lits] == src[i + lits + 2]) break;
+		}
+		*cur++ = (cc_uint8)(lits - 1);
+		Mem_Copy(cur, &src[i], lits);
+		cur += lits; i += lits;
+	}
+	return (int)(cur - dst);
+}
+
+static cc_result Ccm_DecodeRLE(const cc_uint8* src, int srcLen, cc_uint8* dst, int dstLen) {
+	const cc_uint8* end = src + srcLen;
+	int i = 0, count;
+
+	while (i < dstLen) {
+		if (end - src < 2) return CCM_ERR_SECTION_DATA;
+
+		if (*src < 128) {
+			count = *src++ + 1;
+			if (count > end - src || count > dstLen - i) return CCM_ERR_SECTION_DATA;
+			Mem_Copy(&dst[i], src, count);
+			src += count;
+		} else {
+			count = *src++ - 125;
+			if (count > dstLen - i) return CCM_ERR_SECTION_DATA;
+			Mem_Set(&dst[i], *src++, count);
+		}
+		i += count;
+	}
+	return src == end ? 0 : CCM_ERR_SECTION_DATA;
+}
+
+/* Calculates the bounds of the part of the given section that lies inside the map */
+static void Ccm_GetBounds(int index, int* x, int* y, int* z, int* maxX, int* maxY, int* maxZ) {
+	*x = (index % ccm.sectionsX) * CCM_SECTION_SIZE;
+	*z = ((index / ccm.sectionsX) % ccm.sectionsZ) * CCM_SECTION_SIZE;
+	*y = (index / (ccm.sectionsX * ccm.sectionsZ)) * CCM_SECTION_SIZE;
+
+	*maxX = min(CCM_SECTION_SIZE, ccm.width  - *x);
+	*maxY = min(CCM_SECTION_SIZE, ccm.height - *y);
+	*maxZ = min(CCM_SECTION_SIZE, ccm.length - *z);
+}
+
+static void Ccm_CopyOut(int index, cc_uint8* raw) {
+	int x, y, z, maxX, maxY, maxZ;
+	int yy, zz, src, dst;
+
+	Ccm_GetBounds(index, &x, &y, &z, &maxX, &maxY, &maxZ);
+	if (maxX < CCM_SECTION_SIZE || maxY < CCM_SECTION_SIZE || maxZ < CCM_SECTION_SIZE) {
+		Mem_Set(raw, 0, ccm.rawSize);
+	}
+
+	for (yy = 0; yy < maxY; yy++) {
+		for (zz = 0; zz < maxZ; zz++) {
+			src = ((y + yy) * ccm.length + (z + zz)) * ccm.width + x;
+			dst = (yy * CCM_SECTION_SIZE + zz) * CCM_SECTION_SIZE;
+
+			Mem_Copy(&raw[dst], &ccm.blocks[src], maxX);
+			if (!ccm.blocks2) continue;
+			Mem_Copy(&raw[dst + CCM_SECTION_VOLUME], &ccm.blocks2[src], maxX);
+		}
+	}
+}
+
+static void Ccm_CopyIn(int index, const cc_uint8* raw) {
+	int x, y, z, maxX, maxY, maxZ;
+	int yy, zz, src, dst;
+
+	Ccm_GetBounds(index, &x, &y, &z, &maxX, &maxY, &maxZ);
+	for (yy = 0; yy < maxY; yy++) {
+		for (zz = 0; zz < maxZ; zz++) {
+			src = (yy * CCM_SECTION_SIZE + zz) * CCM_SECTION_SIZE;
+			dst = ((y + yy) * ccm.length + (z + zz)) * ccm.width + x;
+
+			Mem_Copy(&ccm.blocks[dst], &raw[src], maxX);
+			if (!ccm.blocks2) continue;
+			Mem_Copy(&ccm.blocks2[dst], &raw[src + CCM_SECTION_VOLUME], maxX);
+		}
+	}
+}
+
+/* Returns whether all the blocks in the given section data are the same */
+static cc_bool Ccm_IsUniform(const cc_uint8* raw, int len) {
+	int i;
+	for (i = 1; i < len; i++) {
+		if (raw[i] != raw[0]) return false;
+	}
+	return true;
+}
+
+static void Ccm_EncodeJob(struct CcmJob* job) {
+	cc_uint8 raw[2 * CCM_SECTION_VOLUME];
+	cc_uint8 encoded[CCM_MAX_ENCODED];
+	struct CcmSection* section;
+	int i, len;
+
+	for (i = job->first; i < job->first + job->count; i++) {
+		if (ccm.dirty && !ccm.dirty[i]) continue;
+		section = &ccm.sections[i];
+		Ccm_CopyOut(i, raw);
+
+		if (Ccm_IsUniform(raw, CCM_SECTION_VOLUME) && (!ccm.blocks2 || Ccm_IsUniform(raw + CCM_SECTION_VOLUME, CCM_SECTION_VOLUME))) {
+			section->size  = 0;
+			section->block = ccm.blocks2 ? raw[0] | (raw[CCM_SECTION_VOLUME] << 8) : raw[0];
+			continue;
+		}
+		len = Ccm_EncodeRLE(raw, ccm.rawSize, encoded);
+
+		if (job->dataLen + len > job->dataCapacity) {
+			job->dataCapacity = max(job->dataCapacity * 2, job->dataLen + len);
+			job->data = (cc_uint8*)Mem_Realloc(job->data, job->dataCapacity, 1, "map sections");
+		}
+
+		Mem_Copy(job->data + job->dataLen, encoded, len);
+		section->jobOffset = job->dataLen;
+		section->size      = len;
+		job->dataLen   += len;
+	}
+}
+
+static void Ccm_DecodeJob(struct CcmJob* job) {
+	cc_uint8 raw[2 * CCM_SECTION_VOLUME];
+	struct CcmSection* section;
+	cc_result res;
+	int i;
+
+	for (i = job->first; i < job->first + job->count; i++) {
+		section = &ccm.sections[i];
+
+		if (!section->size) {
+			Mem_Set(raw, (cc_uint8)section->block, CCM_SECTION_VOLUME);
+			Mem_Set(raw + CCM_SECTION_VOLUME, (cc_uint8)(section->block >> 8), CCM_SECTION_VOLUME);
+		} else {
+			if (section->offset < ccm.dataBeg || section->offset > ccm.dataEnd || section->size > ccm.dataEnd - section->offset) {
+				job->result = CCM_ERR_OFFSETS; return;
+			}
+
+			res = Ccm_DecodeRLE(ccm.data + (section->offset - ccm.dataBeg), section->size, raw, ccm.rawSize);
+			if (res) { job->result = res; return; }
+		}
+		Ccm_CopyIn(i, raw);
+	}
+}
+
+static void Ccm_WorkerLoop(void) {
+	int i;
+	for (;;) {
+		Mutex_Lock(ccm.mutex);
+		{
+			i = ccm.nextJob++;
+		}
+		Mutex_Unlock(ccm.mutex);
+
+		if (i >= ccm.numJobs) return;
+		ccm.ProcessJob(&ccm.jobs[i]);
+	}
+}
+
+/* Splits the sections into jobs, then processes the jobs across multiple threads */
+static cc_result Ccm_RunJobs(void (*processJob)(struct CcmJob* job)) {
+	void* threads[CCM_MAX_THREADS];
+	int i, numThreads;
+
+	ccm.numJobs = (ccm.count + (CCM_JOB_SECTIONS - 1)) / CCM_JOB_SECTIONS;
+	ccm.nextJob = 0;
+	ccm.jobs    = (struct CcmJob*)Mem_TryAlloc(ccm.numJobs, sizeof(struct CcmJob));
+	if (!ccm.jobs) return ERR_OUT_OF_MEMORY;
+	Mem_Set(ccm.jobs, 0, ccm.numJobs * sizeof(struct CcmJob));
+
+	for (i = 0; i < ccm.numJobs; i++) {
+		ccm.jobs[i].first = i * CCM_JOB_SECTIONS;
+		ccm.jobs[i].count = min(CCM_JOB_SECTIONS, ccm.count - i * CCM_JOB_SECTIONS);
+	}
+	ccm.ProcessJob = processJob;
+	ccm.mutex      = Mutex_Create();
+
+	numThreads = min(Thread_ProcessorCount(), CCM_MAX_THREADS);
+	numThreads = min(numThreads, ccm.numJobs);
+
+	/* Calling thread also processes jobs, so one less thread is needed */
+	for (i = 1; i < numThreads; i++) {
+		threads[i] = Thread_Start(Ccm_WorkerLoop, false);
+	}
+	Ccm_WorkerLoop();
+	for (i = 1; i < numThreads; i++) {
+		Thread_Join(threads[i]);
+	}
+
+	Mutex_Free(ccm.mutex);
+	for (i = 0; i < ccm.numJobs; i++) {
+		if (ccm.jobs[i].result) return ccm.jobs[i].result;
+	}
+	return 0;
+}
+
+static void Ccm_FreeJobs(void) {
+	int i;
+	if (!ccm.jobs) return;
+
+	for (i = 0; i < ccm.numJobs; i++) {
+		Mem_Free(ccm.jobs[i].data);
+	}
+	Mem_Free(ccm.jobs);
+	ccm.jobs = NULL;
+}
+
+static cc_result Ccm_CheckHeader(const cc_uint8* header) {
+	cc_uint32 width, height, length;
+	cc_uint64 volume, count;
+
+	if (header[0] != 'C' || header[1] != 'C' || header[2] != 'M' || header[3] != 'P') return CCM_ERR_SIGNATURE;
+	if (Stream_GetU16_LE(&header[4]) != CCM_VERSION) return CCM_ERR_VERSION;
+
+	width  = Stream_GetU16_LE(&header[8]);
+	height = Stream_GetU16_LE(&header[10]);
+	length = Stream_GetU16_LE(&header[12]);
+	/* Multiplying 16 bit dimensions as int could overflow, so multiply them as 64 bit */
+	volume = (cc_uint64)width * height * length;
+	if (!volume || volume > 0x7FFFFFFFUL) return CCM_ERR_DIMENSIONS;
+
+	/* Both section tables must also fit before the 32 bit offset of the data after them */
+	count = (cc_uint64)Ccm_SectionsAlong(width) * Ccm_SectionsAlong(height) * Ccm_SectionsAlong(length);
+	if (2 * (CCM_HEADER_SIZE + count * CCM_ENTRY_SIZE) > 0x7FFFFFFFUL) return CCM_ERR_DIMENSIONS;
+	return 0;
+}
+
+static void Ccm_DecodeTable(const cc_uint8* table) {
+	int i;
+	for (i = 0; i < ccm.count; i++) {
+		ccm.sections[i].offset   = Stream_GetU32_LE(&table[i * CCM_ENTRY_SIZE + 0]);
+		ccm.sections[i].capacity = Stream_GetU32_LE(&table[i * CCM_ENTRY_SIZE + 4]);
+		ccm.sections[i].size     = Stream_GetU16_LE(&table[i * CCM_ENTRY_SIZE + 8]);
+		ccm.sections[i].block    = Stream_GetU16_LE(&table[i * CCM_ENTRY_SIZE + 10]);
+	}
+}
+
+static void Ccm_EncodeTable(cc_uint8* table) {
+	int i;
+	for (i = 0; i < ccm.count; i++) {
+		Stream_SetU32_LE(&table[i * CCM_ENTRY_SIZE + 0],  ccm.sections[i].offset);
+		Stream_SetU32_LE(&table[i * CCM_ENTRY_SIZE + 4],  ccm.sections[i].capacity);
+		Stream_SetU16_LE(&table[i * CCM_ENTRY_SIZE + 8],  ccm.sections[i].size);
+		Stream_SetU16_LE(&table[i * CCM_ENTRY_SIZE + 10], ccm.sections[i].block);
+	}
+}
+
+static cc_uint32 Ccm_Checksum(const cc_uint8* header, const cc_uint8* table) {
+	cc_uint32 crc = 0xFFFFFFFFUL;
+	crc = Utils_Crc32Update(crc, header, CCM_HEADER_SIZE - 4);
+	crc = Utils_Crc32Update(crc, table,  ccm.count * CCM_ENTRY_SIZE);
+	return crc ^ 0xFFFFFFFFUL;
+}
+
+/* Reads both headers and section tables, then decodes the section table of the newest valid header */
+/* NOTE: ccm state is initialised using the dimensions in the headers */
+static cc_result Ccm_ReadRoots(struct Stream* stream, cc_uint8* headers, int* live) {
+	cc_uint32 size, generation = 0;
+	cc_uint8* header;
+	cc_uint8* tables;
+	cc_result res;
+	int i;
+
+	ccm.sections = NULL;
+	ccm.data     = NULL;
+	if ((res = Stream_Read(stream, headers, 2 * CCM_HEADER_SIZE))) return res;
+
+	/* Saving may have been interrupted while writing a header, so use whichever one looks valid */
+	header = headers;
+	if ((res = Ccm_CheckHeader(header))) {
+		header = headers + CCM_HEADER_SIZE;
+		if (Ccm_CheckHeader(header)) return res;
+	}
+	Ccm_InitState(Stream_GetU16_LE(&header[8]), Stream_GetU16_LE(&header[10]), 
+				Stream_GetU16_LE(&header[12]), NULL, NULL);
+
+	size   = ccm.count * CCM_ENTRY_SIZE;
+	tables = (cc_uint8*)Mem_TryAlloc(2 * size, 1);
+	if (!tables) return ERR_OUT_OF_MEMORY;
+	if ((res = Stream_Read(stream, tables, 2 * size))) { Mem_Free(tables); return res; }
+
+	*live = -1;
+	for (i = 0; i < 2; i++) {
+		header = headers + i * CCM_HEADER_SIZE;
+		if (Ccm_CheckHeader(header)) continue;
+		if (Stream_GetU16_LE(&header[8])  != ccm.width  || Stream_GetU16_LE(&header[10]) != ccm.height ||
+			Stream_GetU16_LE(&header[12]) != ccm.length) continue;
+		if (Ccm_Checksum(header, tables + i * size) != Stream_GetU32_LE(&header[36])) continue;
+
+		if (*live >= 0 && Stream_GetU32_LE(&header[32]) <= generation) continue;
+		*live      = i;
+		generation = Stream_GetU32_LE(&header[32]);
+	}
+
+	if (*live == -1) {
+		res = CCM_ERR_CHECKSUM;
+	} else {
+		ccm.sections = (struct CcmSection*)Mem_TryAlloc(ccm.count, sizeof(struct CcmSection));
+		if (ccm.sections) Ccm_DecodeTable(tables + *live * size);
+		else res = ERR_OUT_OF_MEMORY;
+	}
+	Mem_Free(tables);
+	return res;
+}
+
+static void Ccm_MakeHeader(cc_uint8* header, const cc_uint8* table, cc_uint32 metaOffset, cc_uint32 metaSize, 
+							cc_uint32 metaCapacity, cc_uint32 end, cc_uint32 generation) {
+	header[0] = 'C'; header[1] = 'C'; header[2] = 'M'; header[3] = 'P';
+	Stream_SetU16_LE(&header[4],  CCM_VERSION);
+	Stream_SetU16_LE(&header[6],  ccm.blocks2 ? 1 : 0);
+	Stream_SetU16_LE(&header[8],  ccm.width);
+	Stream_SetU16_LE(&header[10], ccm.height);
+	Stream_SetU16_LE(&header[12], ccm.length);
+	Stream_SetU16_LE(&header[14], 0);
+
+	Stream_SetU32_LE(&header[16], metaOffset);
+	Stream_SetU32_LE(&header[20], metaSize);
+	Stream_SetU32_LE(&header[24], metaCapacity);
+	Stream_SetU32_LE(&header[28], end);
+	Stream_SetU32_LE(&header[32], generation);
+	Stream_SetU32_LE(&header[36], Ccm_Checksum(header, table));
+}
+
+/* Writes the ClassicWorld root tag (without any block arrays) into the given buffer */
+static cc_result Ccm_EncodeMeta(cc_uint8* data, cc_uint32* size) {
+	struct Stream stream;
+	cc_result res;
+
+	Stream_WriteonlyMemory(&stream, data, CCM_MAX_META);
+	if ((res = Cw_WriteBegin(&stream)))    return res;
+	if ((res = Cw_WriteMetadata(&stream))) return res;
+
+	*size = CCM_MAX_META - stream.Meta.Mem.Left;
+	return 0;
+}
+
+static cc_result Ccm_GetArray(struct NbtTag* tag, cc_uint8** data) { return 0; }
+
+cc_result Ccm_Load(struct Stream* stream) {
+	static const struct NbtReader reader = { Cw_Callback, Ccm_GetArray };
+	cc_uint8 headers[2 * CCM_HEADER_SIZE];
+	cc_uint8* header;
+	cc_uint32 metaOffset, metaSize;
+	struct Stream metaStream;
+	BlockRaw* blocks2 = NULL;
+	cc_result res;
+	int live;
+
+	if ((res = Ccm_ReadRoots(stream, headers, &live))) goto cleanup;
+	header = headers + live * CCM_HEADER_SIZE;
+
+	/* Sections and metadata can be anywhere in the file, so just read it all in */
+	ccm.dataBeg = 2 * (CCM_HEADER_SIZE + ccm.count * CCM_ENTRY_SIZE);
+	ccm.dataEnd = Stream_GetU32_LE(&header[28]);
+	if (ccm.dataEnd < ccm.dataBeg) { res = CCM_ERR_OFFSETS; goto cleanup; }
+
+	ccm.data = (cc_uint8*)Mem_TryAlloc(ccm.dataEnd - ccm.dataBeg + 1, 1);
+	if (!ccm.data) { res = ERR_OUT_OF_MEMORY; goto cleanup; }
+	if ((res = Stream_Read(stream, ccm.data, ccm.dataEnd - ccm.dataBeg))) goto cleanup;
+
+	metaOffset = Stream_GetU32_LE(&header[16]);
+	metaSize   = Stream_GetU32_LE(&header[20]);
+	if (metaOffset < ccm.dataBeg || metaOffset > ccm.dataEnd || metaSize > ccm.dataEnd - metaOffset) {
+		res = CCM_ERR_OFFSETS; goto cleanup;
+	}
+
+	Stream_ReadonlyMemory(&metaStream, ccm.data + (metaOffset - ccm.dataBeg), metaSize);
+	if ((res = Cw_ReadRoot(&metaStream, &reader))) goto cleanup;
+
+	/* Dimensions in the metadata are ignored, since the sections must match header dimensions */
+	World.Width  = ccm.width;
+	World.Height = ccm.height;
+	World.Length = ccm.length;
+	World.Volume = ccm.width * ccm.height * ccm.length;
+
+	map_blocks = (BlockRaw*)Mem_TryAlloc(World.Volume, 1);
+	if (!map_blocks) { res = ERR_OUT_OF_MEMORY; goto cleanup; }
+
+	if (Stream_GetU16_LE(&header[6]) & 1) {
+		blocks2 = (BlockRaw*)Mem_TryAlloc(World.Volume, 1);
+		if (!blocks2) { res = ERR_OUT_OF_MEMORY; goto cleanup; }
+		map_blocks2 = blocks2;
+	}
+
+	ccm.blocks  = map_blocks;
+	ccm.blocks2 = blocks2;
+	ccm.rawSize = blocks2 ? 2 * CCM_SECTION_VOLUME : CCM_SECTION_VOLUME;
+	res = Ccm_RunJobs(Ccm_DecodeJob);
+
+cleanup:
+	Ccm_FreeJobs();
+	Mem_Free(ccm.sections);
+	Mem_Free(ccm.data);
+	return res;
+}
+
+static BlockRaw* Ccm_UpperBlocks(void) {
+#ifdef EXTENDED_BLOCKS
+	if (World.Blocks != World.Blocks2) return World.Blocks2;
+#endif
+	return NULL;
+}
+
+cc_result Ccm_Save(struct Stream* stream) {
+	cc_uint8 headers[2 * CCM_HEADER_SIZE];
+	cc_uint32 offset, metaOffset, metaSize, tableSize;
+	struct CcmJob* job;
+	cc_uint8* table;
+	cc_uint8* meta;
+	cc_result res;
+	int i, j;
+
+	Ccm_InitState(World.Width, World.Height, World.Length, World.Blocks, Ccm_UpperBlocks());
+	tableSize    = ccm.count * CCM_ENTRY_SIZE;
+	ccm.sections = (struct CcmSection*)Mem_TryAlloc(ccm.count, sizeof(struct CcmSection));
+	table        = (cc_uint8*)Mem_TryAlloc(tableSize, 1);
+	meta         = (cc_uint8*)Mem_TryAlloc(CCM_MAX_META, 1);
+	if (!ccm.sections || !table || !meta) { res = ERR_OUT_OF_MEMORY; goto cleanup; }
+	Mem_Set(ccm.sections, 0, ccm.count * sizeof(struct CcmSection));
+
+	if ((res = Ccm_RunJobs(Ccm_EncodeJob)))  goto cleanup;
+	if ((res = Ccm_EncodeMeta(meta, &metaSize))) goto cleanup;
+
+	/* Sections are written out in order, immediately after the metadata */
+	metaOffset = 2 * (CCM_HEADER_SIZE + tableSize);
+	offset     = metaOffset + metaSize;
+
+	for (i = 0; i < ccm.numJobs; i++) {
+		job = &ccm.jobs[i];
+		for (j = job->first; j < job->first + job->count; j++) {
+			if (!ccm.sections[j].size) continue;
+			ccm.sections[j].offset   = offset + ccm.sections[j].jobOffset;
+			ccm.sections[j].capacity = ccm.sections[j].size;
+		}
+		offset += job->dataLen;
+	}
+
+	/* Both headers refer to the same data, so either can be replaced by Ccm_SaveSections */
+	Ccm_EncodeTable(table);
+	Ccm_MakeHeader(headers,                   table, metaOffset, metaSize, metaSize, offset, 1);
+	Ccm_MakeHeader(headers + CCM_HEADER_SIZE, table, metaOffset, metaSize, metaSize, offset, 0);
+
+	if ((res = Stream_Write(stream, headers, 2 * CCM_HEADER_SIZE))) goto cleanup;
+	if ((res = Stream_Write(stream, table, tableSize)))            goto cleanup;
+	if ((res = Stream_Write(stream, table, tableSize)))            goto cleanup;
+	if ((res = Stream_Write(stream, meta, metaSize)))              goto cleanup;
+
+	for (i = 0; i < ccm.numJobs; i++) {
+		job = &ccm.jobs[i];
+		if ((res = Stream_Write(stream, job->data, job->dataLen))) goto cleanup;
+	}
+
+cleanup:
+	Ccm_FreeJobs();
+	Mem_Free(ccm.sections);
+	Mem_Free(table);
+	Mem_Free(meta);
+	return res;
+}
+
+/* Start and end of each slot the current header refers to, sorted by start (see Ccm_FindUsedSlots) */
+static cc_uint32* ccm_slotBegs;
+static cc_uint32* ccm_slotEnds;
+static int ccm_slotsCount, ccm_nextSlot;
+/* Start of the unused space that slots are currently being allocated from */
+static cc_uint32 ccm_freeBeg;
+
+static void Ccm_QuickSortSlots(int left, int right) {
+	cc_uint32* keys   = ccm_slotBegs; cc_uint32 key;
+	cc_uint32* values = ccm_slotEnds; cc_uint32 value;
+
+	while (left < right) {
+		int i = left, j = right;
+		cc_uint32 pivot = keys[(i + j) >> 1];
+
+		/* partition the list */
+		while (i <= j) {
+			while (pivot > keys[i]) i++;
+			while (pivot < keys[j]) j--;
+			QuickSort_Swap_KV_Maybe();
+		}
+		/* recurse into the smaller subset */
+		QuickSort_Recurse(Ccm_QuickSortSlots)
+	}
+}
+
+/* Finds the slots used by the sections and metadata the current header refers to */
+/* NOTE: Must be called before the sections are encoded, as that changes their sizes */
+static cc_result Ccm_FindUsedSlots(cc_uint32 metaOffset, cc_uint32 metaCapacity) {
+	struct CcmSection* section;
+	int i, count = 0;
+
+	ccm_slotBegs = (cc_uint32*)Mem_TryAlloc(ccm.count + 1, sizeof(cc_uint32));
+	ccm_slotEnds = (cc_uint32*)Mem_TryAlloc(ccm.count + 1, sizeof(cc_uint32));
+	if (!ccm_slotBegs || !ccm_slotEnds) return ERR_OUT_OF_MEMORY;
+
+	for (i = 0; i < ccm.count; i++) {
+		section = &ccm.sections[i];
+		if (!section->size) continue;
+
+		ccm_slotBegs[count] = section->offset;
+		ccm_slotEnds[count] = section->offset + section->capacity;
+		count++;
+	}
+	ccm_slotBegs[count] = metaOffset;
+	ccm_slotEnds[count] = metaOffset + metaCapacity;
+	count++;
+
+	Ccm_QuickSortSlots(0, count - 1);
+	ccm_slotsCount = count;
+	ccm_nextSlot   = 0;
+	ccm_freeBeg    = 2 * (CCM_HEADER_SIZE + ccm.count * CCM_ENTRY_SIZE);
+	return 0;
+}
+
+/* Allocates a slot from the space between the used slots, or from the end of the file if there isn't enough */
+/* NOTE: The unused space is only searched forwards, so any skipped space is reused by the next save */
+static void Ccm_AllocSlot(cc_uint32 size, cc_uint32* offset, cc_uint32* capacity, cc_uint32* end) {
+	cc_uint32 freeEnd;
+
+	for (;;) {
+		freeEnd = ccm_nextSlot < ccm_slotsCount ? ccm_slotBegs[ccm_nextSlot] : *end;
+		if (freeEnd >= ccm_freeBeg && freeEnd - ccm_freeBeg >= size) {
+			*offset   = ccm_freeBeg;
+			*capacity = min(Ccm_AlignSlot(size), freeEnd - ccm_freeBeg);
+			ccm_freeBeg += *capacity;
+			return;
+		}
+
+		if (ccm_nextSlot == ccm_slotsCount) break;
+		ccm_freeBeg = max(ccm_freeBeg, ccm_slotEnds[ccm_nextSlot]);
+		ccm_nextSlot++;
+	}
+
+	*offset     = *end;
+	*capacity   = Ccm_AlignSlot(size);
+	*end       += *capacity;
+	ccm_freeBeg = *end;
+}
+
+static cc_result Ccm_WriteSlot(struct Stream* stream, cc_uint32 offset, cc_uint32 capacity, 
+								const cc_uint8* data, cc_uint32 size) {
+	static const cc_uint8 padding[CCM_SLOT_ALIGN] = { 0 };
+	cc_result res;
+
+	if ((res = stream->Seek(stream, offset)))     return res;
+	if ((res = Stream_Write(stream, data, size))) return res;
+	/* Fill up rest of the slot, so the file doesn't end before the end of the last slot */
+	return Stream_Write(stream, padding, min(capacity - size, CCM_SLOT_ALIGN));
+}
+
+cc_result Ccm_SaveSections(struct Stream* stream, const cc_bool* dirty) {
+	cc_uint8 headers[2 * CCM_HEADER_SIZE];
+	cc_uint32 metaOffset, metaSize, metaCapacity, end, tableSize;
+	struct CcmSection* section;
+	struct CcmJob* job;
+	cc_uint8* header;
+	cc_uint8* table = NULL;
+	cc_uint8* meta  = NULL;
+	cc_result res;
+	int i, j, live;
+
+	ccm_slotBegs = NULL;
+	ccm_slotEnds = NULL;
+	if ((res = stream->Seek(stream, 0)))               return res;
+	if ((res = Ccm_ReadRoots(stream, headers, &live))) goto cleanup;
+	header = headers + live * CCM_HEADER_SIZE;
+
+	/* Layout of the sections is different, so the whole map needs to be saved again */
+	if (ccm.width != World.Width || ccm.height != World.Height || ccm.length != World.Length ||
+		(Stream_GetU16_LE(&header[6]) & 1) != (Ccm_UpperBlocks() != NULL)) {
+		res = CCM_ERR_DIMENSIONS; goto cleanup;
+	}
+	Ccm_InitState(World.Width, World.Height, World.Length, World.Blocks, Ccm_UpperBlocks());
+
+	metaOffset   = Stream_GetU32_LE(&header[16]);
+	metaCapacity = Stream_GetU32_LE(&header[24]);
+	end          = Stream_GetU32_LE(&header[28]);
+	if ((res = Ccm_FindUsedSlots(metaOffset, metaCapacity))) goto cleanup;
+
+	tableSize = ccm.count * CCM_ENTRY_SIZE;
+	table     = (cc_uint8*)Mem_TryAlloc(tableSize, 1);
+	meta      = (cc_uint8*)Mem_TryAlloc(CCM_MAX_META, 1);
+	if (!table || !meta) { res = ERR_OUT_OF_MEMORY; goto cleanup; }
+
+	ccm.dirty = dirty;
+	if ((res = Ccm_RunJobs(Ccm_EncodeJob)))      goto cleanup;
+	if ((res = Ccm_EncodeMeta(meta, &metaSize))) goto cleanup;
+
+	/* Changed sections and metadata are only written into space the current header doesn't refer to */
+	for (i = 0; i < ccm.numJobs; i++) {
+		job = &ccm.jobs[i];
+		for (j = job->first; j < job->first + job->count; j++) {
+			section = &ccm.sections[j];
+			if (!dirty[j]) continue;
+			if (!section->size) { section->offset = 0; section->capacity = 0; continue; }
+
+			Ccm_AllocSlot(section->size, &section->offset, &section->capacity, &end);
+			res = Ccm_WriteSlot(stream, section->offset, section->capacity, 
+								job->data + section->jobOffset, section->size);
+			if (res) goto cleanup;
+		}
+	}
+
+	Ccm_AllocSlot(metaSize, &metaOffset, &metaCapacity, &end);
+	res = Ccm_WriteSlot(stream, metaOffset, metaCapacity, meta, metaSize);
+	if (res) goto cleanup;
+
+	/* Then the older header and its section table are replaced. If saving is interrupted before this, */
+	/*  the current header still refers to unchanged data. If interrupted while replacing them, the */
+	/*  checksum of the older header no longer matches, so the current header is still used instead. */
+	live   = !live;
+	header = headers + live * CCM_HEADER_SIZE;
+	Ccm_EncodeTable(table);
+	Ccm_MakeHeader(header, table, metaOffset, metaSize, metaCapacity, end, 
+					Stream_GetU32_LE(&headers[!live * CCM_HEADER_SIZE + 32]) + 1);
+
+	if ((res = stream->Seek(stream, 2 * CCM_HEADER_SIZE + live * tableSize))) goto cleanup;
+	if ((res = Stream_Write(stream, table, tableSize)))                      goto cleanup;
+	if ((res = stream->Seek(stream, live * CCM_HEADER_SIZE)))                goto cleanup;
+	res = Stream_Write(stream, header, CCM_HEADER_SIZE);
+
+cleanup:
+	Ccm_FreeJobs();
+	Mem_Free(ccm.sections);
+	Mem_Free(ccm_slotBegs);
+	Mem_Free(ccm_slotEnds);
+	Mem_Free(table);
+	Mem_Free(meta);
+	return res;
+}
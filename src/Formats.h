@@ -11,9 +11,19 @@ typedef cc_result (*IMapImporter)(struct Stream* stream);
 /* Attempts to find a suitable importer based on filename. */
 /* Returns NULL if no match found. */
 CC_API IMapImporter Map_FindImporter(const String* path);
-/* Attempts to import the map from the given file. */
+/* Starts importing the map from the given file on a background thread, showing a loading screen. */
 /* NOTE: Uses Map_FindImporter to import based on filename. */
 CC_API void Map_LoadFrom(const String* path);
+/* Progress (0 to 1) of importing the map started by Map_LoadFrom. */
+extern volatile float Map_LoadProgress;
+/* Whether the background thread has finished importing the map started by Map_LoadFrom. */
+extern volatile cc_bool Map_LoadDone;
+/* Replaces the current world with the imported map, or shows why importing it failed. */
+/* NOTE: Must only be called on the main thread, after Map_LoadDone has been set to true. */
+void Map_EndLoad(void);
+/* Replaces the current world with the map imported from the given stream, on the calling thread. */
+/* NOTE: Unlike Map_LoadFrom, does not reset the game or move the player. (e.g. for converting maps) */
+CC_API cc_result Map_Import(IMapImporter importer, struct Stream* stream);
 
 /* Imports a world from a .lvl MCSharp server map file. */
 /* Used by MCSharp/MCLawl/MCForge/MCDzienny/MCGalaxy. */
@@ -27,10 +37,23 @@ cc_result Cw_Load(struct Stream* stream);
 /* Imports a world from a .dat classic map file. */
 /* Used by Minecraft Classic/WoM client. */
 cc_result Dat_Load(struct Stream* stream);
+/* Imports a world from a .schematic Schematic map file. */
+/* Used by MCEdit and other tools. */
+cc_result Schematic_Load(struct Stream* stream);
+/* Imports a world from a .ccm ClassiCube chunked map file. */
+cc_result Ccm_Load(struct Stream* stream);
 
 /* Exports a world to a .cw ClassicWorld map file. */
 /* Compatible with ClassiCube/ClassicalSharp. */
 cc_result Cw_Save(struct Stream* stream);
+/* Exports a world to a .ccm ClassiCube chunked map file. */
+/* Map is split into 16x16x16 sections, which are compressed independently. */
+cc_result Ccm_Save(struct Stream* stream);
+/* Writes only the given sections (and metadata) of an existing .ccm map file. */
+/* dirty is indexed by section, in YZX order. Stream must be readable, writable and seekable. */
+/* NOTE: Data the last save refers to is never overwritten, so the file stays valid if saving is interrupted. */
+/* NOTE: Returns CCM_ERR_DIMENSIONS if the file is for different dimensions than the current map. */
+cc_result Ccm_SaveSections(struct Stream* stream, const cc_bool* dirty);
 /* Exports a world to a .schematic Schematic map file. */
 /* Used by MCEdit and other tools. */
 cc_result Schematic_Save(struct Stream* stream);
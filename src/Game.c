@@ -2,6 +2,8 @@
 #include "Block.h"
 #include "World.h"
 #include "Lighting.h"
+#include "BlockPhysics.h"
+#include "Physics.h"
 #include "MapRenderer.h"
 #include "Graphics.h"
 #include "Camera.h"
@@ -207,6 +209,8 @@ void Game_UpdateBlock(int x, int y, int z, BlockID block) {
 		EnvRenderer_OnBlockChanged(x, y, z, old, block);
 	}
 	Lighting_OnBlockChanged(x, y, z, old, block);
+	Physics_OnBlockUpdated(x, y, z, old, block);
+	Searcher_OnBlockChanged(x, y, z, block);
 
 	/* Refresh the chunk the block was located in. */
 	chunk = MapRenderer_GetChunk(cx, cy, cz);
@@ -450,6 +454,7 @@ static void Game_Load(void) {
 	Game_AddComponent(&Entities_Component);
 	Game_AddComponent(&Http_Component);
 	Game_AddComponent(&Lighting_Component);
+	Game_AddComponent(&Searcher_Component);
 
 	Game_AddComponent(&Animations_Component);
 	Game_AddComponent(&Inventory_Component);
@@ -1,10 +1,19 @@
 #include "Generator.h"
 #include "BlockID.h"
 #include "ExtMath.h"
-#include "Funcs.h"
 #include "Platform.h"
 #include "World.h"
 #include "Utils.h"
+/* NOTE: NEON is only used on ARM64, as 32 bit ARM NEON flushes denormals to zero */
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define NOISE_SSE2
+#include <emmintrin.h>
+#elif defined __aarch64__ && defined __ARM_NEON
+#define NOISE_NEON
+#include <arm_neon.h>
+#endif
+/* Must be after SIMD headers, as in C++ they end up #undef-ing min and max */
+#include "Funcs.h"
 
 volatile float Gen_CurrentProgress;
 volatile const char* Gen_CurrentState;
@@ -111,6 +120,104 @@ static float ImprovedNoise_Calc(const cc_uint8* p, float x, float y) {
 	return c1 + v * (c2 - c1);
 }
 
+/* Batch evaluation processes 4 samples at once using SIMD, performing the exact same sequence of */
+/*  floating point operations as ImprovedNoise_Calc so that results are identical to the scalar path. */
+#if defined NOISE_SSE2
+#define NOISE_SIMD
+typedef __m128  NoiseVec;
+typedef __m128i NoiseIVec;
+#define NoiseVec_Load(ptr)      _mm_loadu_ps(ptr)
+#define NoiseVec_Store(ptr, a)  _mm_storeu_ps(ptr, a)
+#define NoiseVec_Set(value)     _mm_set1_ps(value)
+#define NoiseVec_Add(a, b)      _mm_add_ps(a, b)
+#define NoiseVec_Sub(a, b)      _mm_sub_ps(a, b)
+#define NoiseVec_Mul(a, b)      _mm_mul_ps(a, b)
+#define NoiseVec_FromInt(a)     _mm_cvtepi32_ps(a)
+#define NoiseIVec_Store(ptr, a) _mm_storeu_si128((__m128i*)(ptr), a)
+/* Same as 'x >= 0 ? (int)x : (int)x - 1' (less than comparison gives -1 in lanes where x < 0) */
+#define NoiseVec_Floor(a)       _mm_add_epi32(_mm_cvttps_epi32(a), _mm_castps_si128(_mm_cmplt_ps(a, _mm_setzero_ps())))
+#elif defined NOISE_NEON
+#define NOISE_SIMD
+typedef float32x4_t NoiseVec;
+typedef int32x4_t   NoiseIVec;
+#define NoiseVec_Load(ptr)      vld1q_f32(ptr)
+#define NoiseVec_Store(ptr, a)  vst1q_f32(ptr, a)
+#define NoiseVec_Set(value)     vdupq_n_f32(value)
+#define NoiseVec_Add(a, b)      vaddq_f32(a, b)
+#define NoiseVec_Sub(a, b)      vsubq_f32(a, b)
+#define NoiseVec_Mul(a, b)      vmulq_f32(a, b)
+#define NoiseVec_FromInt(a)     vcvtq_f32_s32(a)
+#define NoiseIVec_Store(ptr, a) vst1q_s32(ptr, a)
+#define NoiseVec_Floor(a)       vaddq_s32(vcvtq_s32_f32(a), vreinterpretq_s32_u32(vcltq_f32(a, vdupq_n_f32(0.0f))))
+#endif
+
+#ifdef NOISE_SIMD
+#define NoiseVec_Fade(t) NoiseVec_Mul(NoiseVec_Mul(NoiseVec_Mul(t, t), t), \
+	NoiseVec_Add(NoiseVec_Mul(t, NoiseVec_Sub(NoiseVec_Mul(t, six), fifteen)), ten))
+#define NoiseVec_Grad(corner, x, y) NoiseVec_Add(NoiseVec_Mul(NoiseVec_Load(gradX[corner]), x), NoiseVec_Mul(NoiseVec_Load(gradY[corner]), y))
+#define Noise_StoreGrad(corner, value) gradX[corner][j] = noise_gradX[value & 0xF]; gradY[corner][j] = noise_gradY[value & 0xF];
+
+/* Unpacked versions of xFlags and yFlags */
+static const float noise_gradX[16] = { 1, -1,  1, -1, 1, -1, 1, -1, 0,  0, 0,  0, 1,  0, -1,  0 };
+static const float noise_gradY[16] = { 1,  1, -1, -1, 0,  0, 0,  0, 1, -1, 1, -1, 1, -1,  1, -1 };
+#endif
+
+/* Adds ImprovedNoise_Calc(p, xs[i] * freq, ys[i] * freq) * amplitude to sums[i] for each sample */
+static void ImprovedNoise_AddBatch(const cc_uint8* p, const float* xs, const float* ys, int count, 
+									float freq, float amplitude, float* sums) {
+	int i = 0;
+#ifdef NOISE_SIMD
+	NoiseVec six = NoiseVec_Set(6.0f), fifteen = NoiseVec_Set(15.0f), ten = NoiseVec_Set(10.0f), one = NoiseVec_Set(1.0f);
+	NoiseVec vFreq = NoiseVec_Set(freq), vAmplitude = NoiseVec_Set(amplitude);
+	NoiseVec x, y, x1, y1, u, v, g22, g12, g21, g11, c1, c2;
+	NoiseIVec xFloorV, yFloorV;
+	int xFloor[4], yFloor[4];
+	/* Gradient of each corner of the cell, for each of the 4 samples */
+	float gradX[4][4], gradY[4][4];
+	int j, X, Y, A, B;
+
+	for (; i + 4 <= count; i += 4) {
+		x = NoiseVec_Mul(NoiseVec_Load(xs + i), vFreq);
+		y = NoiseVec_Mul(NoiseVec_Load(ys + i), vFreq);
+
+		xFloorV = NoiseVec_Floor(x); NoiseIVec_Store(xFloor, xFloorV);
+		yFloorV = NoiseVec_Floor(y); NoiseIVec_Store(yFloor, yFloorV);
+		x = NoiseVec_Sub(x, NoiseVec_FromInt(xFloorV));
+		y = NoiseVec_Sub(y, NoiseVec_FromInt(yFloorV));
+
+		/* Permutation table lookups can't be vectorised, so calculate the gradients for each sample separately */
+		for (j = 0; j < 4; j++) {
+			X = xFloor[j] & 0xFF; Y = yFloor[j] & 0xFF;
+			A = p[X] + Y; B = p[X + 1] + Y;
+
+			Noise_StoreGrad(0, p[p[A]]);
+			Noise_StoreGrad(1, p[p[B]]);
+			Noise_StoreGrad(2, p[p[A + 1]]);
+			Noise_StoreGrad(3, p[p[B + 1]]);
+		}
+
+		u  = NoiseVec_Fade(x);
+		v  = NoiseVec_Fade(y);
+		x1 = NoiseVec_Sub(x, one);
+		y1 = NoiseVec_Sub(y, one);
+
+		g22 = NoiseVec_Grad(0, x,  y);
+		g12 = NoiseVec_Grad(1, x1, y);
+		c1  = NoiseVec_Add(g22, NoiseVec_Mul(u, NoiseVec_Sub(g12, g22)));
+		g21 = NoiseVec_Grad(2, x,  y1);
+		g11 = NoiseVec_Grad(3, x1, y1);
+		c2  = NoiseVec_Add(g21, NoiseVec_Mul(u, NoiseVec_Sub(g11, g21)));
+
+		c1 = NoiseVec_Add(c1, NoiseVec_Mul(v, NoiseVec_Sub(c2, c1)));
+		NoiseVec_Store(sums + i, NoiseVec_Add(NoiseVec_Load(sums + i), NoiseVec_Mul(c1, vAmplitude)));
+	}
+#endif
+
+	for (; i < count; i++) {
+		sums[i] += ImprovedNoise_Calc(p, xs[i] * freq, ys[i] * freq) * amplitude;
+	}
+}
+
 
 struct OctaveNoise { cc_uint8 p[8][NOISE_TABLE_SIZE]; int octaves; };
 static void OctaveNoise_Init(struct OctaveNoise* n, RNGState* rnd, int octaves) {
@@ -135,6 +242,19 @@ static float OctaveNoise_Calc(const struct OctaveNoise* n, float x, float y) {
 	return sum;
 }
 
+/* Calculates OctaveNoise_Calc(n, xs[i], ys[i]) for each sample */
+static void OctaveNoise_CalcBatch(const struct OctaveNoise* n, const float* xs, const float* ys, int count, float* results) {
+	float amplitude = 1, freq = 1;
+	int i;
+	for (i = 0; i < count; i++) { results[i] = 0; }
+
+	for (i = 0; i < n->octaves; i++) {
+		ImprovedNoise_AddBatch(n->p[i], xs, ys, count, freq, amplitude, results);
+		amplitude *= 2.0f;
+		freq *= 0.5f;
+	}
+}
+
 
 struct CombinedNoise { struct OctaveNoise noise1, noise2; };
 static void CombinedNoise_Init(struct CombinedNoise* n, RNGState* rnd, int octaves1, int octaves2) {
@@ -142,20 +262,79 @@ static void CombinedNoise_Init(struct CombinedNoise* n, RNGState* rnd, int octav
 	OctaveNoise_Init(&n->noise2, rnd, octaves2);
 }
 
-static float CombinedNoise_Calc(const struct CombinedNoise* n, float x, float y) {
-	float offset = OctaveNoise_Calc(&n->noise2, x, y);
-	return OctaveNoise_Calc(&n->noise1, x + offset, y);
+/* Calculates noise1(xs[i] + noise2(xs[i], ys[i]), ys[i]) for each sample, using offsets as temp storage */
+static void CombinedNoise_CalcBatch(const struct CombinedNoise* n, const float* xs, const float* ys, int count, 
+									float* results, float* offsets) {
+	int i;
+	OctaveNoise_CalcBatch(&n->noise2, xs, ys, count, offsets);
+	for (i = 0; i < count; i++) { offsets[i] = xs[i] + offsets[i]; }
+	OctaveNoise_CalcBatch(&n->noise1, offsets, ys, count, results);
 }
 
 
 /*########################################################################################################################*
 *----------------------------------------------------Notchy map gen-------------------------------------------------------*
 *#########################################################################################################################*/
-static int waterLevel, minHeight;
+static int waterLevel, minHeight, minStoneY;
 static cc_int16* Heightmap;
 static RNGState rnd;
+static struct CombinedNoise heightLow, heightHigh;
+static struct OctaveNoise heightSelect, dirtNoise, sandNoise, gravelNoise;
+
+/* Column independent stages are split into tiles of rows along the Z axis, which are then */
+/*  processed across multiple threads. Each tile only ever writes to its own rows of the map */
+#define GEN_TILE_ROWS   16
+#define GEN_MAX_THREADS 16
+typedef void (*NotchyGen_ProcessTile)(int zBeg, int zEnd);
+
+static struct NotchyGenTiles {
+	NotchyGen_ProcessTile Process;
+	int numTiles, nextTile;
+	cc_bool reportProgress;
+	void* mutex;
+} tiles;
+
+static void NotchyGen_WorkerLoop(void) {
+	int i, zBeg;
+	for (;;) {
+		Mutex_Lock(tiles.mutex);
+		{
+			i = tiles.nextTile++;
+			if (tiles.reportProgress && i < tiles.numTiles) {
+				Gen_CurrentProgress = (float)i / tiles.numTiles;
+			}
+		}
+		Mutex_Unlock(tiles.mutex);
+
+		if (i >= tiles.numTiles) return;
+		zBeg = i * GEN_TILE_ROWS;
+		tiles.Process(zBeg, min(zBeg + GEN_TILE_ROWS, World.Length));
+	}
+}
+
+static void NotchyGen_RunTiles(NotchyGen_ProcessTile process, cc_bool reportProgress) {
+	void* threads[GEN_MAX_THREADS];
+	int i, numThreads;
 
-static void NotchyGen_FillOblateSpheroid(int x, int y, int z, float radius, BlockRaw block) {
+	tiles.Process  = process;
+	tiles.numTiles = (World.Length + (GEN_TILE_ROWS - 1)) / GEN_TILE_ROWS;
+	tiles.nextTile = 0;
+	tiles.reportProgress = reportProgress;
+
+	numThreads = min(Thread_ProcessorCount(), GEN_MAX_THREADS);
+	numThreads = min(numThreads, tiles.numTiles);
+
+	/* Calling thread also processes tiles, so one less thread is needed */
+	for (i = 1; i < numThreads; i++) {
+		threads[i] = Thread_Start(NotchyGen_WorkerLoop, false);
+	}
+	NotchyGen_WorkerLoop();
+	for (i = 1; i < numThreads; i++) {
+		Thread_Join(threads[i]);
+	}
+}
+
+static void NotchyGen_FillOblateSpheroid(int x, int y, int z, float radius, BlockRaw block, int tileBeg, int tileEnd) {
 	int xBeg = Math_Floor(max(x - radius, 0));
 	int xEnd = Math_Floor(min(x + radius, World.MaxX));
 	int yBeg = Math_Floor(max(y - radius, 0));
@@ -167,6 +346,11 @@ static void NotchyGen_FillOblateSpheroid(int x, int y, int z, float radius, Bloc
 	int index;
 	int xx, yy, zz, dx, dy, dz;
 
+	/* Only fill in the part of the spheroid that lies inside the tile */
+	zBeg = max(zBeg, tileBeg);
+	zEnd = min(zEnd, tileEnd - 1);
+	if (zBeg > zEnd) return;
+
 	for (yy = yBeg; yy <= yEnd; yy++) { dy = yy - y;
 		for (zz = zBeg; zz <= zEnd; zz++) { dz = zz - z;
 			for (xx = xBeg; xx <= xEnd; xx++) { dx = xx - x;
@@ -181,63 +365,140 @@ static void NotchyGen_FillOblateSpheroid(int x, int y, int z, float radius, Bloc
 	}
 }
 
-#define STACK_FAST 8192
-static void NotchyGen_FloodFill(int index, BlockRaw block) {
-	cc_int32* stack;
-	cc_int32 stack_default[STACK_FAST]; /* try to avoid malloc if we can */
-	int count = 0, limit = STACK_FAST;
-	int x, y, z;
+/* Caves and ore veins still consume the RNG serially, but queue up their spheroids instead of filling them */
+/*  immediately. Since a spheroid only ever replaces stone, the order they are filled in does not matter */
+#define GEN_MAX_SPHEROIDS 16384
+struct NotchyGenSpheroid { int x, y, z, zMin, zMax; float radius; };
+static struct NotchyGenSpheroid* spheroids;
+static int numSpheroids;
+static BlockRaw spheroidBlock;
+
+static void NotchyGen_FillSpheroidsTile(int zBeg, int zEnd) {
+	struct NotchyGenSpheroid* s;
+	int i;
 
-	stack = stack_default;
-	if (index < 0) return; /* y below map, don't bother starting */
-	stack[count++] = index;
+	for (i = 0; i < numSpheroids; i++) {
+		s = &spheroids[i];
+		if (s->zMax < zBeg || s->zMin >= zEnd) continue;
+		NotchyGen_FillOblateSpheroid(s->x, s->y, s->z, s->radius, spheroidBlock, zBeg, zEnd);
+	}
+}
 
-	while (count) {
-		index = stack[--count];
+static void NotchyGen_FlushSpheroids(void) {
+	if (!numSpheroids) return;
+	NotchyGen_RunTiles(NotchyGen_FillSpheroidsTile, false);
+	numSpheroids = 0;
+}
 
-		if (Gen_Blocks[index] != BLOCK_AIR) continue;
-		Gen_Blocks[index] = block;
+static void NotchyGen_QueueSpheroid(int x, int y, int z, float radius) {
+	struct NotchyGenSpheroid* s;
+	if (numSpheroids == GEN_MAX_SPHEROIDS) NotchyGen_FlushSpheroids();
+
+	s = &spheroids[numSpheroids++];
+	s->x = x; s->y = y; s->z = z; s->radius = radius;
+	/* Quickly rejects spheroids that are outside a tile */
+	s->zMin = Math_Floor(z - radius);
+	s->zMax = Math_Floor(z + radius);
+}
 
-		x = index  % World.Width;
-		y = index  / World.OneY;
-		z = (index / World.Width) % World.Length;
+/* Flood fill works on runs of air along the X axis, so only the start of each run needs to be queued */
+struct FloodSeed { int x, y, z; };
+struct FloodStack { struct FloodSeed* seeds; int count, limit; };
+#define STACK_FAST 2048
+
+/* Queues the start of each run of air blocks between x1 and x2 in the given row */
+static void NotchyGen_QueueRuns(struct FloodStack* stack, int x1, int x2, int y, int z) {
+	BlockRaw* row = Gen_Blocks + World_Pack(0, y, z);
+	struct FloodSeed* seed;
+	int x;
+
+	for (x = x1; x <= x2; x++) {
+		if (row[x] != BLOCK_AIR) continue;
 
 		/* need to increase stack */
-		if (count >= limit - FACE_COUNT) {
-			Utils_Resize((void**)&stack, &limit, 4, STACK_FAST, STACK_FAST);
+		if (stack->count == stack->limit) {
+			Utils_Resize((void**)&stack->seeds, &stack->limit, sizeof(struct FloodSeed), STACK_FAST, STACK_FAST);
 		}
+		seed = &stack->seeds[stack->count++];
+		seed->x = x; seed->y = y; seed->z = z;
+
+		/* skip past rest of this run */
+		while (x < x2 && row[x + 1] == BLOCK_AIR) x++;
+	}
+}
 
-		if (x > 0)          { stack[count++] = index - 1; }
-		if (x < World.MaxX) { stack[count++] = index + 1; }
-		if (z > 0)          { stack[count++] = index - World.Width; }
-		if (z < World.MaxZ) { stack[count++] = index + World.Width; }
-		if (y > 0)          { stack[count++] = index - World.OneY; }
+static void NotchyGen_FloodFill(int x, int y, int z, BlockRaw block) {
+	struct FloodSeed stack_default[STACK_FAST]; /* try to avoid malloc if we can */
+	struct FloodStack stack;
+	struct FloodSeed* seed;
+	BlockRaw* row;
+	int x1, x2;
+
+	if (y < 0) return; /* y below map, don't bother starting */
+	stack.seeds = stack_default;
+	stack.count = 0; stack.limit = STACK_FAST;
+	NotchyGen_QueueRuns(&stack, x, x, y, z);
+
+	while (stack.count) {
+		seed = &stack.seeds[--stack.count];
+		x = seed->x; y = seed->y; z = seed->z;
+
+		row = Gen_Blocks + World_Pack(0, y, z);
+		if (row[x] != BLOCK_AIR) continue;
+
+		/* expand to cover the whole run of air, then fill it in */
+		for (x1 = x; x1 > 0          && row[x1 - 1] == BLOCK_AIR; x1--) {}
+		for (x2 = x; x2 < World.MaxX && row[x2 + 1] == BLOCK_AIR; x2++) {}
+		Mem_Set(row + x1, block, x2 - x1 + 1);
+
+		if (z > 0)          NotchyGen_QueueRuns(&stack, x1, x2, y, z - 1);
+		if (z < World.MaxZ) NotchyGen_QueueRuns(&stack, x1, x2, y, z + 1);
+		if (y > 0)          NotchyGen_QueueRuns(&stack, x1, x2, y - 1, z);
 	}
-	if (limit > STACK_FAST) Mem_Free(stack);
+	if (stack.limit > STACK_FAST) Mem_Free(stack.seeds);
 }
 
 
-static void NotchyGen_CreateHeightmap(void) {
+static void NotchyGen_HeightmapTile(int zBeg, int zEnd) {
 	float hLow, hHigh, height;
-	int hIndex = 0, adjHeight;
-	int x, z;
-	struct CombinedNoise n1, n2;
-	struct OctaveNoise n3;
+	int hIndex = zBeg * World.Width, adjHeight;
+	int tileMin = World.Height, width = World.Width;
+	int x, z, highs;
+	/* Noise is calculated a row at a time in batches */
+	float* rows    = (float*)Mem_Alloc(width * 9, 4, "gen noise rows");
+	float* rawX    = rows + width * 0;
+	float* rawZ    = rows + width * 1;
+	float* scaledX = rows + width * 2;
+	float* scaledZ = rows + width * 3;
+	float* lows    = rows + width * 4;
+	float* selects = rows + width * 5;
+	float* highX   = rows + width * 6;
+	float* high    = rows + width * 7;
+	float* temp    = rows + width * 8;
+
+	for (x = 0; x < width; x++) {
+		rawX[x] = (float)x; scaledX[x] = x * 1.3f;
+	}
 
-	CombinedNoise_Init(&n1, &rnd, 8, 8);
-	CombinedNoise_Init(&n2, &rnd, 8, 8);	
-	OctaveNoise_Init(&n3, &rnd, 6);
+	for (z = zBeg; z < zEnd; z++) {
+		for (x = 0; x < width; x++) {
+			rawZ[x] = (float)z; scaledZ[x] = z * 1.3f;
+		}
+		CombinedNoise_CalcBatch(&heightLow, scaledX, scaledZ, width, lows, temp);
+		OctaveNoise_CalcBatch(&heightSelect, rawX, rawZ, width, selects);
 
-	Gen_CurrentState = "Building heightmap";
-	for (z = 0; z < World.Length; z++) {
-		Gen_CurrentProgress = (float)z / World.Length;
+		/* Only calculate high noise for the columns that actually use it */
+		for (x = 0, highs = 0; x < width; x++) {
+			if (selects[x] <= 0) highX[highs++] = scaledX[x];
+		}
+		CombinedNoise_CalcBatch(&heightHigh, highX, scaledZ, highs, high, temp);
 
-		for (x = 0; x < World.Width; x++) {
-			hLow   = CombinedNoise_Calc(&n1, x * 1.3f, z * 1.3f) / 6 - 4;
+		for (x = 0, highs = 0; x < width; x++) {
+			hLow   = lows[x] / 6 - 4;
 			height = hLow;
 
-			if (OctaveNoise_Calc(&n3, (float)x, (float)z) <= 0) {
-				hHigh = CombinedNoise_Calc(&n2, x * 1.3f, z * 1.3f) / 5 + 6;
+			if (selects[x] <= 0) {
+				hHigh = high[highs++] / 5 + 6;
 				height = max(hLow, hHigh);
 			}
 
@@ -245,10 +506,26 @@ static void NotchyGen_CreateHeightmap(void) {
 			if (height < 0) height *= 0.8f;
 
 			adjHeight = (int)(height + waterLevel);
-			minHeight = min(adjHeight, minHeight);
+			tileMin   = min(adjHeight, tileMin);
 			Heightmap[hIndex++] = adjHeight;
 		}
 	}
+	Mem_Free(rows);
+
+	Mutex_Lock(tiles.mutex);
+	{
+		minHeight = min(tileMin, minHeight);
+	}
+	Mutex_Unlock(tiles.mutex);
+}
+
+static void NotchyGen_CreateHeightmap(void) {
+	CombinedNoise_Init(&heightLow,  &rnd, 8, 8);
+	CombinedNoise_Init(&heightHigh, &rnd, 8, 8);
+	OctaveNoise_Init(&heightSelect, &rnd, 6);
+
+	Gen_CurrentState = "Building heightmap";
+	NotchyGen_RunTiles(NotchyGen_HeightmapTile, true);
 }
 
 static int NotchyGen_CreateStrataFast(void) {
@@ -280,23 +557,25 @@ static int NotchyGen_CreateStrataFast(void) {
 	return max(stoneHeight, 1);
 }
 
-static void NotchyGen_CreateStrata(void) {
-	int dirtThickness, dirtHeight;
-	int minStoneY, stoneHeight;
-	int hIndex = 0, maxY = World.MaxY, index = 0;
+static void NotchyGen_StrataTile(int zBeg, int zEnd) {
+	int dirtThickness, dirtHeight, stoneHeight;
+	int hIndex = zBeg * World.Width, maxY = World.MaxY, index = 0;
+	int width  = World.Width;
 	int x, y, z;
-	struct OctaveNoise n;
+	/* Noise is calculated a row at a time in batches */
+	float* rows       = (float*)Mem_Alloc(width * 3, 4, "gen noise rows");
+	float* rawX       = rows + width * 0;
+	float* rawZ       = rows + width * 1;
+	float* thickness = rows + width * 2;
 
-	/* Try to bulk fill bottom of the map if possible */
-	minStoneY = NotchyGen_CreateStrataFast();
-	OctaveNoise_Init(&n, &rnd, 8);
+	for (x = 0; x < width; x++) { rawX[x] = (float)x; }
 
-	Gen_CurrentState = "Creating strata";
-	for (z = 0; z < World.Length; z++) {
-		Gen_CurrentProgress = (float)z / World.Length;
+	for (z = zBeg; z < zEnd; z++) {
+		for (x = 0; x < width; x++) { rawZ[x] = (float)z; }
+		OctaveNoise_CalcBatch(&dirtNoise, rawX, rawZ, width, thickness);
 
-		for (x = 0; x < World.Width; x++) {
-			dirtThickness = (int)(OctaveNoise_Calc(&n, (float)x, (float)z) / 24 - 4);
+		for (x = 0; x < width; x++) {
+			dirtThickness = (int)(thickness[x] / 24 - 4);
 			dirtHeight    = Heightmap[hIndex++];
 			stoneHeight   = dirtHeight + dirtThickness;
 
@@ -315,6 +594,16 @@ static void NotchyGen_CreateStrata(void) {
 			}
 		}
 	}
+	Mem_Free(rows);
+}
+
+static void NotchyGen_CreateStrata(void) {
+	/* Try to bulk fill bottom of the map if possible */
+	minStoneY = NotchyGen_CreateStrataFast();
+	OctaveNoise_Init(&dirtNoise, &rnd, 8);
+
+	Gen_CurrentState = "Creating strata";
+	NotchyGen_RunTiles(NotchyGen_StrataTile, true);
 }
 
 static void NotchyGen_CarveCaves(void) {
@@ -327,6 +616,7 @@ static void NotchyGen_CarveCaves(void) {
 
 	cavesCount       = World.Volume / 8192;
 	Gen_CurrentState = "Carving caves";
+	spheroidBlock    = BLOCK_AIR;
 	for (i = 0; i < cavesCount; i++) {
 		Gen_CurrentProgress = (float)i / cavesCount;
 
@@ -357,9 +647,10 @@ static void NotchyGen_CarveCaves(void) {
 			radius = (World.Height - cenY) / (float)World.Height;
 			radius = 1.2f + (radius * 3.5f + 1.0f) * caveRadius;
 			radius = radius * Math_SinF(j * MATH_PI / caveLen);
-			NotchyGen_FillOblateSpheroid(cenX, cenY, cenZ, radius, BLOCK_AIR);
+			NotchyGen_QueueSpheroid(cenX, cenY, cenZ, radius);
 		}
 	}
+	NotchyGen_FlushSpheroids();
 }
 
 static void NotchyGen_CarveOreVeins(float abundance, const char* state, BlockRaw block) {
@@ -371,6 +662,7 @@ static void NotchyGen_CarveOreVeins(float abundance, const char* state, BlockRaw
 
 	numVeins         = (int)(World.Volume * abundance / 16384);
 	Gen_CurrentState = state;
+	spheroidBlock    = block;
 	for (i = 0; i < numVeins; i++) {
 		Gen_CurrentProgress = (float)i / numVeins;
 
@@ -393,35 +685,29 @@ static void NotchyGen_CarveOreVeins(float abundance, const char* state, BlockRaw
 			deltaPhi   = deltaPhi   * 0.9f + Random_Float(&rnd) - Random_Float(&rnd);
 
 			radius = abundance * Math_SinF(j * MATH_PI / veinLen) + 1.0f;
-			NotchyGen_FillOblateSpheroid((int)veinX, (int)veinY, (int)veinZ, radius, block);
+			NotchyGen_QueueSpheroid((int)veinX, (int)veinY, (int)veinZ, radius);
 		}
 	}
+	NotchyGen_FlushSpheroids();
 }
 
 static void NotchyGen_FloodFillWaterBorders(void) {
 	int waterY = waterLevel - 1;
-	int index1, index2;
 	int x, z;
 	Gen_CurrentState = "Flooding edge water";
 
-	index1 = World_Pack(0, waterY, 0);
-	index2 = World_Pack(0, waterY, World.Length - 1);
 	for (x = 0; x < World.Width; x++) {
 		Gen_CurrentProgress = 0.0f + ((float)x / World.Width) * 0.5f;
 
-		NotchyGen_FloodFill(index1, BLOCK_WATER);
-		NotchyGen_FloodFill(index2, BLOCK_WATER);
-		index1++; index2++;
+		NotchyGen_FloodFill(x, waterY, 0,          BLOCK_WATER);
+		NotchyGen_FloodFill(x, waterY, World.MaxZ, BLOCK_WATER);
 	}
 
-	index1 = World_Pack(0,             waterY, 0);
-	index2 = World_Pack(World.Width - 1, waterY, 0);
 	for (z = 0; z < World.Length; z++) {
 		Gen_CurrentProgress = 0.5f + ((float)z / World.Length) * 0.5f;
 
-		NotchyGen_FloodFill(index1, BLOCK_WATER);
-		NotchyGen_FloodFill(index2, BLOCK_WATER);
-		index1 += World.Width; index2 += World.Width;
+		NotchyGen_FloodFill(0,          waterY, z, BLOCK_WATER);
+		NotchyGen_FloodFill(World.MaxX, waterY, z, BLOCK_WATER);
 	}
 }
 
@@ -437,7 +723,7 @@ static void NotchyGen_FloodFillWater(void) {
 		x = Random_Next(&rnd, World.Width);
 		z = Random_Next(&rnd, World.Length);
 		y = waterLevel - Random_Range(&rnd, 1, 3);
-		NotchyGen_FloodFill(World_Pack(x, y, z), BLOCK_WATER);
+		NotchyGen_FloodFill(x, y, z, BLOCK_WATER);
 	}
 }
 
@@ -453,23 +739,16 @@ static void NotchyGen_FloodFillLava(void) {
 		x = Random_Next(&rnd, World.Width);
 		z = Random_Next(&rnd, World.Length);
 		y = (int)((waterLevel - 3) * Random_Float(&rnd) * Random_Float(&rnd));
-		NotchyGen_FloodFill(World_Pack(x, y, z), BLOCK_LAVA);
+		NotchyGen_FloodFill(x, y, z, BLOCK_LAVA);
 	}
 }
 
-static void NotchyGen_CreateSurfaceLayer(void) {	
-	int hIndex = 0, index;
+static void NotchyGen_SurfaceTile(int zBeg, int zEnd) {
+	int hIndex = zBeg * World.Width, index;
 	BlockRaw above;
 	int x, y, z;
-	struct OctaveNoise n1, n2;
-
-	OctaveNoise_Init(&n1, &rnd, 8);
-	OctaveNoise_Init(&n2, &rnd, 8);
-
-	Gen_CurrentState = "Creating surface";
-	for (z = 0; z < World.Length; z++) {
-		Gen_CurrentProgress = (float)z / World.Length;
 
+	for (z = zBeg; z < zEnd; z++) {
 		for (x = 0; x < World.Width; x++) {
 			y = Heightmap[hIndex++];
 			if (y < 0 || y >= World.Height) continue;
@@ -478,15 +757,23 @@ static void NotchyGen_CreateSurfaceLayer(void) {
 			above = y >= World.MaxY ? BLOCK_AIR : Gen_Blocks[index + World.OneY];
 
 			/* TODO: update heightmap */
-			if (above == BLOCK_WATER && (OctaveNoise_Calc(&n2, (float)x, (float)z) > 12)) {
+			if (above == BLOCK_WATER && (OctaveNoise_Calc(&gravelNoise, (float)x, (float)z) > 12)) {
 				Gen_Blocks[index] = BLOCK_GRAVEL;
 			} else if (above == BLOCK_AIR) {
-				Gen_Blocks[index] = (y <= waterLevel && (OctaveNoise_Calc(&n1, (float)x, (float)z) > 8)) ? BLOCK_SAND : BLOCK_GRASS;
+				Gen_Blocks[index] = (y <= waterLevel && (OctaveNoise_Calc(&sandNoise, (float)x, (float)z) > 8)) ? BLOCK_SAND : BLOCK_GRASS;
 			}
 		}
 	}
 }
 
+static void NotchyGen_CreateSurfaceLayer(void) {
+	OctaveNoise_Init(&sandNoise,   &rnd, 8);
+	OctaveNoise_Init(&gravelNoise, &rnd, 8);
+
+	Gen_CurrentState = "Creating surface";
+	NotchyGen_RunTiles(NotchyGen_SurfaceTile, true);
+}
+
 static void NotchyGen_PlantFlowers(void) {
 	int numPatches;
 	BlockRaw block;
@@ -608,6 +895,9 @@ static void NotchyGen_PlantTrees(void) {
 void NotchyGen_Generate(void) {
 	Gen_Init();
 	Heightmap = (cc_int16*)Mem_Alloc(World.Width * World.Length, 2, "gen heightmap");
+	spheroids = (struct NotchyGenSpheroid*)Mem_Alloc(GEN_MAX_SPHEROIDS, sizeof(struct NotchyGenSpheroid), "gen spheroids");
+	tiles.mutex  = Mutex_Create();
+	numSpheroids = 0;
 
 	Random_Seed(&rnd, Gen_Seed);
 	waterLevel = World.Height / 2;	
@@ -630,7 +920,10 @@ void NotchyGen_Generate(void) {
 	NotchyGen_PlantTrees();
 
 	Mem_Free(Heightmap);
+	Mem_Free(spheroids);
+	Mutex_Free(tiles.mutex);
 	Heightmap = NULL;
+	spheroids = NULL;
 	Gen_Done  = true;
 }
 
@@ -361,12 +361,6 @@ static cc_bool useBitmappedFont;
 static Bitmap dirtBmp, stoneBmp, fontBmp;
 #define TILESIZE 48
 
-static cc_bool Launcher_SelectZipEntry(const String* path) {
-	return
-		String_CaselessEqualsConst(path, "default.png") ||
-		String_CaselessEqualsConst(path, "terrain.png");
-}
-
 static void Launcher_LoadTextures(Bitmap* bmp) {
 	int tileSize = bmp->Width / 16;
 	Bitmap_Allocate(&dirtBmp,  TILESIZE, TILESIZE);
@@ -380,7 +374,7 @@ static void Launcher_LoadTextures(Bitmap* bmp) {
 	Gradient_Tint(&stoneBmp, 96, 96, 0, 0, TILESIZE, TILESIZE);
 }
 
-static cc_result Launcher_ProcessZipEntry(const String* path, struct Stream* data, struct ZipState* s) {
+static cc_result Launcher_ProcessZipEntry(const String* path, struct Stream* data) {
 	Bitmap bmp;
 	cc_result res;
 
@@ -407,18 +401,35 @@ static cc_result Launcher_ProcessZipEntry(const String* path, struct Stream* dat
 	return 0;
 }
 
+/* Looks up then processes the given entry in the texture pack, if it exists */
+static cc_result Launcher_ExtractZipEntry(struct ZipIndex* index, const String* path) {
+	struct ZipEntryState state;
+	struct Stream data;
+	cc_result res;
+	int i = ZipIndex_Find(index, path);
+
+	if (i == -1) return 0;
+	if ((res = ZipIndex_Open(index, i, &data, &state))) return res;
+	return Launcher_ProcessZipEntry(path, &data);
+}
+
 static void Launcher_ExtractTexturePack(const String* path) {
-	struct ZipState state;
+	static const String defaultPng = String_FromConst("default.png");
+	static const String terrainPng = String_FromConst("terrain.png");
+	struct ZipIndex index;
 	struct Stream stream;
 	cc_result res;
 
 	res = Stream_OpenFile(&stream, path);
 	if (res) { Logger_Warn(res, "opening texture pack"); return; }
 
-	Zip_Init(&state, &stream);
-	state.SelectEntry  = Launcher_SelectZipEntry;
-	state.ProcessEntry = Launcher_ProcessZipEntry;
-	res = Zip_Extract(&state);
+	/* Only need these two entries, so avoid reading through the rest of the archive */
+	res = ZipIndex_Load(&index, &stream);
+	if (!res) {
+		res = Launcher_ExtractZipEntry(&index, &defaultPng);
+		if (!res) res = Launcher_ExtractZipEntry(&index, &terrainPng);
+		ZipIndex_Free(&index);
+	}
 
 	if (res) { Logger_Warn(res, "extracting texture pack"); }
 	stream.Close(&stream);
@@ -157,6 +157,21 @@ static const char* Logger_GetCCErrorDesc(cc_result res) {
 	case NBT_ERR_UNKNOWN:   return "Unknown NBT tag type";
 	case CW_ERR_ROOT_TAG:   return "Invalid root NBT tag";
 	case CW_ERR_STRING_LEN: return "NBT string too long";
+
+	case INF_ERR_BLOCKTYPE:    return "Invalid DEFLATE block type";
+	case INF_ERR_BLOCKLEN:     return "DEFLATE uncompressed block LEN check failed";
+	case INF_ERR_REPEAT_BEG:   return "DEFLATE tried to repeat invalid code length";
+	case INF_ERR_REPEAT_END:   return "DEFLATE tried to repeat past end of code lengths";
+	case INF_ERR_INVALID_CODE: return "Invalid huffman code in DEFLATE data";
+	case INF_ERR_NUM_CODES:    return "Too many huffman codes for bit length";
+
+	case CCM_ERR_SIGNATURE:    return "Invalid .ccm map signature";
+	case CCM_ERR_VERSION:      return "Unsupported .ccm map version";
+	case CCM_ERR_DIMENSIONS:   return "Invalid or mismatched .ccm map dimensions";
+	case CCM_ERR_OFFSETS:      return ".ccm map section or metadata lies outside file";
+	case CCM_ERR_SECTION_DATA: return "Corrupted .ccm map section data";
+	case CCM_ERR_CHECKSUM:     return "No .ccm map header with a valid checksum";
+	case SC_ERR_BLOCKS:        return "Schematic blocks missing or don't match dimensions";
 	}
 	return NULL;
 }
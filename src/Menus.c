@@ -1305,12 +1305,12 @@ finished:
 static void SaveLevelScreen_SaveMap(struct SaveLevelScreen* s, const String* path) {
 	static const String cw = String_FromConst(".cw");
 	struct Stream stream, compStream;
-	struct GZipState state;
+	struct GZipParallelState state;
 	cc_result res;
 
 	res = Stream_CreateFile(&stream, path);
 	if (res) { Logger_Warn2(res, "creating", path); return; }
-	GZip_MakeStream(&compStream, &state, &stream);
+	GZip_MakeParallelStream(&compStream, &state, &stream);
 
 #ifdef CC_BUILD_WEB
 	res = Cw_Save(&compStream);
@@ -1323,6 +1323,8 @@ static void SaveLevelScreen_SaveMap(struct SaveLevelScreen* s, const String* pat
 #endif
 
 	if (res) {
+		/* don't close compressor, as that would write out rest of the partial map */
+		GZip_AbortParallelStream(&state);
 		stream.Close(&stream);
 		Logger_Warn2(res, "encoding", path); return;
 	}
@@ -7,6 +7,8 @@
 #include "Funcs.h"
 #include "Logger.h"
 #include "Entity.h"
+#include "Event.h"
+#include "GameStructs.h"
 
 
 /*########################################################################################################################*
@@ -130,36 +132,223 @@ cc_bool Intersection_RayIntersectsBox(Vec3 origin, Vec3 dir, Vec3 min, Vec3 max,
 static struct SearcherState searcherDefaultStates[SEARCHER_STATES_MIN];
 static cc_uint32 searcherCapacity = SEARCHER_STATES_MIN;
 struct SearcherState* Searcher_States = searcherDefaultStates;
+static int searcherCount;
+
+/* Bit for each block in the world that has solid collision, with each row along the X axis */
+/*  padded to a multiple of 32 bits. This allows quickly skipping over non solid blocks. */
+/* NOTE: Built on demand, as block definitions may change many times after a map is loaded. */
+/*  When they do, only the bits of blocks whose collision actually changed are updated. */
+static cc_uint32* searcher_solid;
+static int searcher_rowWords;
+static cc_bool searcher_stale, searcher_defsChanged;
+/* Whether each block had solid collision when the bits were last built or updated */
+static cc_bool searcher_wasSolid[BLOCK_COUNT];
+
+static void Searcher_FreeSolid(void) {
+	Mem_Free(searcher_solid);
+	searcher_solid = NULL;
+	searcher_stale = true;
+}
+
+static void Searcher_BuildSolid(void) {
+	cc_uint32* row;
+	int i, x, y, z;
+
+	Mem_Free(searcher_solid);
+	searcher_stale       = false;
+	searcher_defsChanged = false;
+	for (i = 0; i < BLOCK_COUNT; i++) {
+		searcher_wasSolid[i] = Blocks.Collide[i] == COLLIDE_SOLID;
+	}
+
+	searcher_rowWords = (World.Width + 31) >> 5;
+	searcher_solid    = (cc_uint32*)Mem_AllocCleared(searcher_rowWords * World.Height * World.Length, 4, "collision solid blocks");
+	row = searcher_solid;
+
+	for (y = 0; y < World.Height; y++) {
+		for (z = 0; z < World.Length; z++, row += searcher_rowWords) {
+			for (x = 0; x < World.Width; x++) {
+				if (Blocks.Collide[World_GetBlock(x, y, z)] != COLLIDE_SOLID) continue;
+				row[x >> 5] |= 1u << (x & 0x1F);
+			}
+		}
+	}
+}
+
+/* Updates the bits of only the blocks whose collision has changed since the bits were built */
+static void Searcher_UpdateSolid(void) {
+	cc_bool changed[BLOCK_COUNT];
+	cc_bool solid, any = false;
+	cc_uint32* row;
+	BlockID block;
+	int i, x, y, z;
+
+	searcher_defsChanged = false;
+	for (i = 0; i < BLOCK_COUNT; i++) {
+		solid      = Blocks.Collide[i] == COLLIDE_SOLID;
+		changed[i] = solid != searcher_wasSolid[i];
+		any       |= changed[i];
+		searcher_wasSolid[i] = solid;
+	}
+	if (!any) return;
+	row = searcher_solid;
+
+	for (y = 0; y < World.Height; y++) {
+		for (z = 0; z < World.Length; z++, row += searcher_rowWords) {
+			for (x = 0; x < World.Width; x++) {
+				block = World_GetBlock(x, y, z);
+				if (!changed[block]) continue;
+
+				if (searcher_wasSolid[block]) {
+					row[x >> 5] |=  (1u << (x & 0x1F));
+				} else {
+					row[x >> 5] &= ~(1u << (x & 0x1F));
+				}
+			}
+		}
+	}
+}
 
-static void Searcher_QuickSort(int left, int right) {
+void Searcher_OnBlockChanged(int x, int y, int z, BlockID block) {
+	cc_uint32* word;
+	if (!searcher_solid || searcher_stale) return;
+	word = &searcher_solid[(y * World.Length + z) * searcher_rowWords + (x >> 5)];
+
+	if (Blocks.Collide[block] == COLLIDE_SOLID) {
+		*word |=  (1u << (x & 0x1F));
+	} else {
+		*word &= ~(1u << (x & 0x1F));
+	}
+}
+
+/* Scratch buffer for sorting, which has the same capacity as Searcher_States */
+static struct SearcherState* searcher_temp;
+
+static void Searcher_InsertionSort(int count) {
 	struct SearcherState* keys = Searcher_States; struct SearcherState key;
+	int i, j;
+
+	for (i = 1; i < count; i++) {
+		key = keys[i];
+		for (j = i - 1; j >= 0 && keys[j].tSquared > key.tSquared; j--) {
+			keys[j + 1] = keys[j];
+		}
+		keys[j + 1] = key;
+	}
+}
+
+/* Sorts states by time to collide, using a radix sort on the bits of each time. */
+/* (as times are never negative, ordering their bits as integers gives the same order) */
+static void Searcher_Sort(int count) {
+	struct SearcherState* src = Searcher_States;
+	struct SearcherState* dst = searcher_temp;
+	struct SearcherState* tmp;
+	int offsets[256];
+	union { float f; cc_uint32 u; } key;
+	int i, shift, digit, total;
+
+	if (count <= 32) { Searcher_InsertionSort(count); return; }
+	if (!searcher_temp) {
+		searcher_temp = (struct SearcherState*)Mem_Alloc(searcherCapacity, sizeof(struct SearcherState), "collision sort states");
+		dst = searcher_temp;
+	}
+
+	for (shift = 0; shift < 32; shift += 8) {
+		Mem_Set(offsets, 0, sizeof(offsets));
+		for (i = 0; i < count; i++) {
+			key.f = src[i].tSquared;
+			offsets[(key.u >> shift) & 0xFF]++;
+		}
+
+		/* Skip this digit when it is the same for all times */
+		key.f = src[0].tSquared;
+		if (offsets[(key.u >> shift) & 0xFF] == count) continue;
+
+		for (i = 0, total = 0; i < 256; i++) {
+			digit = offsets[i]; offsets[i] = total; total += digit;
+		}
+		for (i = 0; i < count; i++) {
+			key.f = src[i].tSquared;
+			dst[offsets[(key.u >> shift) & 0xFF]++] = src[i];
+		}
+		tmp = src; src = dst; dst = tmp;
+	}
+	if (src != Searcher_States) Mem_Copy(Searcher_States, src, count * sizeof(struct SearcherState));
+}
+
+static void Searcher_Add(int x, int y, int z, BlockID block, Vec3* vel, struct AABB* entityBB, struct AABB* entityExtentBB) {
+	struct SearcherState* state;
+	struct AABB blockBB;
+	float xx, yy, zz, tx, ty, tz;
+
+	xx = (float)x; yy = (float)y; zz = (float)z;
+	blockBB.Min = Blocks.MinBB[block];
+	blockBB.Min.X += xx; blockBB.Min.Y += yy; blockBB.Min.Z += zz;
+	blockBB.Max = Blocks.MaxBB[block];
+	blockBB.Max.X += xx; blockBB.Max.Y += yy; blockBB.Max.Z += zz;
+
+	if (!AABB_Intersects(entityExtentBB, &blockBB)) return; /* necessary for non whole blocks. (slabs) */
+	Searcher_CalcTime(vel, entityBB, &blockBB, &tx, &ty, &tz);
+	if (tx > 1.0f || ty > 1.0f || tz > 1.0f) return;
+
+	/* States buffers are reused, so this rarely needs to allocate */
+	if (searcherCount == searcherCapacity) {
+		if (Searcher_States == searcherDefaultStates) {
+			Searcher_States = (struct SearcherState*)Mem_Alloc(searcherCapacity * 2, sizeof(struct SearcherState), "collision search states");
+			Mem_Copy(Searcher_States, searcherDefaultStates, sizeof(searcherDefaultStates));
+		} else {
+			Searcher_States = (struct SearcherState*)Mem_Realloc(Searcher_States, searcherCapacity * 2, sizeof(struct SearcherState), "collision search states");
+		}
+		searcherCapacity *= 2;
+
+		Mem_Free(searcher_temp);
+		searcher_temp = NULL;
+	}
+
+	state    = &Searcher_States[searcherCount];
+	state->X = (x << 3) | (block  & 0x007);
+	state->Y = (y << 4) | ((block & 0x078) >> 3);
+	state->Z = (z << 3) | ((block & 0x380) >> 7);
+	state->tSquared = tx * tx + ty * ty + tz * tz;
+	searcherCount++;
+}
+
+/* Adds blocks in the given row which might be outside the map */
+static void Searcher_AddRowSlow(int minX, int maxX, int y, int z, Vec3* vel, struct AABB* entityBB, struct AABB* entityExtentBB) {
+	BlockID block;
+	int x;
+
+	for (x = minX; x <= maxX; x++) {
+		block = World_GetPhysicsBlock(x, y, z);
+		if (Blocks.Collide[block] != COLLIDE_SOLID) continue;
+		Searcher_Add(x, y, z, block, vel, entityBB, entityExtentBB);
+	}
+}
 
-	while (left < right) {
-		int i = left, j = right;
-		float pivot = keys[(i + j) >> 1].tSquared;
+/* Adds the solid blocks in the given row, skipping over non solid blocks 32 at a time */
+static void Searcher_AddRow(int minX, int maxX, int y, int z, Vec3* vel, struct AABB* entityBB, struct AABB* entityExtentBB) {
+	cc_uint32* row = &searcher_solid[(y * World.Length + z) * searcher_rowWords];
+	cc_uint32 bits;
+	int i, x;
 
-		/* partition the list */
-		while (i <= j) {
-			while (pivot > keys[i].tSquared) i++;
-			while (pivot < keys[j].tSquared) j--;
-			QuickSort_Swap_Maybe();
+	for (i = minX >> 5; i <= (maxX >> 5); i++) {
+		bits = row[i];
+		if (i == (minX >> 5)) bits &= 0xFFFFFFFFu << (minX & 0x1F);
+		if (i == (maxX >> 5)) bits &= 0xFFFFFFFFu >> (0x1F - (maxX & 0x1F));
+
+		for (x = i << 5; bits; ) {
+			if (!(bits & 0xFF)) { bits >>= 8; x += 8; continue; }
+
+			if (bits & 1) Searcher_Add(x, y, z, World_GetBlock(x, y, z), vel, entityBB, entityExtentBB);
+			bits >>= 1; x++;
 		}
-		/* recurse into the smaller subset */
-		QuickSort_Recurse(Searcher_QuickSort);
 	}
 }
 
 int Searcher_FindReachableBlocks(struct Entity* entity, struct AABB* entityBB, struct AABB* entityExtentBB) {
 	Vec3 vel = entity->Velocity;
 	IVec3 min, max;
-	cc_uint32 elements;
-	struct SearcherState* curState;
-	int count;
-
-	BlockID block;
-	struct AABB blockBB;
-	float xx, yy, zz, tx, ty, tz;
-	int x, y, z;
+	int y, z, minX, maxX;
 
 	Entity_GetBounds(entity, entityBB);
 	/* Exact maximum extent the entity can reach, and the equivalent map coordinates. */
@@ -173,44 +362,36 @@ int Searcher_FindReachableBlocks(struct Entity* entity, struct AABB* entityBB, s
 
 	IVec3_Floor(&min, &entityExtentBB->Min);
 	IVec3_Floor(&max, &entityExtentBB->Max);
-	elements = (max.X - min.X + 1) * (max.Y - min.Y + 1) * (max.Z - min.Z + 1);
-
-	if (elements > searcherCapacity) {
-		Searcher_Free();
-		searcherCapacity = elements;
-		Searcher_States  = (struct SearcherState*)Mem_Alloc(elements, sizeof(struct SearcherState), "collision search states");
+	if (World.Blocks) {
+		if (searcher_stale) Searcher_BuildSolid();
+		else if (searcher_defsChanged) Searcher_UpdateSolid();
 	}
-	curState = Searcher_States;
+
+	searcherCount = 0;
+	minX = max(min.X, 0); maxX = min(max.X, World.MaxX);
 
 	/* Order loops so that we minimise cache misses */
 	for (y = min.Y; y <= max.Y; y++) {
 		for (z = min.Z; z <= max.Z; z++) {
-			for (x = min.X; x <= max.X; x++) {
-				block = World_GetPhysicsBlock(x, y, z);
-				if (Blocks.Collide[block] != COLLIDE_SOLID) continue;
-
-				xx = (float)x; yy = (float)y; zz = (float)z;
-				blockBB.Min = Blocks.MinBB[block];
-				blockBB.Min.X += xx; blockBB.Min.Y += yy; blockBB.Min.Z += zz;
-				blockBB.Max = Blocks.MaxBB[block];
-				blockBB.Max.X += xx; blockBB.Max.Y += yy; blockBB.Max.Z += zz;
-
-				if (!AABB_Intersects(entityExtentBB, &blockBB)) continue; /* necessary for non whole blocks. (slabs) */
-				Searcher_CalcTime(&vel, entityBB, &blockBB, &tx, &ty, &tz);
-				if (tx > 1.0f || ty > 1.0f || tz > 1.0f) continue;
-
-				curState->X = (x << 3) | (block  & 0x007);
-				curState->Y = (y << 4) | ((block & 0x078) >> 3);
-				curState->Z = (z << 3) | ((block & 0x380) >> 7);
-				curState->tSquared = tx * tx + ty * ty + tz * tz;
-				curState++;
+			if (!searcher_solid || y < 0 || z < 0 || z >= World.Length) {
+				Searcher_AddRowSlow(min.X, max.X, y, z, &vel, entityBB, entityExtentBB); continue;
 			}
+
+			/* Outside the map horizontally is always bedrock, and above the map is always air */
+			if (min.X < 0) Searcher_AddRowSlow(min.X, -1, y, z, &vel, entityBB, entityExtentBB);
+			if (minX <= maxX) {
+				if (y < World.Height) {
+					Searcher_AddRow(minX, maxX, y, z, &vel, entityBB, entityExtentBB);
+				} else if (Blocks.Collide[BLOCK_AIR] == COLLIDE_SOLID) {
+					Searcher_AddRowSlow(minX, maxX, y, z, &vel, entityBB, entityExtentBB);
+				}
+			}
+			if (max.X > World.MaxX) Searcher_AddRowSlow(World.Width, max.X, y, z, &vel, entityBB, entityExtentBB);
 		}
 	}
 
-	count = (int)(curState - Searcher_States);
-	if (count) Searcher_QuickSort(0, count - 1);
-	return count;
+	Searcher_Sort(searcherCount);
+	return searcherCount;
 }
 
 void Searcher_CalcTime(Vec3* vel, struct AABB *entityBB, struct AABB* blockBB, float* tx, float* ty, float* tz) {
@@ -231,4 +412,28 @@ void Searcher_Free(void) {
 	if (Searcher_States != searcherDefaultStates) Mem_Free(Searcher_States);
 	Searcher_States  = searcherDefaultStates;
 	searcherCapacity = SEARCHER_STATES_MIN;
+
+	Mem_Free(searcher_temp);
+	searcher_temp = NULL;
+}
+
+static void Searcher_OnBlockDefChanged(void* obj) { searcher_defsChanged = true; }
+static void Searcher_OnNewMap(void) { Searcher_FreeSolid(); }
+
+static void Searcher_Init(void) {
+	Event_RegisterVoid(&BlockEvents.BlockDefChanged, NULL, Searcher_OnBlockDefChanged);
+}
+
+static void Searcher_FreeAll(void) {
+	Event_UnregisterVoid(&BlockEvents.BlockDefChanged, NULL, Searcher_OnBlockDefChanged);
+	Searcher_FreeSolid();
+	Searcher_Free();
 }
+
+struct IGameComponent Searcher_Component = {
+	Searcher_Init,     /* Init  */
+	Searcher_FreeAll,  /* Free  */
+	Searcher_OnNewMap, /* Reset */
+	Searcher_OnNewMap, /* OnNewMap */
+	Searcher_OnNewMap  /* OnNewMapLoaded */
+};
@@ -8,6 +8,8 @@
    Copyright 2014-2019 ClassiCube | Licensed under BSD-3
 */
 struct Entity;
+struct IGameComponent;
+extern struct IGameComponent Searcher_Component;
 
 /* Descibes an axis aligned bounding box. */
 struct AABB { Vec3 Min, Max; };
@@ -34,6 +36,8 @@ cc_bool Intersection_RayIntersectsBox(Vec3 origin, Vec3 dir, Vec3 min, Vec3 max,
 struct SearcherState { int X, Y, Z; float tSquared; };
 extern struct SearcherState* Searcher_States;
 int Searcher_FindReachableBlocks(struct Entity* entity, struct AABB* entityBB, struct AABB* entityExtentBB);
+/* Updates which blocks in the world are solid. Called whenever a block in the world is changed. */
+void Searcher_OnBlockChanged(int x, int y, int z, BlockID block);
 void Searcher_CalcTime(Vec3* vel, struct AABB *entityBB, struct AABB* blockBB, float* tx, float* ty, float* tz);
 void Searcher_Free(void);
 #endif
@@ -441,6 +441,15 @@ cc_result File_SetModifiedTime(const String* path, TimeMS time) {
 /* Don't need special execute permission on windows */
 cc_result File_MarkExecutable(const String* path) { return 0; }
 
+cc_result File_Rename(const String* src, const String* dst) {
+	TCHAR srcStr[NATIVE_STR_LEN];
+	TCHAR dstStr[NATIVE_STR_LEN];
+
+	Platform_ConvertString(srcStr, src);
+	Platform_ConvertString(dstStr, dst);
+	return MoveFileEx(srcStr, dstStr, MOVEFILE_REPLACE_EXISTING) ? 0 : GetLastError();
+}
+
 static cc_result File_Do(FileHandle* file, const String* path, DWORD access, DWORD createMode) {
 	TCHAR str[NATIVE_STR_LEN];
 	Platform_ConvertString(str, path);
@@ -573,6 +582,15 @@ cc_result File_MarkExecutable(const String* path) {
 	return chmod(str, st.st_mode) == -1 ? errno : 0;
 }
 
+cc_result File_Rename(const String* src, const String* dst) {
+	char srcStr[NATIVE_STR_LEN];
+	char dstStr[NATIVE_STR_LEN];
+
+	Platform_ConvertString(srcStr, src);
+	Platform_ConvertString(dstStr, dst);
+	return rename(srcStr, dstStr) == -1 ? errno : 0;
+}
+
 static cc_result File_Do(FileHandle* file, const String* path, int mode) {
 	char str[NATIVE_STR_LEN];
 	Platform_ConvertString(str, path);
@@ -650,6 +668,28 @@ void* Thread_Start(Thread_StartFunc* func, cc_bool detach) {
 	return handle;
 }
 
+struct ThreadArgs { Thread_StartArgFunc* func; void* arg; };
+static DWORD WINAPI Thread_StartArgCallback(void* param) {
+	struct ThreadArgs args = *(struct ThreadArgs*)param;
+	Mem_Free(param);
+	args.func(args.arg);
+	return 0;
+}
+
+void* Thread_StartArg(Thread_StartArgFunc* func, void* arg) {
+	struct ThreadArgs* args = (struct ThreadArgs*)Mem_Alloc(1, sizeof(struct ThreadArgs), "thread args");
+	DWORD threadID;
+	void* handle;
+
+	args->func = func;
+	args->arg  = arg;
+	handle = CreateThread(NULL, 0, Thread_StartArgCallback, args, 0, &threadID);
+	if (!handle) {
+		Logger_Abort2(GetLastError(), "Creating thread");
+	}
+	return handle;
+}
+
 void Thread_Detach(void* handle) {
 	if (!CloseHandle((HANDLE)handle)) {
 		Logger_Abort2(GetLastError(), "Freeing thread handle");
@@ -661,6 +701,12 @@ void Thread_Join(void* handle) {
 	Thread_Detach(handle);
 }
 
+int Thread_ProcessorCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors ? (int)info.dwNumberOfProcessors : 1;
+}
+
 void* Mutex_Create(void) {
 	CRITICAL_SECTION* ptr = (CRITICAL_SECTION*)Mem_Alloc(1, sizeof(CRITICAL_SECTION), "mutex");
 	InitializeCriticalSection(ptr);
@@ -700,8 +746,10 @@ void Waitable_WaitFor(void* handle, cc_uint32 milliseconds) {
 /* No real threading support with emscripten backend */
 void Thread_Sleep(cc_uint32 milliseconds) { }
 void* Thread_Start(Thread_StartFunc* func, cc_bool detach) { (*func)(); return NULL; }
+void* Thread_StartArg(Thread_StartArgFunc* func, void* arg) { (*func)(arg); return NULL; }
 void Thread_Detach(void* handle) { }
 void Thread_Join(void* handle) { }
+int Thread_ProcessorCount(void) { return 1; }
 
 void* Mutex_Create(void) { return NULL; }
 void Mutex_Free(void* handle) { }
@@ -730,6 +778,26 @@ void* Thread_Start(Thread_StartFunc* func, cc_bool detach) {
 	return ptr;
 }
 
+struct ThreadArgs { Thread_StartArgFunc* func; void* arg; };
+static void* Thread_StartArgCallback(void* lpParam) {
+	struct ThreadArgs args = *(struct ThreadArgs*)lpParam;
+	Mem_Free(lpParam);
+	args.func(args.arg);
+	return NULL;
+}
+
+void* Thread_StartArg(Thread_StartArgFunc* func, void* arg) {
+	pthread_t* ptr = (pthread_t*)Mem_Alloc(1, sizeof(pthread_t), "thread");
+	struct ThreadArgs* args = (struct ThreadArgs*)Mem_Alloc(1, sizeof(struct ThreadArgs), "thread args");
+	int res;
+
+	args->func = func;
+	args->arg  = arg;
+	res = pthread_create(ptr, NULL, Thread_StartArgCallback, args);
+	if (res) Logger_Abort2(res, "Creating thread");
+	return ptr;
+}
+
 void Thread_Detach(void* handle) {
 	pthread_t* ptr = (pthread_t*)handle;
 	int res = pthread_detach(*ptr);
@@ -744,6 +812,11 @@ void Thread_Join(void* handle) {
 	Mem_Free(ptr);
 }
 
+int Thread_ProcessorCount(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
 void* Mutex_Create(void) {
 	pthread_mutex_t* ptr = (pthread_mutex_t*)Mem_Alloc(1, sizeof(pthread_mutex_t), "mutex");
 	int res = pthread_mutex_init(ptr, NULL);
@@ -140,6 +140,8 @@ CC_API int File_Exists(const String* path);
 CC_API cc_result File_SetModifiedTime(const String* path, TimeMS ms);
 /* Marks a file as being executable. */
 CC_API cc_result File_MarkExecutable(const String* path);
+/* Renames a file, replacing the destination file if it already exists. */
+CC_API cc_result File_Rename(const String* src, const String* dst);
 
 /* Attempts to create a new (or overwrite) file for writing. */
 /* NOTE: If the file already exists, its contents are discarded. */
@@ -166,12 +168,17 @@ CC_API void Thread_Sleep(cc_uint32 milliseconds);
 typedef void Thread_StartFunc(void);
 /* Starts a new thread, optionally immediately detaching it. (See Thread_Detach) */
 CC_API void* Thread_Start(Thread_StartFunc* func, cc_bool detach);
+typedef void Thread_StartArgFunc(void* arg);
+/* Starts a new thread, which is passed the given argument. (See Thread_Join) */
+CC_API void* Thread_StartArg(Thread_StartArgFunc* func, void* arg);
 /* Frees the platform specific persistent data associated with the thread. */
 /* NOTE: You must either detach or join threads, as this data otherwise leaks. */
 CC_API void Thread_Detach(void* handle);
 /* Blocks the current thread, until the given thread has finished. */
 /* NOTE: Once a thread has been detached, you can no longer use this method. */
 CC_API void Thread_Join(void* handle);
+/* Returns the number of logical processors that threads can run on. (always at least 1) */
+CC_API int Thread_ProcessorCount(void);
 
 /* Allocates a new mutex. (used to synchronise access to a shared resource) */
 CC_API void* Mutex_Create(void);
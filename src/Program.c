@@ -7,6 +7,16 @@
 #include "Utils.h"
 #include "Launcher.h"
 #include "Server.h"
+#include "Formats.h"
+#include "World.h"
+#include "Block.h"
+#include "Stream.h"
+#include "Deflate.h"
+#include "GameStructs.h"
+#include "Generator.h"
+#include "ExtMath.h"
+#include "Errors.h"
+#include "Entity.h"
 
 /*#define CC_TEST_VORBIS*/
 #ifdef CC_TEST_VORBIS
@@ -40,6 +50,719 @@ int main_imdct() {
 }
 #endif
 
+#if !defined CC_BUILD_WEB && !defined CC_BUILD_ANDROID
+/*########################################################################################################################*
+*------------------------------------------------------Map conversion-----------------------------------------------------*
+*#########################################################################################################################*/
+/* Converts all the maps in a directory to another format, without opening a window */
+/*  e.g. ClassiCube --convert maps/old maps/new cw 9 */
+/* Maps are converted one at a time, since importing a map replaces the current world */
+/* (but loading .ccm maps and saving all formats uses all cores anyways) */
+static String convert_dir, convert_ext;
+static char convert_extBuffer[16];
+static int convert_level, convert_count, convert_failed;
+
+static cc_result Convert_Save(const String* path, cc_uint32* size) {
+	static const String ccm = String_FromConst(".ccm"), schematic = String_FromConst(".schematic");
+	struct Stream stream, compStream;
+	struct GZipParallelState state;
+	cc_result res, closeRes;
+
+	if ((res = Stream_CreateFile(&stream, path))) return res;
+	if (String_CaselessEquals(&convert_ext, &ccm)) {
+		res = Ccm_Save(&stream);
+	} else {
+		GZip_MakeParallelStream(&compStream, &state, &stream);
+		state.Level = convert_level;
+
+		if (String_CaselessEquals(&convert_ext, &schematic)) {
+			res = Schematic_Save(&compStream);
+		} else {
+			res = Cw_Save(&compStream);
+		}
+		if (res) {
+			/* don't close compressor, as that would write out rest of the partial map */
+			GZip_AbortParallelStream(&state);
+		} else {
+			res = compStream.Close(&compStream);
+		}
+	}
+
+	if (!res) res = stream.Position(&stream, size);
+	closeRes = stream.Close(&stream);
+	return res ? res : closeRes;
+}
+
+static void Convert_File(const String* path, void* obj) {
+	String file, dst; char dstBuffer[FILENAME_SIZE];
+	IMapImporter importer = Map_FindImporter(path);
+	struct Stream stream;
+	cc_uint32 srcSize = 0, dstSize = 0;
+	cc_uint64 beg;
+	int i, elapsed, srcKB, dstKB;
+	float speed;
+	cc_result res;
+	if (!importer) return;
+
+	file = *path;
+	Utils_UNSAFE_GetFilename(&file);
+	i = String_LastIndexOf(&file, '.');
+	if (i >= 0) file.length = i;
+
+	String_InitArray(dst, dstBuffer);
+	String_Format3(&dst, "%s/%s%s", &convert_dir, &file, &convert_ext);
+	beg = Stopwatch_Measure();
+
+	if (!(res = Stream_OpenFile(&stream, path))) {
+		stream.Length(&stream, &srcSize);
+		res = Map_Import(importer, &stream);
+		stream.Close(&stream);
+	}
+	if (res) {
+		Platform_Log2("Error %h when importing %s", &res, path);
+		convert_failed++; return;
+	}
+
+	res = Convert_Save(&dst, &dstSize);
+	/* Discard world and block definitions, so they don't end up in the next map */
+	World_Reset();
+	Blocks_Component.Reset();
+	if (res) {
+		Platform_Log2("Error %h when exporting %s", &res, &dst);
+		convert_failed++; return;
+	}
+
+	elapsed = (int)(Stopwatch_ElapsedMicroseconds(beg, Stopwatch_Measure()) / 1000);
+	srcKB   = srcSize / 1024;
+	dstKB   = dstSize / 1024;
+	speed   = srcSize / 1048576.0f / (max(elapsed, 1) / 1000.0f);
+
+	Platform_Log4("%s: %i KB -> %i KB in %i ms", path, &srcKB, &dstKB, &elapsed);
+	Platform_Log1("  (%f1 MB/s)", &speed);
+	convert_count++;
+}
+
+static int Convert_Run(const String* args, int argsCount) {
+	cc_uint64 beg;
+	int elapsed;
+	cc_result res;
+
+	if (argsCount < 4) {
+		Platform_LogConst("Usage: ClassiCube --convert [source dir] [output dir] [cw/ccm/schematic] [level 1-9]");
+		return 1;
+	}
+	if (!String_CaselessEqualsConst(&args[3], "cw") && !String_CaselessEqualsConst(&args[3], "ccm") 
+		&& !String_CaselessEqualsConst(&args[3], "schematic")) {
+		Platform_Log1("Unsupported output format '%s'", &args[3]);
+		return 1;
+	}
+
+	convert_level = DEFLATE_DEF_LEVEL;
+	if (argsCount > 4 && !Convert_ParseInt(&args[4], &convert_level)) {
+		Platform_Log1("Invalid compression level '%s'", &args[4]);
+		return 1;
+	}
+
+	convert_dir = args[2];
+	String_InitArray(convert_ext, convert_extBuffer);
+	String_Format1(&convert_ext, ".%s", &args[3]);
+	if (!Directory_Exists(&convert_dir) && (res = Directory_Create(&convert_dir))) {
+		Platform_Log2("Error %h when creating %s", &res, &convert_dir);
+		return 1;
+	}
+
+	/* Importing .cw maps defines custom blocks, and block defaults are needed for that */
+	Game_AllowCustomBlocks = true;
+	Blocks_Component.Init();
+
+	beg = Stopwatch_Measure();
+	res = Directory_Enum(&args[1], NULL, Convert_File);
+	if (res) {
+		Platform_Log2("Error %h when enumerating %s", &res, &args[1]);
+		return 1;
+	}
+
+	elapsed = (int)(Stopwatch_ElapsedMicroseconds(beg, Stopwatch_Measure()) / 1000);
+	Platform_Log3("Converted %i maps (%i failed) in %i ms", &convert_count, &convert_failed, &elapsed);
+	return convert_failed ? 1 : 0;
+}
+
+
+/*########################################################################################################################*
+*-----------------------------------------------------Generator check-----------------------------------------------------*
+*#########################################################################################################################*/
+/* Generates maps from a fixed set of seeds and sizes, then checks their blocks still match what they */
+/*  have always been, so that changes to the generators never silently change the map a seed produces */
+/*  e.g. ClassiCube --gencheck */
+/* Time taken by each stage (as reported through Gen_CurrentState) is also logged */
+static const struct GenCheckCase {
+	cc_bool vanilla; int width, height, length, seed; cc_uint32 crc;
+} genCheck_cases[] = {
+	{ false, 128,  64, 128,      0, 0x1622F464UL },
+	{ false,  99,  33,  77,      0, 0xDED5E91EUL },
+	{ true,  128,  64, 128,      0, 0x9B290CBBUL },
+	{ true,  256,  64, 256,   1337, 0x3B0ECD09UL },
+	{ true,   64, 256,  96,     42, 0x441E5C1EUL },
+	{ true,  100,  50, 300, -12345, 0x901E0FE9UL },
+	{ true,  512, 128, 512,   2020, 0x3AAAB76EUL },
+};
+/* CRC32 of the blocks and positions generated by TreeGen_Grow for the first GENCHECK_TREES seeds */
+#define GENCHECK_TREES 64
+#define GENCHECK_TREES_CRC 0x28DD8143UL
+
+static void GenCheck_LogStage(const char* stage, cc_uint64* beg) {
+	cc_uint64 end = Stopwatch_Measure();
+	float ms = Stopwatch_ElapsedMicroseconds(*beg, end) / 1000.0f;
+
+	if (stage && stage[0]) Platform_Log2("  %c: %f1 ms", stage, &ms);
+	*beg = end;
+}
+
+/* Runs the generator on another thread, while logging how long it spends in each stage */
+/* NOTE: Stages are only checked every millisecond, so very short stages may not get logged */
+static void GenCheck_Generate(Thread_StartFunc* generate) {
+	const char* stage = NULL;
+	const char* state;
+	cc_uint64 beg;
+	cc_bool done;
+	void* thread;
+
+	Gen_Done         = false;
+	Gen_CurrentState = "";
+	beg    = Stopwatch_Measure();
+	thread = Thread_Start(generate, false);
+
+	for (;;) {
+		done  = Gen_Done;
+		state = (const char*)Gen_CurrentState;
+
+		if (state != stage) {
+			GenCheck_LogStage(stage, &beg);
+			stage = state;
+		}
+		if (done) break;
+		Thread_Sleep(1);
+	}
+
+	GenCheck_LogStage(stage, &beg);
+	Thread_Join(thread);
+}
+
+static cc_bool GenCheck_RunCase(const struct GenCheckCase* c) {
+	cc_uint32 crc;
+	World_SetDimensions(c->width, c->height, c->length);
+	Gen_Seed   = c->seed;
+	Gen_Blocks = (BlockRaw*)Mem_Alloc(World.Volume, 1, "gen check blocks");
+
+	Platform_Log4("%c %ix%ix%i", c->vanilla ? "Vanilla" : "Flatgrass", &c->width, &c->height, &c->length);
+	Platform_Log1("  seed %i", &c->seed);
+	GenCheck_Generate(c->vanilla ? NotchyGen_Generate : FlatgrassGen_Generate);
+
+	crc = Utils_CRC32(Gen_Blocks, World.Volume);
+	Mem_Free(Gen_Blocks);
+	Gen_Blocks = NULL;
+
+	if (crc == c->crc) return true;
+	Platform_Log2("  FAILED: CRC32 is %h, expected %h", &crc, &c->crc);
+	return false;
+}
+
+static cc_bool GenCheck_RunTrees(void) {
+	IVec3 coords[TREE_MAX_COUNT];
+	BlockRaw blocks[TREE_MAX_COUNT];
+	cc_uint8 data[4];
+	cc_uint32 crc = 0xFFFFFFFFUL, expected = GENCHECK_TREES_CRC;
+	RNGState rnd;
+	int seed, i, count;
+
+	Tree_Rnd = &rnd;
+	for (seed = 0; seed < GENCHECK_TREES; seed++) {
+		Random_Seed(&rnd, seed);
+		count = TreeGen_Grow(16, 32, 16, 5 + seed % 3, coords, blocks);
+
+		/* pack into bytes, so CRC is the same regardless of endianness */
+		for (i = 0; i < count; i++) {
+			data[0] = coords[i].X; data[1] = coords[i].Y;
+			data[2] = coords[i].Z; data[3] = blocks[i];
+			crc = Utils_Crc32Update(crc, data, 4);
+		}
+	}
+
+	crc ^= 0xFFFFFFFFUL;
+	Platform_LogConst("Trees");
+	if (crc == expected) return true;
+	Platform_Log2("  FAILED: CRC32 is %h, expected %h", &crc, &expected);
+	return false;
+}
+
+static int GenCheck_Run(void) {
+	int i, failed = 0;
+	for (i = 0; i < Array_Elems(genCheck_cases); i++) {
+		if (!GenCheck_RunCase(&genCheck_cases[i])) failed++;
+	}
+	if (!GenCheck_RunTrees()) failed++;
+
+	if (failed) { Platform_Log1("%i generator checks FAILED", &failed); return 1; }
+	Platform_LogConst("All generator checks passed");
+	return 0;
+}
+
+
+/*########################################################################################################################*
+*------------------------------------------------------Replay check-------------------------------------------------------*
+*#########################################################################################################################*/
+/* Runs a recording made with /client replay through the local player's physics, without opening a window */
+/*  e.g. ClassiCube --replay maps/parkour.cw replays/replay.rpl */
+/* NOTE: The recording stores the player's hacks and model state, so the player isn't otherwise initialised */
+static int ReplayCheck_Run(const String* args, int argsCount) {
+	IMapImporter importer;
+	struct LocalPlayerReplay r;
+	struct Stream stream;
+	float perTick, totalMs;
+	cc_result res;
+
+	if (argsCount < 3) {
+		Platform_LogConst("Usage: ClassiCube --replay [map] [recording]");
+		return 1;
+	}
+	if (!(importer = Map_FindImporter(&args[1]))) {
+		Platform_Log1("Unsupported map format for %s", &args[1]);
+		return 1;
+	}
+
+	/* Importing .cw maps defines custom blocks, and block defaults are needed for that */
+	Game_AllowCustomBlocks = true;
+	Blocks_Component.Init();
+
+	if (!(res = Stream_OpenFile(&stream, &args[1]))) {
+		res = Map_Import(importer, &stream);
+		stream.Close(&stream);
+	}
+	if (res) { Platform_Log2("Error %h when importing %s", &res, &args[1]); return 1; }
+
+	res = LocalPlayer_Replay(&args[2], &r);
+	World_Reset();
+	Blocks_Component.Reset();
+	if (res) { Platform_Log2("Error %h when replaying %s", &res, &args[2]); return 1; }
+	if (!r.sameMap) Platform_LogConst("WARNING: Map differs from the map this was recorded in");
+
+	perTick = r.ticks ? r.microseconds / r.ticks : 0.0f;
+	totalMs = r.microseconds / 1000.0f;
+	Platform_Log3("Replayed %i ticks, %f2 us per tick (%f1 ms total)", &r.ticks, &perTick, &totalMs);
+
+	if (r.firstDiverged == -1) {
+		Platform_LogConst("All positions matched the recording exactly");
+		return 0;
+	}
+	Platform_Log3("FAILED: First diverged at tick %i, max %f3 blocks, final %f3 blocks off",
+		&r.firstDiverged, &r.maxDiff, &r.finalDiff);
+	return 1;
+}
+
+/*########################################################################################################################*
+*----------------------------------------------------Compression bench----------------------------------------------------*
+*#########################################################################################################################*/
+/* Measures MB/s of each compression stream type, using the blocks of each map in a directory, default.zip, */
+/*  and synthetic data. Then decompresses randomly corrupted data and .zip archives, which must be rejected */
+/*  without crashing, e.g. ClassiCube --compressbench maps 1000 */
+enum CompressType { COMPRESS_DEFLATE, COMPRESS_ZLIB, COMPRESS_GZIP, COMPRESS_GZIP_PARALLEL, COMPRESS_TYPES };
+static const char* const compress_names[COMPRESS_TYPES] = { "DEFLATE", "ZLIB", "GZIP", "GZIP (parallel)" };
+#define COMPRESS_SYNTH_SIZE (1024 * 1024)
+#define COMPRESS_MAX_INPUTS 64
+
+struct CompressInput { String name; char nameBuffer[FILENAME_SIZE]; cc_uint8* data; cc_uint32 len; };
+static struct CompressInput compress_inputs[COMPRESS_MAX_INPUTS];
+static int compress_numInputs, compress_failed;
+
+/* Writes to a block of memory, which is resized when it becomes full */
+static cc_result CompressBench_OutputWrite(struct Stream* s, const cc_uint8* data, cc_uint32 count, cc_uint32* modified) {
+	cc_uint32 used = s->Meta.Mem.Length - s->Meta.Mem.Left;
+
+	if (count > s->Meta.Mem.Left) {
+		s->Meta.Mem.Length = max(s->Meta.Mem.Length * 2, used + count);
+		s->Meta.Mem.Base   = (cc_uint8*)Mem_Realloc(s->Meta.Mem.Base, s->Meta.Mem.Length, 1, "compress output");
+		s->Meta.Mem.Left   = s->Meta.Mem.Length - used;
+	}
+
+	Mem_Copy(s->Meta.Mem.Base + used, data, count);
+	s->Meta.Mem.Left -= count;
+	*modified = count;
+	return 0;
+}
+
+static void CompressBench_AddInput(const String* name, cc_uint8* data, cc_uint32 len) {
+	struct CompressInput* input = &compress_inputs[compress_numInputs++];
+	String_InitArray(input->name, input->nameBuffer);
+	String_AppendString(&input->name, name);
+
+	input->data = data;
+	input->len  = len;
+}
+
+/* Adds the blocks of a map in the given directory */
+static void CompressBench_AddMap(const String* path, void* obj) {
+	IMapImporter importer = Map_FindImporter(path);
+	struct Stream stream;
+	cc_uint8* data;
+	cc_result res;
+	if (!importer) return;
+
+	/* Last few inputs are reserved for the texture pack and synthetic data */
+	if (compress_numInputs >= COMPRESS_MAX_INPUTS - 4) {
+		Platform_Log1("Too many maps, skipping %s", path); return;
+	}
+
+	if (!(res = Stream_OpenFile(&stream, path))) {
+		res = Map_Import(importer, &stream);
+		stream.Close(&stream);
+	}
+	if (res) { Platform_Log2("Error %h when importing %s", &res, path); return; }
+
+	data = (cc_uint8*)Mem_Alloc(World.Volume, 1, "compress map");
+	Mem_Copy(data, World.Blocks, World.Volume);
+	CompressBench_AddInput(path, data, World.Volume);
+
+	/* Discard world and block definitions, so they don't end up in the next map */
+	World_Reset();
+	Blocks_Component.Reset();
+}
+
+static void CompressBench_AddConst(const char* name, cc_uint8* data, cc_uint32 len) {
+	String str = String_FromReadonly(name);
+	CompressBench_AddInput(&str, data, len);
+}
+
+/* Adds the maps in the given directory, default texture pack, and synthetic best and worst cases */
+static cc_result CompressBench_InitInputs(const String* dir) {
+	static const String texPack = String_FromConst("texpacks/default.zip");
+	static const char* text = "The quick brown fox jumps over the lazy dog. ";
+	struct Stream stream;
+	cc_uint32 i, len;
+	cc_uint8* data;
+	cc_result res;
+	RNGState rnd;
+
+	compress_numInputs = 0;
+	/* Importing .cw maps defines custom blocks, and block defaults are needed for that */
+	Game_AllowCustomBlocks = true;
+	Blocks_Component.Init();
+	if ((res = Directory_Enum(dir, NULL, CompressBench_AddMap))) return res;
+
+	if (!Stream_OpenFile(&stream, &texPack)) {
+		if (!stream.Length(&stream, &len)) {
+			data = (cc_uint8*)Mem_Alloc(len, 1, "compress texture pack");
+			if (!Stream_Read(&stream, data, len)) {
+				CompressBench_AddInput(&texPack, data, len);
+			} else { Mem_Free(data); }
+		}
+		stream.Close(&stream);
+	}
+
+	data = (cc_uint8*)Mem_AllocCleared(COMPRESS_SYNTH_SIZE, 1, "compress zeros");
+	CompressBench_AddConst("zeros", data, COMPRESS_SYNTH_SIZE);
+
+	data = (cc_uint8*)Mem_Alloc(COMPRESS_SYNTH_SIZE, 1, "compress text");
+	len  = String_CalcLen(text, 100);
+	for (i = 0; i < COMPRESS_SYNTH_SIZE; i++) { data[i] = text[i % len]; }
+	CompressBench_AddConst("text", data, COMPRESS_SYNTH_SIZE);
+
+	data = (cc_uint8*)Mem_Alloc(COMPRESS_SYNTH_SIZE, 1, "compress random");
+	Random_Seed(&rnd, 1234);
+	for (i = 0; i < COMPRESS_SYNTH_SIZE; i++) { data[i] = Random_Next(&rnd, 256); }
+	CompressBench_AddConst("random", data, COMPRESS_SYNTH_SIZE);
+	return 0;
+}
+
+static void CompressBench_FreeInputs(void) {
+	int i;
+	for (i = 0; i < compress_numInputs; i++) {
+		Mem_Free(compress_inputs[i].data);
+	}
+	compress_numInputs = 0;
+}
+
+/* Compresses the given data, storing the compressed data in output->Meta.Mem.Base */
+static cc_result CompressBench_Compress(int type, const cc_uint8* data, cc_uint32 len, struct Stream* output) {
+	union CompressState {
+		struct DeflateState deflate; struct ZLibState zlib;
+		struct GZipState gzip; struct GZipParallelState parallel;
+	} *state;
+	struct Stream stream;
+	cc_result res, closeRes;
+
+	Stream_Init(output);
+	output->Write = CompressBench_OutputWrite;
+	output->Meta.Mem.Length = len / 2 + 64;
+	output->Meta.Mem.Left   = output->Meta.Mem.Length;
+	output->Meta.Mem.Base   = (cc_uint8*)Mem_Alloc(output->Meta.Mem.Length, 1, "compress output");
+	state = (union CompressState*)Mem_Alloc(1, sizeof(union CompressState), "compress state");
+
+	switch (type) {
+	case COMPRESS_DEFLATE:
+		Deflate_MakeStream(&stream, &state->deflate, output); break;
+	case COMPRESS_ZLIB:
+		ZLib_MakeStream(&stream, &state->zlib, output); break;
+	case COMPRESS_GZIP:
+		GZip_MakeStream(&stream, &state->gzip, output); break;
+	default:
+		GZip_MakeParallelStream(&stream, &state->parallel, output); break;
+	}
+
+	/* Always close, since parallel GZIP stream frees memory when closing */
+	res      = Stream_Write(&stream, data, len);
+	closeRes = stream.Close(&stream);
+	Mem_Free(state);
+	return res ? res : closeRes;
+}
+
+/* Decompresses up to dstLen bytes of the given data, setting dstLen to number of bytes decompressed */
+static cc_result CompressBench_Decompress(int type, cc_uint8* data, cc_uint32 len, cc_uint8* dst, cc_uint32* dstLen) {
+	struct InflateState* inflate;
+	struct GZipHeader gzHeader;
+	struct ZLibHeader zlHeader;
+	struct Stream src, stream;
+	cc_uint32 total, read;
+	cc_result res = 0;
+
+	Stream_ReadonlyMemory(&src, data, len);
+	if (type == COMPRESS_ZLIB) {
+		ZLibHeader_Init(&zlHeader);
+		while (!zlHeader.Done && !(res = ZLibHeader_Read(&src, &zlHeader))) { }
+	} else if (type != COMPRESS_DEFLATE) {
+		GZipHeader_Init(&gzHeader);
+		while (!gzHeader.Done && !(res = GZipHeader_Read(&src, &gzHeader))) { }
+	}
+	if (res) { *dstLen = 0; return res; }
+
+	inflate = (struct InflateState*)Mem_Alloc(1, sizeof(struct InflateState), "inflate state");
+	Inflate_MakeStream(&stream, inflate, &src);
+
+	for (total = 0; total < *dstLen; total += read) {
+		res = stream.Read(&stream, dst + total, *dstLen - total, &read);
+		if (res || !read) break;
+	}
+
+	Mem_Free(inflate);
+	*dstLen = total;
+	return res;
+}
+
+static cc_bool CompressBench_Equal(const cc_uint8* a, const cc_uint8* b, cc_uint32 len) {
+	cc_uint32 i;
+	for (i = 0; i < len; i++) {
+		if (a[i] != b[i]) return false;
+	}
+	return true;
+}
+
+/* Compresses then decompresses the given input, checking the decompressed data is the same */
+static cc_result CompressBench_RoundTrip(int type, struct CompressInput* input, cc_uint64* times, cc_uint32* compLen) {
+	struct Stream output;
+	cc_uint32 len = input->len + 1;
+	cc_uint8* check;
+	cc_uint64 beg;
+	cc_result res;
+
+	beg = Stopwatch_Measure();
+	res = CompressBench_Compress(type, input->data, input->len, &output);
+	times[0] += Stopwatch_ElapsedMicroseconds(beg, Stopwatch_Measure());
+	*compLen  = output.Meta.Mem.Length - output.Meta.Mem.Left;
+
+	if (!res) {
+		check = (cc_uint8*)Mem_Alloc(len, 1, "compress check");
+		beg   = Stopwatch_Measure();
+		res   = CompressBench_Decompress(type, output.Meta.Mem.Base, *compLen, check, &len);
+		times[1] += Stopwatch_ElapsedMicroseconds(beg, Stopwatch_Measure());
+
+		if (!res && (len != input->len || !CompressBench_Equal(check, input->data, len))) {
+			res = ERR_INVALID_ARGUMENT;
+		}
+		Mem_Free(check);
+	}
+
+	Mem_Free(output.Meta.Mem.Base);
+	return res;
+}
+
+static void CompressBench_Bench(void) {
+	cc_uint32 total, compTotal, compLen;
+	float compSpeed, decompSpeed, ratio;
+	cc_uint64 times[2];
+	cc_result res;
+	int type, i;
+
+	for (type = 0; type < COMPRESS_TYPES; type++) {
+		times[0] = 0; times[1] = 0; total = 0; compTotal = 0;
+
+		for (i = 0; i < compress_numInputs; i++) {
+			res = CompressBench_RoundTrip(type, &compress_inputs[i], times, &compLen);
+			if (res) {
+				Platform_Log3("  %c round trip of %s FAILED (%h)",
+							compress_names[type], &compress_inputs[i].name, &res);
+				compress_failed++;
+			}
+			total     += compress_inputs[i].len;
+			compTotal += compLen;
+		}
+
+		/* Bytes per microsecond is the same as megabytes per second */
+		compSpeed   = (float)total / (float)max(1, times[0]);
+		decompSpeed = (float)total / (float)max(1, times[1]);
+		ratio       = 100.0f * compTotal / max(1, total);
+		Platform_Log4("%c: %f1 MB/s compress, %f1 MB/s decompress, %f1 percent of original size",
+					compress_names[type], &compSpeed, &decompSpeed, &ratio);
+	}
+}
+
+/* Randomly changes a few bytes of the given data, or truncates it */
+static cc_uint32 CompressBench_Mutate(RNGState* rnd, cc_uint8* data, cc_uint32 len) {
+	int i, changes;
+	if (Random_Next(rnd, 8) == 0) return Random_Next(rnd, len);
+
+	changes = 1 + Random_Next(rnd, 8);
+	for (i = 0; i < changes; i++) {
+		data[Random_Next(rnd, len)] = Random_Next(rnd, 256);
+	}
+	return len;
+}
+
+static cc_result CompressBench_ReadAll(struct Stream* stream) {
+	cc_uint8 tmp[4096];
+	cc_uint32 read;
+	cc_result res;
+
+	for (;;) {
+		if ((res = stream->Read(stream, tmp, sizeof(tmp), &read))) return res;
+		if (!read) return 0;
+	}
+}
+
+static cc_result CompressBench_FuzzEntry(const String* path, struct Stream* data, struct ZipState* state) {
+	return CompressBench_ReadAll(data);
+}
+static cc_bool CompressBench_FuzzSelect(const String* path) { return true; }
+
+/* Reads all the entries of a corrupted .zip archive, using both .zip readers */
+static void CompressBench_FuzzZip(cc_uint8* data, cc_uint32 len) {
+	struct ZipEntryState entryState;
+	struct ZipIndex index;
+	struct ZipState state;
+	struct Stream src, entry;
+	int i;
+
+	Stream_ReadonlyMemory(&src, data, len);
+	Zip_Init(&state, &src);
+	state.SelectEntry  = CompressBench_FuzzSelect;
+	state.ProcessEntry = CompressBench_FuzzEntry;
+	Zip_Extract(&state);
+
+	Stream_ReadonlyMemory(&src, data, len);
+	if (ZipIndex_Load(&index, &src)) return;
+
+	for (i = 0; i < index.Count; i++) {
+		if (ZipIndex_Open(&index, i, &entry, &entryState)) continue;
+		CompressBench_ReadAll(&entry);
+	}
+	ZipIndex_Free(&index);
+}
+
+/* Makes a small .zip archive out of the inputs, with both stored and compressed entries */
+static cc_result CompressBench_MakeZip(struct Stream* output) {
+	struct CompressInput* input;
+	struct ZipWriter zip;
+	String name;
+	cc_result res = 0;
+	int i;
+
+	Stream_Init(output);
+	output->Write = CompressBench_OutputWrite;
+	output->Meta.Mem.Length = 4096;
+	output->Meta.Mem.Left   = output->Meta.Mem.Length;
+	output->Meta.Mem.Base   = (cc_uint8*)Mem_Alloc(output->Meta.Mem.Length, 1, "compress output");
+	ZipWriter_Init(&zip, output);
+
+	for (i = 0; i < compress_numInputs && !res; i++) {
+		input = &compress_inputs[i];
+		name  = input->name;
+		Utils_UNSAFE_GetFilename(&name);
+		res   = ZipWriter_WriteEntry(&zip, &name, i & 1, input->data, min(input->len, 65536));
+	}
+
+	if (!res) res = ZipWriter_Finish(&zip);
+	ZipWriter_Free(&zip);
+	return res;
+}
+
+/* Decompresses randomly corrupted data, which must fail cleanly instead of crashing */
+static void CompressBench_Fuzz(int iterations) {
+	struct CompressInput* input;
+	struct Stream output;
+	cc_uint8* data;
+	cc_uint8* dst;
+	cc_uint32 len, dstLen;
+	int i, type, failed = 0;
+	cc_result res;
+	RNGState rnd;
+
+	Random_SeedFromCurrentTime(&rnd);
+	dst = (cc_uint8*)Mem_Alloc(COMPRESS_SYNTH_SIZE, 1, "compress fuzz");
+
+	for (i = 0; i < iterations; i++) {
+		type  = Random_Next(&rnd, COMPRESS_TYPES + 1);
+		input = &compress_inputs[Random_Next(&rnd, compress_numInputs)];
+
+		/* Only use start of input, so that many iterations can be done quickly */
+		if (type == COMPRESS_TYPES) {
+			res = CompressBench_MakeZip(&output);
+		} else {
+			res = CompressBench_Compress(type, input->data, min(input->len, 65536), &output);
+		}
+		data = output.Meta.Mem.Base;
+		len  = output.Meta.Mem.Length - output.Meta.Mem.Left;
+
+		if (!res) {
+			len = CompressBench_Mutate(&rnd, data, len);
+			if (type == COMPRESS_TYPES) {
+				CompressBench_FuzzZip(data, len);
+			} else {
+				dstLen = COMPRESS_SYNTH_SIZE;
+				if (CompressBench_Decompress(type, data, len, dst, &dstLen)) failed++;
+			}
+		}
+		Mem_Free(data);
+	}
+
+	Mem_Free(dst);
+	Platform_Log2("Fuzzing: %i iterations done, %i rejected as corrupted", &iterations, &failed);
+}
+
+static int CompressBench_Run(const String* args, int argsCount) {
+	static const String defDir = String_FromConst("maps");
+	int iterations = 1000;
+	cc_result res;
+
+	if (argsCount > 2 && !Convert_ParseInt(&args[2], &iterations)) {
+		Platform_Log1("Invalid fuzz iterations '%s'", &args[2]);
+		return 1;
+	}
+
+	res = CompressBench_InitInputs(argsCount > 1 ? &args[1] : &defDir);
+	if (res) {
+		Platform_Log2("Error %h when enumerating %s", &res, argsCount > 1 ? &args[1] : &defDir);
+		return 1;
+	}
+
+	compress_failed = 0;
+	CompressBench_Bench();
+	CompressBench_Fuzz(iterations);
+	CompressBench_FreeInputs();
+
+	if (compress_failed) { Platform_Log1("%i round trips FAILED", &compress_failed); return 1; }
+	return 0;
+}
+
+#endif
+
 static void RunGame(void) {
 	static const String defPath = String_FromConst("texpacks/default.zip");
 	String title; char titleBuffer[STRING_SIZE];
@@ -165,8 +888,29 @@ int main(int argc, char** argv) {
 #endif
 	static char ipBuffer[STRING_SIZE];
 	cc_result res;
+#if !defined CC_BUILD_WEB && !defined CC_BUILD_ANDROID
+	String args[GAME_MAX_CMDARGS];
+	int argsCount;
+#endif
 	Logger_Hook();
 	Platform_Init();
+
+#if !defined CC_BUILD_WEB && !defined CC_BUILD_ANDROID
+	/* Converting maps, checking generators, replaying, or benchmarking compression must not need a window, or change current directory */
+	argsCount = Platform_GetCommandLineArgs(argc, argv, args);
+	if (argsCount && String_CaselessEqualsConst(&args[0], "--convert")) {
+		return Convert_Run(args, argsCount);
+	}
+	if (argsCount && String_CaselessEqualsConst(&args[0], "--gencheck")) {
+		return GenCheck_Run();
+	}
+	if (argsCount && String_CaselessEqualsConst(&args[0], "--replay")) {
+		return ReplayCheck_Run(args, argsCount);
+	}
+	if (argsCount && String_CaselessEqualsConst(&args[0], "--compressbench")) {
+		return CompressBench_Run(args, argsCount);
+	}
+#endif
 	Window_Init();
 	
 	res = Platform_SetDefaultCurrentDirectory(argc, argv);
@@ -37,8 +37,6 @@ static struct ResourceFile {
 
 static struct ResourceTexture {
 	const char* filename;
-	/* zip data */
-	cc_uint32 size, offset, crc32;
 } textureResources[20] = {
 	/* classic jar files */
 	{ "char.png"     }, { "clouds.png"      }, { "default.png" }, { "particles.png" },
@@ -203,149 +201,38 @@ void Resources_CheckExistence(void) {
 /*########################################################################################################################*
 *---------------------------------------------------------Zip writer------------------------------------------------------*
 *#########################################################################################################################*/
-static cc_result ZipPatcher_LocalFile(struct Stream* s, struct ResourceTexture* e) {
-	String name = String_FromReadonly(e->filename);
-	cc_uint8 header[30 + STRING_SIZE];
-	cc_result res;
-	if ((res = s->Position(s, &e->offset))) return res;
-
-	Stream_SetU32_LE(&header[0], 0x04034b50);   /* signature */
-	Stream_SetU16_LE(&header[4],  20);          /* version needed */
-	Stream_SetU16_LE(&header[6],  0);           /* bitflags */
-	Stream_SetU16_LE(&header[8] , 0);           /* compression method */
-	Stream_SetU16_LE(&header[10], 0);           /* last modified */
-	Stream_SetU16_LE(&header[12], 0);           /* last modified */
-	
-	Stream_SetU32_LE(&header[14], e->crc32);    /* CRC32 */
-	Stream_SetU32_LE(&header[18], e->size);     /* Compressed size */
-	Stream_SetU32_LE(&header[22], e->size);     /* Uncompressed size */
-	 
-	Stream_SetU16_LE(&header[26], name.length); /* name length */
-	Stream_SetU16_LE(&header[28], 0);           /* extra field length */
-
-	Mem_Copy(&header[30], name.buffer, name.length);
-	return Stream_Write(s, header, 30 + name.length);
-}
-
-static cc_result ZipPatcher_CentralDir(struct Stream* s, struct ResourceTexture* e) {
-	String name = String_FromReadonly(e->filename);
-	cc_uint8 header[46 + STRING_SIZE];
-	struct DateTime now;
-	int modTime, modDate;
-
-	DateTime_CurrentLocal(&now);
-	modTime = (now.second / 2) | (now.minute << 5) | (now.hour << 11);
-	modDate = (now.day) | (now.month << 5) | ((now.year - 1980) << 9);
-
-	Stream_SetU32_LE(&header[0],  0x02014b50);  /* signature */
-	Stream_SetU16_LE(&header[4],  20);          /* version */
-	Stream_SetU16_LE(&header[6],  20);          /* version needed */
-	Stream_SetU16_LE(&header[8],  0);           /* bitflags */
-	Stream_SetU16_LE(&header[10], 0);           /* compression method */
-	Stream_SetU16_LE(&header[12], modTime);     /* last modified */
-	Stream_SetU16_LE(&header[14], modDate);     /* last modified */
-
-	Stream_SetU32_LE(&header[16], e->crc32);    /* CRC32 */
-	Stream_SetU32_LE(&header[20], e->size);     /* compressed size */
-	Stream_SetU32_LE(&header[24], e->size);     /* uncompressed size */
-
-	Stream_SetU16_LE(&header[28], name.length); /* name length */
-	Stream_SetU16_LE(&header[30], 0);           /* extra field length */
-	Stream_SetU16_LE(&header[32], 0);           /* file comment length */
-	Stream_SetU16_LE(&header[34], 0);           /* disk number */
-	Stream_SetU16_LE(&header[36], 0);           /* internal attributes */
-	Stream_SetU32_LE(&header[38], 0);           /* external attributes */
-	Stream_SetU32_LE(&header[42], e->offset);   /* local header offset */
-
-	Mem_Copy(&header[46], name.buffer, name.length);
-	return Stream_Write(s, header, 46 + name.length);
-}
-
-static cc_result ZipPatcher_EndOfCentralDir(struct Stream* s, cc_uint32 centralDirBeg, cc_uint32 centralDirEnd) {
-	cc_uint8 header[22];
-
-	Stream_SetU32_LE(&header[0], 0x06054b50); /* signature */
-	Stream_SetU16_LE(&header[4], 0);          /* disk number */
-	Stream_SetU16_LE(&header[6], 0);          /* disk number of start */
-	Stream_SetU16_LE(&header[8],  Array_Elems(textureResources));  /* disk entries */
-	Stream_SetU16_LE(&header[10], Array_Elems(textureResources));  /* total entries */
-	Stream_SetU32_LE(&header[12], centralDirEnd - centralDirBeg);  /* central dir size */
-	Stream_SetU32_LE(&header[16], centralDirBeg);                  /* central dir start */
-	Stream_SetU16_LE(&header[20], 0);         /* comment length */
-	return Stream_Write(s, header, 22);
-}
-
-static cc_result ZipPatcher_FixupLocalFile(struct Stream* s, struct ResourceTexture* e) {
-	String name = String_FromReadonly(e->filename);
-	cc_uint8 tmp[2048];
-	cc_uint32 dataBeg, dataEnd;
-	cc_uint32 i, crc, toRead, read;
-	cc_result res;
-
-	dataBeg = e->offset + 30 + name.length;
-	if ((res = s->Position(s, &dataEnd))) return res;
-	e->size = dataEnd - dataBeg;
-
-	/* work out the CRC 32 */
-	crc = 0xffffffffUL;
-	if ((res = s->Seek(s, dataBeg))) return res;
-
-	for (; dataBeg < dataEnd; dataBeg += read) {
-		toRead = dataEnd - dataBeg;
-		toRead = min(toRead, sizeof(tmp));
-
-		if ((res = s->Read(s, tmp, toRead, &read))) return res;
-		if (!read) return ERR_END_OF_STREAM;
-
-		for (i = 0; i < read; i++) {
-			crc = Utils_Crc32Table[(crc ^ tmp[i]) & 0xFF] ^ (crc >> 8);
-		}
-	}
-	e->crc32 = crc ^ 0xffffffffUL;
-
-	/* then fixup the header */
-	if ((res = s->Seek(s, e->offset)))      return res;
-	if ((res = ZipPatcher_LocalFile(s, e))) return res;
-	return s->Seek(s, dataEnd);
-}
-
-static cc_result ZipPatcher_WriteData(struct Stream* dst, struct ResourceTexture* tex, const cc_uint8* data, cc_uint32 len) {
-	cc_result res;
-	tex->size  = len;
-	tex->crc32 = Utils_CRC32(data, len);
-
-	res = ZipPatcher_LocalFile(dst, tex);
-	if (res) return res;
-	return Stream_Write(dst, data, len);
+static cc_result ZipPatcher_WriteData(struct ZipWriter* zip, struct ResourceTexture* tex, const cc_uint8* data, cc_uint32 len) {
+	String name = String_FromReadonly(tex->filename);
+	return ZipWriter_WriteEntry(zip, &name, false, data, len);
 }
 
 static cc_result ZipPatcher_WriteZipEntry(struct Stream* src, struct ResourceTexture* tex, struct ZipState* state) {
+	String name = String_FromReadonly(tex->filename);
+	struct ZipWriter* zip = (struct ZipWriter*)state->Obj;
+	struct Stream dst;
 	cc_uint8 tmp[2048];
 	cc_uint32 read;
-	struct Stream* dst = (struct Stream*)state->Obj;
 	cc_result res;
 
-	tex->size  = state->_curEntry->UncompressedSize;
-	tex->crc32 = state->_curEntry->CRC32;
-	res = ZipPatcher_LocalFile(dst, tex);
-	if (res) return res;
-
+	if ((res = ZipWriter_BeginEntry(zip, &name, false, &dst))) return res;
 	for (;;) {
 		res = src->Read(src, tmp, sizeof(tmp), &read);
 		if (res)   return res;
 		if (!read) break;
 
-		if ((res = Stream_Write(dst, tmp, read))) return res;
+		if ((res = Stream_Write(&dst, tmp, read))) return res;
 	}
-	return 0;
+	return ZipWriter_EndEntry(zip);
 }
 
-static cc_result ZipPatcher_WritePng(struct Stream* s, struct ResourceTexture* tex, Bitmap* src) {
+static cc_result ZipPatcher_WritePng(struct ZipWriter* zip, struct ResourceTexture* tex, Bitmap* src) {
+	String name = String_FromReadonly(tex->filename);
+	struct Stream dst;
 	cc_result res;
 
-	if ((res = ZipPatcher_LocalFile(s, tex)))   return res;
-	if ((res = Png_Encode(src, s, NULL, true))) return res;
-	return ZipPatcher_FixupLocalFile(s, tex);
+	if ((res = ZipWriter_BeginEntry(zip, &name, false, &dst))) return res;
+	if ((res = Png_Encode(src, &dst, NULL, true)))             return res;
+	return ZipWriter_EndEntry(zip);
 }
 
 
@@ -396,14 +283,14 @@ static cc_result ClassicPatcher_ProcessEntry(const String* path, struct Stream*
 	return ZipPatcher_WriteZipEntry(data, entry, state);
 }
 
-static cc_result ClassicPatcher_ExtractFiles(struct Stream* s) {
+static cc_result ClassicPatcher_ExtractFiles(struct ZipWriter* dst) {
 	struct ZipState zip;
 	struct Stream src;
 
 	Stream_ReadonlyMemory(&src, fileResources[0].data, fileResources[0].len);
 	Zip_Init(&zip, &src);
 
-	zip.Obj = s;
+	zip.Obj = dst;
 	zip.SelectEntry  = ClassicPatcher_SelectEntry;
 	zip.ProcessEntry = ClassicPatcher_ProcessEntry;
 	return Zip_Extract(&zip);
@@ -458,7 +345,7 @@ static cc_bool ModernPatcher_SelectEntry(const String* path) {
 		ModernPatcher_GetTile(path) != NULL;
 }
 
-static cc_result ModernPatcher_MakeAnimations(struct Stream* s, struct Stream* data) {
+static cc_result ModernPatcher_MakeAnimations(struct ZipWriter* zip, struct Stream* data) {
 	static const String animsPng = String_FromConst("animations.png");
 	struct ResourceTexture* entry;
 	cc_uint8 anim_data[Bitmap_DataSize(512, 16)];
@@ -475,7 +362,7 @@ static cc_result ModernPatcher_MakeAnimations(struct Stream* s, struct Stream* d
 
 	Mem_Free(bmp.Scan0);
 	entry = Resources_FindTex(&animsPng);
-	return ZipPatcher_WritePng(s, entry, &anim);
+	return ZipPatcher_WritePng(zip, entry, &anim);
 }
 
 static cc_result ModernPatcher_ProcessEntry(const String* path, struct Stream* data, struct ZipState* state) {
@@ -493,28 +380,28 @@ static cc_result ModernPatcher_ProcessEntry(const String* path, struct Stream* d
 	}
 
 	if (String_CaselessEqualsConst(path, "assets/minecraft/textures/blocks/fire_layer_1.png")) {
-		struct Stream* dst = (struct Stream*)state->Obj;
-		return ModernPatcher_MakeAnimations(dst, data);
+		struct ZipWriter* zip = (struct ZipWriter*)state->Obj;
+		return ModernPatcher_MakeAnimations(zip, data);
 	}
 
 	tile = ModernPatcher_GetTile(path);
 	return ModernPatcher_PatchTile(data, tile);
 }
 
-static cc_result ModernPatcher_ExtractFiles(struct Stream* s) {
+static cc_result ModernPatcher_ExtractFiles(struct ZipWriter* dst) {
 	struct ZipState zip;
 	struct Stream src;
 
 	Stream_ReadonlyMemory(&src, fileResources[1].data, fileResources[1].len);
 	Zip_Init(&zip, &src);
 
-	zip.Obj = s;
+	zip.Obj = dst;
 	zip.SelectEntry  = ModernPatcher_SelectEntry;
 	zip.ProcessEntry = ModernPatcher_ProcessEntry;
 	return Zip_Extract(&zip);
 }
 
-static cc_result TexPatcher_NewFiles(struct Stream* s) {
+static cc_result TexPatcher_NewFiles(struct ZipWriter* zip) {
 	static const String guiPng   = String_FromConst("gui.png");
 	static const String animsTxt = String_FromConst("animations.txt");
 	struct ResourceTexture* entry;
@@ -522,12 +409,12 @@ static cc_result TexPatcher_NewFiles(struct Stream* s) {
 
 	/* make default animations.txt */
 	entry = Resources_FindTex(&animsTxt);
-	res   = ZipPatcher_WriteData(s, entry, (const cc_uint8*)ANIMS_TXT, sizeof(ANIMS_TXT) - 1);
+	res   = ZipPatcher_WriteData(zip, entry, (const cc_uint8*)ANIMS_TXT, sizeof(ANIMS_TXT) - 1);
 	if (res) return res;
 
 	/* make ClassiCube gui.png */
 	entry = Resources_FindTex(&guiPng);
-	res   = ZipPatcher_WriteData(s, entry, fileResources[3].data, fileResources[3].len);
+	res   = ZipPatcher_WriteData(zip, entry, fileResources[3].data, fileResources[3].len);
 
 	return res;
 }
@@ -536,7 +423,7 @@ static void TexPatcher_PatchTile(Bitmap* src, int srcX, int srcY, int dstX, int
 	Bitmap_UNSAFE_CopyBlock(srcX, srcY, dstX * 16, dstY * 16, src, &terrainBmp, 16);
 }
 
-static cc_result TexPatcher_Terrain(struct Stream* s) {
+static cc_result TexPatcher_Terrain(struct ZipWriter* zip) {
 	static const String terrainPng = String_FromConst("terrain.png");
 	struct ResourceTexture* entry;
 	Bitmap bmp;
@@ -555,32 +442,23 @@ static cc_result TexPatcher_Terrain(struct Stream* s) {
 	TexPatcher_PatchTile(&bmp, 32,16, 11,0);
 
 	entry = Resources_FindTex(&terrainPng);
-	res   = ZipPatcher_WritePng(s, entry, &terrainBmp);
+	res   = ZipPatcher_WritePng(zip, entry, &terrainBmp);
 	Mem_Free(bmp.Scan0);
 	return res;
 }
 
-static cc_result TexPatcher_WriteEntries(struct Stream* s) {
-	cc_uint32 beg, end;
-	int i;
+static cc_result TexPatcher_WriteEntries(struct ZipWriter* zip) {
 	cc_result res;
-
-	if ((res = ClassicPatcher_ExtractFiles(s))) return res;
-	if ((res = ModernPatcher_ExtractFiles(s)))  return res;
-	if ((res = TexPatcher_NewFiles(s)))         return res;
-	if ((res = TexPatcher_Terrain(s)))          return res;
-	
-	if ((res = s->Position(s, &beg))) return res;
-	for (i = 0; i < Array_Elems(textureResources); i++) {
-		if ((res = ZipPatcher_CentralDir(s, &textureResources[i]))) return res;
-	}
-
-	if ((res = s->Position(s, &end))) return res;
-	return ZipPatcher_EndOfCentralDir(s, beg, end);
+	if ((res = ClassicPatcher_ExtractFiles(zip))) return res;
+	if ((res = ModernPatcher_ExtractFiles(zip)))  return res;
+	if ((res = TexPatcher_NewFiles(zip)))         return res;
+	if ((res = TexPatcher_Terrain(zip)))          return res;
+	return ZipWriter_Finish(zip);
 }
 
 static void TexPatcher_MakeDefaultZip(void) {
 	static const String path = String_FromConst("texpacks/default.zip");
+	struct ZipWriter zip;
 	struct Stream s;
 	int i;
 	cc_result res;
@@ -589,8 +467,10 @@ static void TexPatcher_MakeDefaultZip(void) {
 	if (res) {
 		Logger_Warn(res, "creating default.zip");
 	} else {
-		res = TexPatcher_WriteEntries(&s);
+		ZipWriter_Init(&zip, &s);
+		res = TexPatcher_WriteEntries(&zip);
 		if (res) Logger_Warn(res, "making default.zip");
+		ZipWriter_Free(&zip);
 
 		res = s.Close(&s);
 		if (res) Logger_Warn(res, "closing default.zip");
@@ -19,6 +19,8 @@
 #include "Block.h"
 #include "Menus.h"
 #include "World.h"
+#include "Formats.h"
+#include "BlockPhysics.h"
 
 #define CHAT_MAX_STATUS Array_Elems(Chat_Status)
 #define CHAT_MAX_BOTTOMRIGHT Array_Elems(Chat_BottomRight)
@@ -154,6 +156,7 @@ static void HUDScreen_MakeText(struct HUDScreen* s, String* status) {
 
 		ping = Ping_AveragePingMS();
 		if (ping) String_Format1(status, ", ping %i ms", &ping);
+		Physics_ReportProfile(status);
 	}
 }
 
@@ -1412,6 +1415,35 @@ void GeneratingScreen_Show(void) {
 }
 
 
+/*########################################################################################################################*
+*---------------------------------------------------LoadingMapScreen------------------------------------------------------*
+*#########################################################################################################################*/
+static void LoadingMapScreen_Render(void* screen, double delta) {
+	LoadingScreen_Render(screen, delta);
+	if (Map_LoadDone) {
+		Gui_Remove((struct Screen*)&LoadingScreen);
+		Map_EndLoad(); return;
+	}
+	Event_RaiseFloat(&WorldEvents.Loading, Map_LoadProgress);
+}
+
+static const struct ScreenVTABLE LoadingMapScreen_VTABLE = {
+	LoadingScreen_Init,      Screen_NullUpdate, LoadingScreen_Free,
+	LoadingMapScreen_Render, LoadingScreen_BuildMesh,
+	Screen_TInput,           Screen_TInput,     Screen_TKeyPress,   Screen_TText,
+	Screen_TPointer,         Screen_TPointer,   Screen_FPointer,    Screen_TMouseScroll,
+	LoadingScreen_Layout, LoadingScreen_ContextLost, LoadingScreen_ContextRecreated
+};
+void LoadingMapScreen_Show(const String* path) {
+	static const String title = String_FromConst("Loading level");
+	String file = *path;
+	Utils_UNSAFE_GetFilename(&file);
+
+	LoadingScreen.VTABLE = &LoadingMapScreen_VTABLE;
+	LoadingScreen_ShowCommon(&title, &file);
+}
+
+
 /*########################################################################################################################*
 *----------------------------------------------------DisconnectScreen-----------------------------------------------------*
 *#########################################################################################################################*/
@@ -41,6 +41,7 @@ void InventoryScreen_Show(void);
 void HUDScreen_Show(void);
 void LoadingScreen_Show(const String* title, const String* message);
 void GeneratingScreen_Show(void);
+void LoadingMapScreen_Show(const String* path);
 void ChatScreen_Show(void);
 void DisconnectScreen_Show(const String* title, const String* message);
 #ifdef CC_BUILD_TOUCH
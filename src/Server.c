@@ -21,6 +21,7 @@
 #include "Protocol.h"
 #include "Inventory.h"
 #include "Platform.h"
+#include "Stream.h"
 #include "GameStructs.h"
 
 static char nameBuffer[STRING_SIZE];
@@ -208,9 +209,68 @@ static void SPConnection_Tick(struct ScheduledTask* task) {
 	ticks++;
 }
 
+/* Changed sections of the map are written into unused space in the autosave file. The whole map */
+/*  is only saved again when a new map is loaded, or to compact the file once it has grown too much */
+/*  from changed sections being appended to the end of the file. (see Ccm_SaveSections) */
+/* The whole map is saved to a temp file first, so the previous autosave is kept if that fails */
+#define SP_AUTOSAVE_INTERVAL 60
+static const String sp_autosavePath = String_FromConst("maps/autosave.ccm");
+static const String sp_autosaveTemp = String_FromConst("maps/autosave.ccm.tmp");
+static cc_bool sp_autosaveFull = true;
+static cc_uint32 sp_autosaveCompactSize;
+
+static cc_result SPConnection_SaveFull(void) {
+	struct Stream stream;
+	cc_result res, closeRes;
+
+	if ((res = Stream_CreateFile(&stream, &sp_autosaveTemp))) return res;
+	res = Ccm_Save(&stream);
+	if (!res) res = stream.Length(&stream, &sp_autosaveCompactSize);
+
+	closeRes = stream.Close(&stream);
+	if (res || closeRes) return res ? res : closeRes;
+	return File_Rename(&sp_autosaveTemp, &sp_autosavePath);
+}
+
+static cc_result SPConnection_SaveChanged(void) {
+	struct Stream stream;
+	FileHandle file;
+	cc_uint32 length;
+	cc_result res, closeRes;
+
+	if ((res = File_OpenOrCreate(&file, &sp_autosavePath))) return res;
+	Stream_FromFile(&stream, file);
+	res = Ccm_SaveSections(&stream, World.DirtySections);
+
+	if (!res && !stream.Length(&stream, &length) && length > sp_autosaveCompactSize * 2) {
+		sp_autosaveFull = true;
+	}
+	closeRes = stream.Close(&stream);
+	return res ? res : closeRes;
+}
+
+static void SPConnection_Autosave(struct ScheduledTask* task) {
+	cc_result res;
+	if (!World.Blocks || !World.AnyDirty) return;
+
+	/* If this fails (e.g. autosave file was deleted), just save the whole map instead */
+	if (!sp_autosaveFull && !SPConnection_SaveChanged()) {
+		World_ClearDirty(); return;
+	}
+
+	res = SPConnection_SaveFull();
+	if (res) { Logger_Warn2(res, "autosaving", &sp_autosavePath); return; }
+
+	sp_autosaveFull = false;
+	World_ClearDirty();
+}
+
+static void SPConnection_OnNewMapLoaded(void) { sp_autosaveFull = true; }
+
 static void SPConnection_Init(void) {
 	Server_ResetState();
 	Physics_Init();
+	ScheduledTask_Add(SP_AUTOSAVE_INTERVAL, SPConnection_Autosave);
 
 	Server.BeginConnect = SPConnection_BeginConnect;
 	Server.Tick         = SPConnection_Tick;
@@ -543,5 +603,6 @@ struct IGameComponent Server_Component = {
 	Server_Init, /* Init  */
 	Server_Free, /* Free  */
 	MPConnection_Reset,    /* Reset */
-	MPConnection_OnNewMap  /* OnNewMap */
+	MPConnection_OnNewMap, /* OnNewMap */
+	SPConnection_OnNewMapLoaded /* OnNewMapLoaded */
 };
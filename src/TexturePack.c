@@ -637,22 +637,33 @@ void TextureCache_Update(struct HttpRequest* req) {
 /*########################################################################################################################*
 *-------------------------------------------------------TexturePack-------------------------------------------------------*
 *#########################################################################################################################*/
-static cc_result TexturePack_ProcessZipEntry(const String* path, struct Stream* stream, struct ZipState* s) {
-	String name = *path; 
-	Utils_UNSAFE_GetFilename(&name);
-	Event_RaiseEntry(&TextureEvents.FileChanged, stream, &name);
-	return 0;
-}
-
 /* Extracts all the files from a stream representing a .zip archive */
+/* NOTE: Entries are only decompressed as they are read by FileChanged handlers */
 static cc_result TexturePack_ExtractZip(struct Stream* stream) {
-	struct ZipState state;
+	struct ZipIndex index;
+	struct ZipEntryState state;
+	struct Stream data;
+	String name;
+	cc_result res;
+	int i;
+
 	Event_RaiseVoid(&TextureEvents.PackChanged);
 	if (Gfx.LostContext) return 0;
-	
-	Zip_Init(&state, stream);
-	state.ProcessEntry = TexturePack_ProcessZipEntry;
-	return Zip_Extract(&state);
+	if ((res = ZipIndex_Load(&index, stream))) return res;
+
+	for (i = 0; i < index.Count; i++) {
+		res = ZipIndex_Open(&index, i, &data, &state);
+		/* Skip entries with unsupported compression methods */
+		if (res == ERR_NOT_SUPPORTED) { res = 0; continue; }
+		if (res) break;
+
+		name = index.Paths[i];
+		Utils_UNSAFE_GetFilename(&name);
+		Event_RaiseEntry(&TextureEvents.FileChanged, &data, &name);
+	}
+
+	ZipIndex_Free(&index);
+	return res;
 }
 
 /* Changes the current terrain atlas from a stream representing a .png image */
@@ -101,13 +101,7 @@ cc_uint8 Utils_CalcSkinType(const Bitmap* bmp) {
 }
 
 cc_uint32 Utils_CRC32(const cc_uint8* data, cc_uint32 length) {
-	cc_uint32 crc = 0xffffffffUL;
-	int i;
-
-	for (i = 0; i < length; i++) {
-		crc = Utils_Crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
-	}
-	return crc ^ 0xffffffffUL;
+	return Utils_Crc32Update(0xffffffffUL, data, length) ^ 0xffffffffUL;
 }
 
 const cc_uint32 Utils_Crc32Table[256] = {
@@ -129,6 +123,189 @@ const cc_uint32 Utils_Crc32Table[256] = {
 	0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
 };
 
+
+
+/*########################################################################################################################*
+*----------------------------------------------------------CRC32----------------------------------------------------------*
+*#########################################################################################################################*/
+#define CRC32_POLY 0xEDB88320UL
+/* crc32_tables[n][i] is the CRC32 contribution of byte i followed by n zero bytes, for slicing-by-8 */
+static cc_uint32 crc32_tables[8][256];
+/* crc32_x2n[n] is x^(2^n) modulo the CRC32 polynomial, for combining CRC32s */
+static cc_uint32 crc32_x2n[32];
+static cc_bool crc32_inited, crc32_useClmul;
+
+#if defined __GNUC__ && defined __x86_64__
+#define CRC32_CLMUL
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define CRC32_CLMUL_FUNC __attribute__((target("sse2,pclmul")))
+
+static cc_bool Crc32_HasClmul(void) {
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+	return (ecx & (1 << 1)) != 0;
+}
+#elif defined _MSC_VER && defined _M_X64
+#define CRC32_CLMUL
+#include <intrin.h>
+#define CRC32_CLMUL_FUNC
+
+static cc_bool Crc32_HasClmul(void) {
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 1)) != 0;
+}
+#endif
+
+#ifdef CRC32_CLMUL
+#define Crc32_Fold(x, k, next) \
+	tmp = _mm_clmulepi64_si128(x, k, 0x00); \
+	x   = _mm_clmulepi64_si128(x, k, 0x11); \
+	x   = _mm_xor_si128(_mm_xor_si128(x, tmp), next);
+
+/* Folds data using carry-less multiplication, then Barrett reduces the result to a CRC32. */
+/* Based on "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel) */
+/* NOTE: length must be a multiple of 16, and at least 64 */
+static CRC32_CLMUL_FUNC cc_uint32 Crc32_Clmul(cc_uint32 crc, const cc_uint8* data, cc_uint32 length) {
+	__m128i x1, x2, x3, x4, k, tmp, mask;
+	__m128i t1, t2, t3, t4;
+	/* Constants are x^(4*128+64) mod P, x^(4*128) mod P, x^(128+64) mod P, x^128 mod P, etc */
+	const __m128i k1k2 = _mm_set_epi32(0x00000001, (int)0xC6E41596UL, 0x00000001, (int)0x54442BD4UL);
+	const __m128i k3k4 = _mm_set_epi32(0x00000000, (int)0xCCAA009EUL, 0x00000001, (int)0x751997D0UL);
+	const __m128i k5k0 = _mm_set_epi32(0x00000000, 0x00000000,        0x00000001, (int)0x63CD6124UL);
+	const __m128i poly = _mm_set_epi32(0x00000001, (int)0xF7011641UL, 0x00000001, (int)0xDB710641UL);
+
+	x1 = _mm_loadu_si128((const __m128i*)(data +  0));
+	x2 = _mm_loadu_si128((const __m128i*)(data + 16));
+	x3 = _mm_loadu_si128((const __m128i*)(data + 32));
+	x4 = _mm_loadu_si128((const __m128i*)(data + 48));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	data += 64; length -= 64;
+
+	/* Fold 4 x 128 bits at a time */
+	for (k = k1k2; length >= 64; data += 64, length -= 64) {
+		t1 = _mm_loadu_si128((const __m128i*)(data +  0));
+		t2 = _mm_loadu_si128((const __m128i*)(data + 16));
+		t3 = _mm_loadu_si128((const __m128i*)(data + 32));
+		t4 = _mm_loadu_si128((const __m128i*)(data + 48));
+
+		Crc32_Fold(x1, k, t1);
+		Crc32_Fold(x2, k, t2);
+		Crc32_Fold(x3, k, t3);
+		Crc32_Fold(x4, k, t4);
+	}
+
+	/* Fold 4 x 128 bits into 128 bits, then fold remaining data 128 bits at a time */
+	k = k3k4;
+	Crc32_Fold(x1, k, x2);
+	Crc32_Fold(x1, k, x3);
+	Crc32_Fold(x1, k, x4);
+
+	for (; length >= 16; data += 16, length -= 16) {
+		t1 = _mm_loadu_si128((const __m128i*)data);
+		Crc32_Fold(x1, k, t1);
+	}
+
+	/* Fold 128 bits into 64 bits */
+	mask = _mm_set_epi32(0, ~0, 0, ~0);
+	x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduce 64 bits into 32 bits */
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return (cc_uint32)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif
+
+/* Multiplies two polynomials modulo the CRC32 polynomial */
+static cc_uint32 Crc32_MultModP(cc_uint32 a, cc_uint32 b) {
+	cc_uint32 m = 1UL << 31, p = 0;
+
+	for (; m; m >>= 1) {
+		if (a & m) p ^= b;
+		b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+	}
+	return p;
+}
+
+/* NOTE: If multiple threads race to call this, they all just compute identical tables */
+static void Crc32_Init(void) {
+	cc_uint32 crc, p;
+	int i, n;
+
+	for (i = 0; i < 256; i++) {
+		crc32_tables[0][i] = Utils_Crc32Table[i];
+	}
+	for (n = 1; n < 8; n++) {
+		for (i = 0; i < 256; i++) {
+			crc = crc32_tables[n - 1][i];
+			crc32_tables[n][i] = (crc >> 8) ^ Utils_Crc32Table[crc & 0xFF];
+		}
+	}
+
+	p = 1UL << 30; /* x^1 */
+	for (n = 0; n < 32; n++) {
+		crc32_x2n[n] = p;
+		p = Crc32_MultModP(p, p);
+	}
+
+#ifdef CRC32_CLMUL
+	crc32_useClmul = Crc32_HasClmul();
+#endif
+	crc32_inited   = true;
+}
+
+cc_uint32 Utils_Crc32Update(cc_uint32 crc, const cc_uint8* data, cc_uint32 length) {
+	cc_uint32 hi;
+	if (!crc32_inited) Crc32_Init();
+
+#ifdef CRC32_CLMUL
+	if (crc32_useClmul && length >= 64) {
+		hi  = length & ~15;
+		crc = Crc32_Clmul(crc, data, hi);
+		data += hi; length -= hi;
+	}
+#endif
+
+	/* Slicing-by-8: process 8 bytes at a time using 8 lookup tables */
+	for (; length >= 8; data += 8, length -= 8) {
+		crc ^= data[0] | (data[1] << 8) | (data[2] << 16) | ((cc_uint32)data[3] << 24);
+		hi   = data[4] | (data[5] << 8) | (data[6] << 16) | ((cc_uint32)data[7] << 24);
+
+		crc = crc32_tables[7][crc & 0xFF] ^ crc32_tables[6][(crc >> 8) & 0xFF]
+			^ crc32_tables[5][(crc >> 16) & 0xFF] ^ crc32_tables[4][crc >> 24]
+			^ crc32_tables[3][hi  & 0xFF] ^ crc32_tables[2][(hi  >> 8) & 0xFF]
+			^ crc32_tables[1][(hi  >> 16) & 0xFF] ^ crc32_tables[0][hi  >> 24];
+	}
+
+	for (; length; data++, length--) {
+		crc = Utils_Crc32Table[(crc ^ *data) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+cc_uint32 Utils_Crc32Combine(cc_uint32 crc1, cc_uint32 crc2, cc_uint32 len2) {
+	/* crc1 needs to be multiplied by x^(8 * len2) */
+	cc_uint32 p = 1UL << 31; /* x^0 */
+	int n = 3;
+	if (!crc32_inited) Crc32_Init();
+
+	for (; len2; len2 >>= 1, n++) {
+		if (len2 & 1) p = Crc32_MultModP(crc32_x2n[n & 31], p);
+	}
+	return Crc32_MultModP(p, crc1) ^ crc2;
+}
+
 void Utils_Resize(void** buffer, int* capacity, cc_uint32 elemSize, int defCapacity, int expandElems) {
 	/* We use a statically allocated buffer initally, so can't realloc first time */
 	int curCapacity = *capacity, newCapacity = curCapacity + expandElems;
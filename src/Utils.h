@@ -42,6 +42,12 @@ int Utils_AccumulateWheelDelta(float* accumulator, float delta);
 
 cc_uint8 Utils_CalcSkinType(const Bitmap* bmp);
 cc_uint32 Utils_CRC32(const cc_uint8* data, cc_uint32 length);
+/* Updates a running CRC32 with the given data. (uses PCLMULQDQ instruction when supported) */
+/* NOTE: crc should initially be 0xFFFFFFFFUL, and final CRC32 is then crc ^ 0xFFFFFFFFUL */
+CC_API cc_uint32 Utils_Crc32Update(cc_uint32 crc, const cc_uint8* data, cc_uint32 length);
+/* Combines the final CRC32 of two blocks of data into the final CRC32 of both blocks joined together. */
+/* len2 is the length of the second block. (allows computing CRC32 of separate blocks in parallel) */
+CC_API cc_uint32 Utils_Crc32Combine(cc_uint32 crc1, cc_uint32 crc2, cc_uint32 len2);
 /* CRC32 lookup table, for faster CRC32 calculations. */
 /* NOTE: This cannot be just indexed by byte value - see Utils_CRC32 implementation. */
 extern const cc_uint32 Utils_Crc32Table[256];
@@ -43,6 +43,8 @@ void World_Reset(void) {
 #endif
 	Mem_Free(World.Blocks);
 	World.Blocks = NULL;
+	Mem_Free(World.DirtySections);
+	World.DirtySections = NULL;
 
 	World_SetDimensions(0, 0, 0);
 	Env_Reset();
@@ -53,6 +55,14 @@ void World_SetNewMap(BlockRaw* blocks, int width, int height, int length) {
 	World.Blocks = blocks;
 
 	if (!World.Volume) World.Blocks = NULL;
+	Mem_Free(World.DirtySections);
+	World.DirtySections = NULL;
+	World.AnyDirty      = false;
+
+	if (World.Blocks) {
+		World.DirtySections = (cc_bool*)Mem_AllocCleared(World.SectionsX * World.SectionsY * World.SectionsZ, 
+															1, "map dirty sections");
+	}
 #ifdef EXTENDED_BLOCKS
 	/* .cw maps may have set this to a non-NULL when importing */
 	if (!World.Blocks2) {
@@ -74,6 +84,10 @@ CC_NOINLINE void World_SetDimensions(int width, int height, int length) {
 	World.MaxX = width  - 1;
 	World.MaxY = height - 1;
 	World.MaxZ = length - 1;
+
+	World.SectionsX = (width  + (1 << WORLD_SECTION_SHIFT) - 1) >> WORLD_SECTION_SHIFT;
+	World.SectionsY = (height + (1 << WORLD_SECTION_SHIFT) - 1) >> WORLD_SECTION_SHIFT;
+	World.SectionsZ = (length + (1 << WORLD_SECTION_SHIFT) - 1) >> WORLD_SECTION_SHIFT;
 }
 
 #ifdef EXTENDED_BLOCKS
@@ -84,10 +98,23 @@ void World_SetMapUpper(BlockRaw* blocks) {
 #endif
 
 
+void World_ClearDirty(void) {
+	if (!World.DirtySections) return;
+	Mem_Set(World.DirtySections, 0, World.SectionsX * World.SectionsY * World.SectionsZ);
+	World.AnyDirty = false;
+}
+
+static CC_INLINE void World_MarkDirty(int x, int y, int z) {
+	if (!World.DirtySections) return;
+	World.DirtySections[World_SectionIndex(x, y, z)] = true;
+	World.AnyDirty = true;
+}
+
 #ifdef EXTENDED_BLOCKS
 void World_SetBlock(int x, int y, int z, BlockID block) {
 	int i = World_Pack(x, y, z);
 	World.Blocks[i] = (BlockRaw)block;
+	World_MarkDirty(x, y, z);
 
 	/* defer allocation of second map array if possible */
 	if (World.Blocks == World.Blocks2) {
@@ -99,6 +126,7 @@ void World_SetBlock(int x, int y, int z, BlockID block) {
 #else
 void World_SetBlock(int x, int y, int z, BlockID block) {
 	World.Blocks[World_Pack(x, y, z)] = block; 
+	World_MarkDirty(x, y, z);
 }
 #endif
 
@@ -12,6 +12,10 @@ struct AABB;
 #define World_Unpack(idx, x, y, z) x = idx % World.Width; z = (idx / World.Width) % World.Length; y = (idx / World.Width) / World.Length;
 /* Packs an x,y,z into a single index */
 #define World_Pack(x, y, z) (((y) * World.Length + (z)) * World.Width + (x))
+/* Log2 of the size of a section of the world along each axis. (i.e. sections are 16x16x16) */
+#define WORLD_SECTION_SHIFT 4
+/* Packs the x,y,z of the section that contains the given coordinates into a single index */
+#define World_SectionIndex(x, y, z) ((((y) >> WORLD_SECTION_SHIFT) * World.SectionsZ + ((z) >> WORLD_SECTION_SHIFT)) * World.SectionsX + ((x) >> WORLD_SECTION_SHIFT))
 
 CC_VAR extern struct _WorldData {
 	/* The blocks in the world. */
@@ -39,6 +43,14 @@ CC_VAR extern struct _WorldData {
 	/* e.g. this will be 255 if only 8 bit blocks are used */
 	int IDMask;
 #endif
+
+	/* Number of sections along each axis of the world. */
+	int SectionsX, SectionsY, SectionsZ;
+	/* Whether each section has changed since the world was last saved. (see World_SectionIndex) */
+	/* NOTE: NULL when there is no world. */
+	cc_bool* DirtySections;
+	/* Whether any section has changed since the world was last saved. */
+	cc_bool AnyDirty;
 } World;
 extern String World_TextureUrl;
 
@@ -65,6 +77,9 @@ static CC_INLINE BlockID World_GetBlock(int x, int y, int z) {
 #define World_GetBlock(x, y, z) World_Blocks[World_Pack(x, y, z)]
 #endif
 
+/* Marks all sections of the world as not changed since last saved. */
+void World_ClearDirty(void);
+
 /* If Y is above the map, returns BLOCK_AIR. */
 /* If coordinates are outside the map, returns BLOCK_AIR. */
 /* Otherwise returns the block at the given coordinates. */